@@ -0,0 +1,507 @@
+/*
+ * Copyright (C) 2021 Purism SPC
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#define G_LOG_DOMAIN "phoc-client"
+
+#include "config.h"
+
+#include "client.h"
+#include "server.h"
+
+#include <wlr/types/wlr_linux_dmabuf_v1.h>
+#include <wlr/types/wlr_surface.h>
+#include <wlr/types/wlr_xdg_shell.h>
+
+/* Commits per second a client may have processed for surfaces nobody sees */
+#define PHOC_CLIENT_HIDDEN_COMMIT_BUDGET 30
+#define PHOC_CLIENT_BUDGET_WINDOW_MS     1000
+
+/**
+ * PhocClient:
+ *
+ * Per wl_client state. Hidden surfaces of a client only get a limited
+ * number of commits processed per second. Commits beyond that budget
+ * are deferred and coalesced: the surface's latest state is applied
+ * once per budget window or as soon as it becomes visible.
+ *
+ * With `PHOC_DEBUG=client-stats` the client's resource usage is
+ * accounted too so it can be attributed to the app.
+ */
+struct _PhocClient {
+  struct wl_client   *wl_client;
+  struct wl_listener  destroy;
+
+  gint64              window_start;
+  guint               window_hidden_commits;
+  guint               flush_id;
+
+  guint64             n_commits;
+  guint64             n_throttled;
+
+  /* Resource accounting */
+  struct wl_list      surfaces; /* PhocClientSurface::link */
+  gint64              stats_start;
+  guint               stats_commits;
+  guint64             stats_damage;
+  double              commit_rate;   /* commits per second */
+  double              damage_rate;   /* damaged pixels per second */
+  gint64              commit_time;   /* µs spent in commit handlers */
+  gint64              max_commit_time;
+};
+
+typedef struct {
+  PhocClient         *client;
+  struct wlr_surface *wlr_surface;
+  struct wl_list      link; /* PhocClient::surfaces */
+  gsize               buffer_bytes;
+
+  struct wl_listener  commit;
+  struct wl_listener  destroy;
+} PhocClientSurface;
+
+static gboolean stats_enabled;
+static struct wl_listener new_surface;
+
+
+static void
+client_handle_destroy (struct wl_listener *listener, void *data)
+{
+  PhocClient *self = wl_container_of (listener, self, destroy);
+
+  if (self->n_throttled)
+    g_debug ("Client %p: %" G_GUINT64_FORMAT " of %" G_GUINT64_FORMAT " commits throttled",
+             self->wl_client, self->n_throttled, self->n_commits);
+
+  if (self->flush_id)
+    g_source_remove (self->flush_id);
+
+  /* Surfaces might outlive the client's destroy signal */
+  while (!wl_list_empty (&self->surfaces)) {
+    PhocClientSurface *surface = wl_container_of (self->surfaces.next, surface, link);
+
+    wl_list_remove (&surface->link);
+    wl_list_init (&surface->link);
+    surface->client = NULL;
+  }
+
+  wl_list_remove (&self->destroy.link);
+  g_free (self);
+}
+
+
+static gboolean
+on_flush_deferred_commits (gpointer data)
+{
+  PhocClient *self = data;
+  PhocServer *server = phoc_server_get_default ();
+  struct roots_view *view, *tmp;
+
+  self->flush_id = 0;
+
+  wl_list_for_each_safe (view, tmp, &server->desktop->views, link) {
+    if (!view->commit_deferred || view->wlr_surface == NULL)
+      continue;
+
+    if (wl_resource_get_client (view->wlr_surface->resource) != self->wl_client)
+      continue;
+
+    view_flush_deferred_commit (view);
+  }
+
+  return G_SOURCE_REMOVE;
+}
+
+/**
+ * phoc_client_from_wl_client:
+ * @wl_client: The wayland client
+ *
+ * Get the phoc side state of a client, creating it if needed. It's
+ * freed when the client goes away.
+ *
+ * Returns: (transfer none): The client
+ */
+PhocClient *
+phoc_client_from_wl_client (struct wl_client *wl_client)
+{
+  struct wl_listener *listener;
+  PhocClient *self;
+
+  g_return_val_if_fail (wl_client, NULL);
+
+  listener = wl_client_get_destroy_listener (wl_client, client_handle_destroy);
+  if (listener)
+    return wl_container_of (listener, self, destroy);
+
+  self = g_new0 (PhocClient, 1);
+  self->wl_client = wl_client;
+  self->destroy.notify = client_handle_destroy;
+  wl_client_add_destroy_listener (wl_client, &self->destroy);
+  wl_list_init (&self->surfaces);
+
+  return self;
+}
+
+/**
+ * phoc_client_account_commit:
+ * @self: The client
+ * @visible: Whether the committed surface is visible on any output
+ *
+ * Account a surface commit of the client. Commits of visible surfaces
+ * are always processed. Commits of hidden surfaces are only processed
+ * while the client is within its budget. Otherwise the caller should
+ * mark the view's commit as deferred, it will be flushed later on.
+ *
+ * Returns: %TRUE if the commit should be processed right away
+ */
+gboolean
+phoc_client_account_commit (PhocClient *self, gboolean visible)
+{
+  gint64 now = g_get_monotonic_time ();
+
+  g_return_val_if_fail (self, TRUE);
+
+  self->n_commits++;
+  if (visible)
+    return TRUE;
+
+  if (now - self->window_start > PHOC_CLIENT_BUDGET_WINDOW_MS * 1000) {
+    self->window_start = now;
+    self->window_hidden_commits = 0;
+  }
+
+  if (++self->window_hidden_commits <= PHOC_CLIENT_HIDDEN_COMMIT_BUDGET)
+    return TRUE;
+
+  self->n_throttled++;
+  if (self->flush_id == 0) {
+    gint64 remaining_ms = PHOC_CLIENT_BUDGET_WINDOW_MS - (now - self->window_start) / 1000;
+
+    self->flush_id = g_timeout_add (MAX (remaining_ms, 1), on_flush_deferred_commits, self);
+    g_source_set_name_by_id (self->flush_id, "[phoc] flush deferred commits");
+  }
+
+  return FALSE;
+}
+
+
+static PhocClient *
+client_lookup (struct wl_client *wl_client)
+{
+  struct wl_listener *listener;
+  PhocClient *self;
+
+  listener = wl_client_get_destroy_listener (wl_client, client_handle_destroy);
+  if (listener == NULL)
+    return NULL;
+
+  return wl_container_of (listener, self, destroy);
+}
+
+
+static gsize
+surface_buffer_bytes (struct wlr_surface *wlr_surface)
+{
+  struct wlr_client_buffer *buffer = wlr_surface->buffer;
+  struct wl_shm_buffer *shm_buffer;
+  gsize bytes = 0;
+
+  if (buffer == NULL)
+    return 0;
+
+  if (buffer->resource) {
+    shm_buffer = wl_shm_buffer_get (buffer->resource);
+    if (shm_buffer)
+      return (gsize)wl_shm_buffer_get_stride (shm_buffer) * wl_shm_buffer_get_height (shm_buffer);
+
+    if (wlr_dmabuf_v1_resource_is_buffer (buffer->resource)) {
+      struct wlr_dmabuf_v1_buffer *dmabuf =
+        wlr_dmabuf_v1_buffer_from_buffer_resource (buffer->resource);
+
+      /* Overestimates subsampled planes but good enough for attribution */
+      for (int i = 0; i < dmabuf->attributes.n_planes; i++)
+        bytes += (gsize)dmabuf->attributes.stride[i] * dmabuf->attributes.height;
+      return bytes;
+    }
+  }
+
+  /* Unknown buffer type, assume 32bpp */
+  return (gsize)buffer->base.width * buffer->base.height * 4;
+}
+
+
+static guint
+surface_depth (struct wlr_surface *wlr_surface)
+{
+  guint depth = 0;
+
+  while (wlr_surface) {
+    if (wlr_surface_is_subsurface (wlr_surface)) {
+      wlr_surface = wlr_subsurface_from_wlr_surface (wlr_surface)->parent;
+    } else if (wlr_surface_is_xdg_surface (wlr_surface)) {
+      struct wlr_xdg_surface *xdg_surface = wlr_xdg_surface_from_wlr_surface (wlr_surface);
+
+      if (xdg_surface->role != WLR_XDG_SURFACE_ROLE_POPUP || xdg_surface->popup == NULL)
+        break;
+      wlr_surface = xdg_surface->popup->parent;
+    } else {
+      break;
+    }
+    depth++;
+  }
+
+  return depth;
+}
+
+
+static void
+client_update_rates (PhocClient *self, gint64 now)
+{
+  gint64 elapsed = now - self->stats_start;
+
+  if (elapsed < G_USEC_PER_SEC)
+    return;
+
+  self->commit_rate = (double)self->stats_commits * G_USEC_PER_SEC / elapsed;
+  self->damage_rate = (double)self->stats_damage * G_USEC_PER_SEC / elapsed;
+  self->stats_commits = 0;
+  self->stats_damage = 0;
+  self->stats_start = now;
+}
+
+
+static void
+client_surface_handle_commit (struct wl_listener *listener, void *data)
+{
+  PhocClientSurface *surface = wl_container_of (listener, surface, commit);
+  PhocClient *client = surface->client;
+  pixman_region32_t damage;
+  pixman_box32_t *rects;
+  int n_rects;
+
+  surface->buffer_bytes = surface_buffer_bytes (surface->wlr_surface);
+
+  if (client == NULL)
+    return;
+
+  client_update_rates (client, g_get_monotonic_time ());
+  client->stats_commits++;
+
+  pixman_region32_init (&damage);
+  wlr_surface_get_effective_damage (surface->wlr_surface, &damage);
+  rects = pixman_region32_rectangles (&damage, &n_rects);
+  for (int i = 0; i < n_rects; i++)
+    client->stats_damage += (guint64)(rects[i].x2 - rects[i].x1) * (rects[i].y2 - rects[i].y1);
+  pixman_region32_fini (&damage);
+}
+
+
+static void
+client_surface_handle_destroy (struct wl_listener *listener, void *data)
+{
+  PhocClientSurface *surface = wl_container_of (listener, surface, destroy);
+
+  wl_list_remove (&surface->commit.link);
+  wl_list_remove (&surface->destroy.link);
+  wl_list_remove (&surface->link);
+  g_free (surface);
+}
+
+
+static void
+handle_new_surface (struct wl_listener *listener, void *data)
+{
+  struct wlr_surface *wlr_surface = data;
+  PhocClientSurface *surface = g_new0 (PhocClientSurface, 1);
+
+  surface->wlr_surface = wlr_surface;
+  surface->client = phoc_client_from_wl_client (wl_resource_get_client (wlr_surface->resource));
+  wl_list_insert (&surface->client->surfaces, &surface->link);
+
+  surface->commit.notify = client_surface_handle_commit;
+  wl_signal_add (&wlr_surface->events.commit, &surface->commit);
+  surface->destroy.notify = client_surface_handle_destroy;
+  wl_signal_add (&wlr_surface->events.destroy, &surface->destroy);
+}
+
+/**
+ * phoc_client_stats_init:
+ * @compositor: The compositor creating the clients' surfaces
+ *
+ * Start accounting surfaces, buffers, commits and damage per
+ * client. This needs to happen before any client connects.
+ */
+void
+phoc_client_stats_init (struct wlr_compositor *compositor)
+{
+  g_return_if_fail (!stats_enabled);
+
+  stats_enabled = TRUE;
+  new_surface.notify = handle_new_surface;
+  wl_signal_add (&compositor->events.new_surface, &new_surface);
+}
+
+/**
+ * phoc_client_commit_begin:
+ *
+ * Mark the start of a commit handler. Pass the result to
+ * phoc_client_commit_end() once the handler is done.
+ *
+ * Returns: The start time or 0 if client statistics are disabled
+ */
+gint64
+phoc_client_commit_begin (void)
+{
+  if (G_LIKELY (!stats_enabled))
+    return 0;
+
+  return g_get_monotonic_time ();
+}
+
+/**
+ * phoc_client_commit_end:
+ * @surface: The committed surface
+ * @start: The value returned from phoc_client_commit_begin()
+ *
+ * Account the time spent in a commit handler to the client
+ * owning @surface.
+ */
+void
+phoc_client_commit_end (struct wlr_surface *surface, gint64 start)
+{
+  PhocClient *client;
+  gint64 elapsed;
+
+  if (G_LIKELY (start == 0) || surface == NULL)
+    return;
+
+  client = client_lookup (wl_resource_get_client (surface->resource));
+  if (client == NULL)
+    return;
+
+  elapsed = g_get_monotonic_time () - start;
+  client->commit_time += elapsed;
+  client->max_commit_time = MAX (client->max_commit_time, elapsed);
+}
+
+
+typedef struct {
+  pid_t    pid;
+  char    *command;
+  guint    n_surfaces;
+  guint    max_depth;
+  guint64  buffer_bytes;
+} PhocClientSummary;
+
+
+static void
+client_summarize (PhocClient *self, PhocClientSummary *summary)
+{
+  g_autofree char *path = NULL;
+  PhocClientSurface *surface;
+  char *comm = NULL;
+
+  wl_client_get_credentials (self->wl_client, &summary->pid, NULL, NULL);
+  path = g_strdup_printf ("/proc/%d/comm", summary->pid);
+  if (g_file_get_contents (path, &comm, NULL, NULL))
+    g_strstrip (comm);
+  summary->command = comm;
+
+  summary->n_surfaces = 0;
+  summary->max_depth = 0;
+  summary->buffer_bytes = 0;
+  wl_list_for_each (surface, &self->surfaces, link) {
+    summary->n_surfaces++;
+    summary->max_depth = MAX (summary->max_depth, surface_depth (surface->wlr_surface));
+    summary->buffer_bytes += surface->buffer_bytes;
+  }
+
+  client_update_rates (self, g_get_monotonic_time ());
+}
+
+/**
+ * phoc_client_stats_to_string:
+ * @display: The wayland display
+ *
+ * Returns: (transfer full): Human readable resource usage of all clients
+ */
+char *
+phoc_client_stats_to_string (struct wl_display *display)
+{
+  GString *str = g_string_new ("Clients:\n");
+  struct wl_client *wl_client;
+
+  wl_client_for_each (wl_client, wl_display_get_client_list (display)) {
+    PhocClient *client = client_lookup (wl_client);
+    PhocClientSummary summary;
+    g_autofree char *size = NULL;
+
+    if (client == NULL)
+      continue;
+
+    client_summarize (client, &summary);
+    size = g_format_size (summary.buffer_bytes);
+    g_string_append_printf (str,
+                            "  %d (%s): surfaces=%u depth=%u buffers=%s "
+                            "commits=%.1f/s damage=%.0fpx/s "
+                            "commit-time=%" G_GINT64_FORMAT "µs (max %" G_GINT64_FORMAT "µs) "
+                            "throttled=%" G_GUINT64_FORMAT "\n",
+                            summary.pid, summary.command ?: "unknown",
+                            summary.n_surfaces, summary.max_depth, size,
+                            client->commit_rate, client->damage_rate,
+                            client->commit_time, client->max_commit_time,
+                            client->n_throttled);
+    g_free (summary.command);
+  }
+
+  return g_string_free (str, FALSE);
+}
+
+/**
+ * phoc_client_stats_to_variant:
+ * @display: The wayland display
+ *
+ * Returns: (transfer floating): The resource usage of all clients as `aa{sv}`
+ */
+GVariant *
+phoc_client_stats_to_variant (struct wl_display *display)
+{
+  GVariantBuilder builder;
+  struct wl_client *wl_client;
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("aa{sv}"));
+
+  wl_client_for_each (wl_client, wl_display_get_client_list (display)) {
+    PhocClient *client = client_lookup (wl_client);
+    PhocClientSummary summary;
+
+    if (client == NULL)
+      continue;
+
+    client_summarize (client, &summary);
+    g_variant_builder_open (&builder, G_VARIANT_TYPE ("a{sv}"));
+    g_variant_builder_add (&builder, "{sv}", "pid", g_variant_new_uint32 (summary.pid));
+    g_variant_builder_add (&builder, "{sv}", "command",
+                           g_variant_new_string (summary.command ?: ""));
+    g_variant_builder_add (&builder, "{sv}", "surfaces", g_variant_new_uint32 (summary.n_surfaces));
+    g_variant_builder_add (&builder, "{sv}", "max-depth", g_variant_new_uint32 (summary.max_depth));
+    g_variant_builder_add (&builder, "{sv}", "buffer-bytes",
+                           g_variant_new_uint64 (summary.buffer_bytes));
+    g_variant_builder_add (&builder, "{sv}", "commits-per-second",
+                           g_variant_new_double (client->commit_rate));
+    g_variant_builder_add (&builder, "{sv}", "damage-per-second",
+                           g_variant_new_double (client->damage_rate));
+    g_variant_builder_add (&builder, "{sv}", "commit-time-us",
+                           g_variant_new_int64 (client->commit_time));
+    g_variant_builder_add (&builder, "{sv}", "max-commit-time-us",
+                           g_variant_new_int64 (client->max_commit_time));
+    g_variant_builder_add (&builder, "{sv}", "throttled-commits",
+                           g_variant_new_uint64 (client->n_throttled));
+    g_variant_builder_close (&builder);
+    g_free (summary.command);
+  }
+
+  return g_variant_builder_end (&builder);
+}
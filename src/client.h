@@ -0,0 +1,26 @@
+/*
+ * Copyright (C) 2021 Purism SPC
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <glib.h>
+#include <wayland-server-core.h>
+#include <wlr/types/wlr_compositor.h>
+
+G_BEGIN_DECLS
+
+typedef struct _PhocClient PhocClient;
+
+PhocClient *phoc_client_from_wl_client (struct wl_client *wl_client);
+gboolean    phoc_client_account_commit (PhocClient *self, gboolean visible);
+
+void        phoc_client_stats_init     (struct wlr_compositor *compositor);
+gint64      phoc_client_commit_begin   (void);
+void        phoc_client_commit_end     (struct wlr_surface *surface, gint64 start);
+char       *phoc_client_stats_to_string  (struct wl_display *display);
+GVariant   *phoc_client_stats_to_variant (struct wl_display *display);
+
+G_END_DECLS
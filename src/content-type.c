@@ -0,0 +1,369 @@
+/*
+ * Copyright (C) 2021 Purism SPC
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#define G_LOG_DOMAIN "phoc-content-type"
+
+#include "config.h"
+
+#include <content-type-v1-protocol.h>
+#include "content-type.h"
+
+#include <math.h>
+
+/* Longer gaps between frames mean playback is paused or stalled */
+#define CONTENT_MAX_FRAME_INTERVAL_US (G_USEC_PER_SEC / 10)
+/* Number of frame intervals the rate estimate is averaged over */
+#define CONTENT_RATE_WINDOW 30
+
+/**
+ * PhocContentTypeManager:
+ *
+ * Implements wp_content_type_manager_v1 so clients can hint what kind
+ * of content (photo, video, game) a surface shows. The compositor uses
+ * that to pick latency and power trade-offs.
+ */
+struct _PhocContentTypeManager {
+  struct wl_global           *global;
+  /* wlr_surface -> PhocContentTypeObject */
+  GHashTable                 *objects;
+  PhocContentTypeChangedFunc  changed_func;
+  gpointer                    user_data;
+};
+
+typedef struct {
+  struct wl_resource     *resource;
+  struct wlr_surface     *wlr_surface;
+  PhocContentTypeManager *manager;
+  PhocContentType         pending;
+  PhocContentType         current;
+
+  /* Frame rate estimate of video content */
+  gint64                  window_start; /* µs, monotonic */
+  gint64                  last_frame;   /* µs, monotonic */
+  guint                   n_intervals;
+  int                     rate;         /* mHz */
+
+  struct wl_listener      surface_commit;
+  struct wl_listener      surface_destroy;
+} PhocContentTypeObject;
+
+
+static void
+content_type_object_detach (PhocContentTypeObject *object)
+{
+  if (object->wlr_surface == NULL)
+    return;
+
+  g_hash_table_remove (object->manager->objects, object->wlr_surface);
+  wl_list_remove (&object->surface_commit.link);
+  wl_list_remove (&object->surface_destroy.link);
+  object->wlr_surface = NULL;
+}
+
+
+static const int common_video_rates[] = {
+  23976, 24000, 25000, 29970, 30000, 48000, 50000, 59940, 60000,
+};
+
+static int
+snap_video_rate (double rate)
+{
+  int best = 0;
+  double best_diff = 0;
+
+  for (size_t i = 0; i < G_N_ELEMENTS (common_video_rates); i++) {
+    double diff = fabs (rate - common_video_rates[i]) / common_video_rates[i];
+    /* Allow for some jitter in commit timing */
+    if (diff < 0.015 && (best == 0 || diff < best_diff)) {
+      best = common_video_rates[i];
+      best_diff = diff;
+    }
+  }
+  return best;
+}
+
+
+static void
+content_type_object_reset_rate (PhocContentTypeObject *object)
+{
+  object->window_start = 0;
+  object->last_frame = 0;
+  object->n_intervals = 0;
+  object->rate = 0;
+}
+
+
+/*
+ * Estimate the frame rate of video content from the intervals between
+ * new buffers on the hinted surface, averaged over a window of frames
+ * so jitter of single commits doesn't matter.
+ *
+ * Returns: %TRUE if the estimate changed
+ */
+static gboolean
+content_type_object_update_rate (PhocContentTypeObject *object)
+{
+  gint64 now = g_get_monotonic_time ();
+  int rate;
+
+  if (!(object->wlr_surface->current.committed & WLR_SURFACE_STATE_BUFFER))
+    return FALSE;
+
+  if (object->last_frame == 0 || now - object->last_frame > CONTENT_MAX_FRAME_INTERVAL_US) {
+    object->window_start = now;
+    object->n_intervals = 0;
+  } else {
+    object->n_intervals++;
+  }
+  object->last_frame = now;
+
+  if (object->n_intervals < CONTENT_RATE_WINDOW || now <= object->window_start)
+    return FALSE;
+
+  rate = snap_video_rate (1e9 * object->n_intervals / (now - object->window_start));
+  object->window_start = now;
+  object->n_intervals = 0;
+
+  if (rate == 0 || rate == object->rate)
+    return FALSE;
+
+  object->rate = rate;
+  return TRUE;
+}
+
+
+static void
+handle_surface_commit (struct wl_listener *listener, void *data)
+{
+  PhocContentTypeObject *object = wl_container_of (listener, object, surface_commit);
+  PhocContentTypeManager *manager = object->manager;
+
+  if (object->pending == object->current) {
+    if (object->current != PHOC_CONTENT_TYPE_VIDEO || !content_type_object_update_rate (object))
+      return;
+
+    g_debug ("Video rate of surface %p is %d mHz", object->wlr_surface, object->rate);
+  } else {
+    object->current = object->pending;
+    content_type_object_reset_rate (object);
+    g_debug ("Content type of surface %p changed to %d", object->wlr_surface, object->current);
+  }
+
+  if (manager->changed_func)
+    manager->changed_func (object->wlr_surface, object->current, object->rate, manager->user_data);
+}
+
+
+static void
+handle_surface_destroy (struct wl_listener *listener, void *data)
+{
+  PhocContentTypeObject *object = wl_container_of (listener, object, surface_destroy);
+
+  content_type_object_detach (object);
+}
+
+
+static void
+content_type_handle_resource_destroy (struct wl_resource *resource)
+{
+  PhocContentTypeObject *object = wl_resource_get_user_data (resource);
+  PhocContentTypeManager *manager = object->manager;
+
+  /* Strictly speaking this should only apply on the next commit but the
+   * surface might never be committed again */
+  if (object->wlr_surface && object->current != PHOC_CONTENT_TYPE_NONE && manager->changed_func)
+    manager->changed_func (object->wlr_surface, PHOC_CONTENT_TYPE_NONE, 0, manager->user_data);
+
+  content_type_object_detach (object);
+  g_free (object);
+}
+
+
+static void
+handle_destroy (struct wl_client *client, struct wl_resource *resource)
+{
+  wl_resource_destroy (resource);
+}
+
+
+static void
+handle_set_content_type (struct wl_client   *client,
+                         struct wl_resource *resource,
+                         uint32_t            content_type)
+{
+  PhocContentTypeObject *object = wl_resource_get_user_data (resource);
+
+  switch (content_type) {
+  case WP_CONTENT_TYPE_V1_TYPE_NONE:
+  case WP_CONTENT_TYPE_V1_TYPE_PHOTO:
+  case WP_CONTENT_TYPE_V1_TYPE_VIDEO:
+  case WP_CONTENT_TYPE_V1_TYPE_GAME:
+    object->pending = content_type;
+    break;
+  default:
+    /* The protocol has no error for this, treat unknown hints as none */
+    object->pending = PHOC_CONTENT_TYPE_NONE;
+    break;
+  }
+}
+
+
+static const struct wp_content_type_v1_interface content_type_impl = {
+  .destroy = handle_destroy,
+  .set_content_type = handle_set_content_type,
+};
+
+
+static void
+handle_get_surface_content_type (struct wl_client   *client,
+                                 struct wl_resource *manager_resource,
+                                 uint32_t            id,
+                                 struct wl_resource *surface_resource)
+{
+  PhocContentTypeManager *self = wl_resource_get_user_data (manager_resource);
+  struct wlr_surface *wlr_surface = wlr_surface_from_resource (surface_resource);
+  PhocContentTypeObject *object;
+
+  if (g_hash_table_contains (self->objects, wlr_surface)) {
+    wl_resource_post_error (manager_resource,
+                            WP_CONTENT_TYPE_MANAGER_V1_ERROR_ALREADY_CONSTRUCTED,
+                            "wl_surface already has a content type object");
+    return;
+  }
+
+  object = g_new0 (PhocContentTypeObject, 1);
+  object->resource = wl_resource_create (client, &wp_content_type_v1_interface,
+                                         wl_resource_get_version (manager_resource),
+                                         id);
+  if (object->resource == NULL) {
+    g_free (object);
+    wl_client_post_no_memory (client);
+    return;
+  }
+  wl_resource_set_implementation (object->resource,
+                                  &content_type_impl,
+                                  object,
+                                  content_type_handle_resource_destroy);
+
+  object->manager = self;
+  object->wlr_surface = wlr_surface;
+  object->surface_commit.notify = handle_surface_commit;
+  wl_signal_add (&wlr_surface->events.commit, &object->surface_commit);
+  object->surface_destroy.notify = handle_surface_destroy;
+  wl_signal_add (&wlr_surface->events.destroy, &object->surface_destroy);
+  g_hash_table_insert (self->objects, wlr_surface, object);
+}
+
+
+static const struct wp_content_type_manager_v1_interface content_type_manager_impl = {
+  .destroy = handle_destroy,
+  .get_surface_content_type = handle_get_surface_content_type,
+};
+
+
+static void
+content_type_manager_bind (struct wl_client *client, void *data, uint32_t version, uint32_t id)
+{
+  PhocContentTypeManager *self = data;
+  struct wl_resource *resource;
+
+  resource = wl_resource_create (client, &wp_content_type_manager_v1_interface, version, id);
+  if (resource == NULL) {
+    wl_client_post_no_memory (client);
+    return;
+  }
+
+  wl_resource_set_implementation (resource, &content_type_manager_impl, self, NULL);
+}
+
+/**
+ * phoc_content_type_manager_create:
+ * @display: The wayland display
+ * @changed_func: Function to invoke when a surface's content type changes
+ * @user_data: User data for @changed_func
+ *
+ * Create the wp_content_type_manager_v1 global.
+ *
+ * Returns: The new content type manager
+ */
+PhocContentTypeManager *
+phoc_content_type_manager_create (struct wl_display          *display,
+                                  PhocContentTypeChangedFunc  changed_func,
+                                  gpointer                    user_data)
+{
+  PhocContentTypeManager *self = g_new0 (PhocContentTypeManager, 1);
+
+  g_info ("Initializing content type interface");
+  self->global = wl_global_create (display, &wp_content_type_manager_v1_interface,
+                                   1, self, content_type_manager_bind);
+  if (self->global == NULL) {
+    g_free (self);
+    return NULL;
+  }
+
+  self->objects = g_hash_table_new (g_direct_hash, g_direct_equal);
+  self->changed_func = changed_func;
+  self->user_data = user_data;
+
+  return self;
+}
+
+/**
+ * phoc_content_type_manager_destroy:
+ * @self: The content type manager
+ *
+ * Destroy the global. Content type objects of clients stay around
+ * until the clients destroy them but become inert.
+ */
+void
+phoc_content_type_manager_destroy (PhocContentTypeManager *self)
+{
+  GHashTableIter iter;
+  PhocContentTypeObject *object;
+
+  g_hash_table_iter_init (&iter, self->objects);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *)&object)) {
+    wl_list_remove (&object->surface_commit.link);
+    wl_list_remove (&object->surface_destroy.link);
+    object->wlr_surface = NULL;
+    g_hash_table_iter_remove (&iter);
+  }
+
+  g_hash_table_destroy (self->objects);
+  wl_global_destroy (self->global);
+  g_free (self);
+}
+
+/**
+ * phoc_content_type_manager_get_content_type:
+ * @self: The content type manager
+ * @surface: The surface
+ * @content_rate: (out) (optional): The estimated frame rate in mHz of
+ *   video content, 0 if not known
+ *
+ * Returns: The currently committed content type of @surface
+ */
+PhocContentType
+phoc_content_type_manager_get_content_type (PhocContentTypeManager *self,
+                                            struct wlr_surface     *surface,
+                                            int                    *content_rate)
+{
+  PhocContentTypeObject *object;
+
+  if (content_rate)
+    *content_rate = 0;
+
+  g_return_val_if_fail (self, PHOC_CONTENT_TYPE_NONE);
+  g_return_val_if_fail (surface, PHOC_CONTENT_TYPE_NONE);
+
+  object = g_hash_table_lookup (self->objects, surface);
+  if (object == NULL)
+    return PHOC_CONTENT_TYPE_NONE;
+
+  if (content_rate)
+    *content_rate = object->rate;
+  return object->current;
+}
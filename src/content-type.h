@@ -0,0 +1,46 @@
+/*
+ * Copyright (C) 2021 Purism SPC
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <glib.h>
+#include <wayland-server-core.h>
+#include <wlr/types/wlr_surface.h>
+
+G_BEGIN_DECLS
+
+/**
+ * PhocContentType:
+ * @PHOC_CONTENT_TYPE_NONE: No content type hint
+ * @PHOC_CONTENT_TYPE_PHOTO: Still images
+ * @PHOC_CONTENT_TYPE_VIDEO: Video or animations, smooth playback matters
+ * @PHOC_CONTENT_TYPE_GAME: Games, latency matters
+ *
+ * The kind of content a surface shows as hinted by the client.
+ */
+typedef enum {
+  PHOC_CONTENT_TYPE_NONE  = 0,
+  PHOC_CONTENT_TYPE_PHOTO = 1,
+  PHOC_CONTENT_TYPE_VIDEO = 2,
+  PHOC_CONTENT_TYPE_GAME  = 3,
+} PhocContentType;
+
+typedef struct _PhocContentTypeManager PhocContentTypeManager;
+
+typedef void (*PhocContentTypeChangedFunc) (struct wlr_surface *surface,
+                                            PhocContentType     content_type,
+                                            int                 content_rate,
+                                            gpointer            user_data);
+
+PhocContentTypeManager *phoc_content_type_manager_create  (struct wl_display          *display,
+                                                           PhocContentTypeChangedFunc  changed_func,
+                                                           gpointer                    user_data);
+void                    phoc_content_type_manager_destroy (PhocContentTypeManager *self);
+PhocContentType         phoc_content_type_manager_get_content_type (PhocContentTypeManager *self,
+                                                                    struct wlr_surface     *surface,
+                                                                    int                    *content_rate);
+
+G_END_DECLS
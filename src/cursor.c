@@ -21,6 +21,7 @@
 #include <linux/input-event-codes.h>
 #include "cursor.h"
 #include "desktop.h"
+#include "output.h"
 #include "utils.h"
 #include "view.h"
 #include "xcursor.h"
@@ -148,26 +149,85 @@ seat_view_deco_button (PhocSeatView *view, double sx,
 }
 
 static bool
-roots_handle_shell_reveal (struct wlr_surface *surface, double lx, double ly, int threshold)
+is_layer_surface_tree (struct wlr_surface *surface)
 {
-  PhocServer *server = phoc_server_get_default ();
-  PhocDesktop *desktop = server->desktop;
+  struct wlr_surface *root = wlr_surface_get_root_surface (surface), *iter = root;
 
-  if (surface) {
-    struct wlr_surface *root = wlr_surface_get_root_surface (surface), *iter = root;
+  while (wlr_surface_is_xdg_surface (iter)) {
+    struct wlr_xdg_surface *xdg_surface = wlr_xdg_surface_from_wlr_surface (iter);
+    if (xdg_surface->role == WLR_XDG_SURFACE_ROLE_POPUP) {
+      iter = xdg_surface->popup->parent;
+    } else {
+      break;
+    }
+  }
 
-    while (wlr_surface_is_xdg_surface (iter)) {
-      struct wlr_xdg_surface *xdg_surface = wlr_xdg_surface_from_wlr_surface (iter);
-      if (xdg_surface->role == WLR_XDG_SURFACE_ROLE_POPUP) {
-        iter = xdg_surface->popup->parent;
-      } else {
-        break;
-      }
+  return wlr_surface_is_layer_surface (iter);
+}
+
+/*
+ * Get the panel on the given edge of the output, that is a surface
+ * in the top layer anchored to that edge and spanning the output.
+ */
+static struct roots_layer_surface *
+get_shell_panel (PhocOutput *output, uint32_t edge)
+{
+  struct roots_layer_surface *roots_surface;
+  const uint32_t both_horiz = ZWLR_LAYER_SURFACE_V1_ANCHOR_LEFT
+                              | ZWLR_LAYER_SURFACE_V1_ANCHOR_RIGHT;
+  const uint32_t both_vert = ZWLR_LAYER_SURFACE_V1_ANCHOR_TOP
+                             | ZWLR_LAYER_SURFACE_V1_ANCHOR_BOTTOM;
+
+  wl_list_for_each (roots_surface, &output->layers[ZWLR_LAYER_SHELL_V1_LAYER_TOP], link) {
+    struct wlr_layer_surface_v1_state *state = &roots_surface->layer_surface->current;
+
+    if ((edge == WLR_EDGE_TOP && state->anchor == (both_horiz | ZWLR_LAYER_SURFACE_V1_ANCHOR_TOP)) ||
+        (edge == WLR_EDGE_BOTTOM && state->anchor == (both_horiz | ZWLR_LAYER_SURFACE_V1_ANCHOR_BOTTOM)) ||
+        (edge == WLR_EDGE_LEFT && state->anchor == (both_vert | ZWLR_LAYER_SURFACE_V1_ANCHOR_LEFT)) ||
+        (edge == WLR_EDGE_RIGHT && state->anchor == (both_vert | ZWLR_LAYER_SURFACE_V1_ANCHOR_RIGHT))) {
+      return roots_surface;
     }
+  }
+
+  return NULL;
+}
+
+static uint32_t
+get_shell_edges (PhocOutput *output)
+{
+  const uint32_t all[] = { WLR_EDGE_TOP, WLR_EDGE_BOTTOM, WLR_EDGE_LEFT, WLR_EDGE_RIGHT };
+  uint32_t edges = WLR_EDGE_NONE;
 
-    if (wlr_surface_is_layer_surface (iter)) {
-      return false;
+  for (guint i = 0; i < G_N_ELEMENTS (all); i++) {
+    if (get_shell_panel (output, all[i]))
+      edges |= all[i];
+  }
+
+  return edges;
+}
+
+static void
+set_shell_reveal (PhocOutput *output, bool reveal)
+{
+  if (reveal) {
+    if (output->fullscreen_view) {
+      output->force_shell_reveal = true;
+      phoc_output_damage_whole (output);
     }
+  } else if (output->force_shell_reveal) {
+    output->force_shell_reveal = false;
+    phoc_output_damage_whole (output);
+  }
+}
+
+static bool
+roots_handle_shell_reveal (struct wlr_surface *surface, double lx, double ly, int threshold)
+{
+  PhocServer *server = phoc_server_get_default ();
+  PhocDesktop *desktop = server->desktop;
+
+  if (surface && is_layer_surface_tree (surface)) {
+    return false;
   }
 
   struct wlr_output *wlr_output = wlr_output_layout_output_at (desktop->layout, lx, ly);
@@ -181,50 +241,257 @@ roots_handle_shell_reveal (struct wlr_surface *surface, double lx, double ly, in
   struct wlr_box *output_box =
     wlr_output_layout_get_box (desktop->layout, wlr_output);
 
-  struct roots_layer_surface *roots_surface;
-  bool left = false, right = false, top = false, bottom = false;
-
-  wl_list_for_each (roots_surface, &output->layers[ZWLR_LAYER_SHELL_V1_LAYER_TOP], link) {
-    struct wlr_layer_surface_v1 *layer = roots_surface->layer_surface;
-    struct wlr_layer_surface_v1_state *state = &layer->current;
-    const uint32_t both_horiz = ZWLR_LAYER_SURFACE_V1_ANCHOR_LEFT
-                                | ZWLR_LAYER_SURFACE_V1_ANCHOR_RIGHT;
-    const uint32_t both_vert = ZWLR_LAYER_SURFACE_V1_ANCHOR_TOP
-                               | ZWLR_LAYER_SURFACE_V1_ANCHOR_BOTTOM;
-
-    if (state->anchor == (both_horiz | ZWLR_LAYER_SURFACE_V1_ANCHOR_TOP)) {
-      top = true;
-    }
-    if (state->anchor == (both_horiz | ZWLR_LAYER_SURFACE_V1_ANCHOR_BOTTOM)) {
-      bottom = true;
-    }
-    if (state->anchor == (both_vert | ZWLR_LAYER_SURFACE_V1_ANCHOR_LEFT)) {
-      left = true;
-    }
-    if (state->anchor == (both_vert | ZWLR_LAYER_SURFACE_V1_ANCHOR_RIGHT)) {
-      right = true;
-    }
-  }
+  uint32_t edges = get_shell_edges (output);
+  bool left = edges & WLR_EDGE_LEFT, right = edges & WLR_EDGE_RIGHT;
+  bool top = edges & WLR_EDGE_TOP, bottom = edges & WLR_EDGE_BOTTOM;
 
   if ((top    && ly <= output_box->y + threshold) ||
       (bottom && ly >= output_box->y + output_box->height - 1 - threshold) ||
       (left   && lx <= output_box->x + threshold) ||
       (right  && lx >= output_box->x + output_box->width - 1 - threshold)) {
-    if (output->fullscreen_view) {
-      output->force_shell_reveal = true;
-      phoc_output_damage_whole (output);
-    }
+    set_shell_reveal (output, true);
     return true;
   } else {
-    if (output->force_shell_reveal) {
-      output->force_shell_reveal = false;
-      phoc_output_damage_whole (output);
-    }
+    set_shell_reveal (output, false);
   }
 
   return false;
 }
 
+static void
+get_panel_coords (PhocOutput *output, struct roots_layer_surface *panel,
+                  double lx, double ly, double *sx, double *sy)
+{
+  PhocServer *server = phoc_server_get_default ();
+  struct wlr_box *output_box =
+    wlr_output_layout_get_box (server->desktop->layout, output->wlr_output);
+
+  *sx = lx - output_box->x - panel->geo.x;
+  *sy = ly - output_box->y - panel->geo.y;
+}
+
+/*
+ * Gestures stick to the output they started on even when the fingers
+ * cross into another one. The output might go away mid gesture.
+ */
+static void
+set_gesture_output (PhocCursor *self, PhocOutput *output)
+{
+  if (self->gesture_output == output)
+    return;
+
+  if (self->gesture_output)
+    g_object_remove_weak_pointer (G_OBJECT (self->gesture_output),
+                                  (gpointer *)&self->gesture_output);
+  self->gesture_output = output;
+  if (self->gesture_output)
+    g_object_add_weak_pointer (G_OBJECT (self->gesture_output),
+                               (gpointer *)&self->gesture_output);
+}
+
+
+static PhocOutput *
+get_output_at (double lx, double ly)
+{
+  PhocServer *server = phoc_server_get_default ();
+  struct wlr_output *wlr_output;
+
+  wlr_output = wlr_output_layout_output_at (server->desktop->layout, lx, ly);
+  return wlr_output ? wlr_output->data : NULL;
+}
+
+/*
+ * Edge swipes reveal the shell and hand the touch sequence to the panel
+ * on that edge right away so it tracks the finger even when covered by a
+ * fullscreen view.
+ */
+static gboolean
+on_edge_swipe (PhocCursor            *self,
+               PhocGestureState       state,
+               guint                  edge,
+               int                    touch_id,
+               guint                  time,
+               double                 lx,
+               double                 ly,
+               PhocGestureRecognizer *recognizer)
+{
+  struct wlr_seat *wlr_seat = self->seat->seat;
+  struct roots_layer_surface *panel;
+  struct wlr_touch_point *point;
+  PhocOutput *output;
+  double sx, sy;
+
+  if (state == PHOC_GESTURE_STATE_BEGIN)
+    set_gesture_output (self, get_output_at (lx, ly));
+  output = self->gesture_output;
+
+  switch (state) {
+  case PHOC_GESTURE_STATE_BEGIN:
+    if (output == NULL)
+      return FALSE;
+    set_shell_reveal (output, true);
+    panel = get_shell_panel (output, edge);
+    if (panel && phoc_seat_allow_input (self->seat, panel->layer_surface->resource)) {
+      get_panel_coords (output, panel, lx, ly, &sx, &sy);
+      wlr_seat_touch_notify_down (wlr_seat, panel->layer_surface->surface, time, touch_id, sx, sy);
+      wlr_seat_touch_point_focus (wlr_seat, panel->layer_surface->surface, time, touch_id, sx, sy);
+    }
+    return TRUE;
+  case PHOC_GESTURE_STATE_UPDATE:
+    if (output == NULL)
+      return TRUE;
+    point = wlr_seat_touch_get_point (wlr_seat, touch_id);
+    panel = get_shell_panel (output, edge);
+    if (point && panel && point->surface == panel->layer_surface->surface) {
+      get_panel_coords (output, panel, lx, ly, &sx, &sy);
+      wlr_seat_touch_notify_motion (wlr_seat, time, touch_id, sx, sy);
+    }
+    return TRUE;
+  case PHOC_GESTURE_STATE_END:
+  case PHOC_GESTURE_STATE_CANCEL:
+    if (wlr_seat_touch_get_point (wlr_seat, touch_id))
+      wlr_seat_touch_notify_up (wlr_seat, time, touch_id);
+    set_gesture_output (self, NULL);
+    return TRUE;
+  default:
+    g_assert_not_reached ();
+  }
+
+  return FALSE;
+}
+
+/*
+ * Multi finger swipes over a fullscreen view reveal (downwards) or
+ * hide (upwards) the shell panels. Elsewhere they're left to clients.
+ */
+static gboolean
+on_swipe (PhocCursor            *self,
+          PhocGestureState       state,
+          guint                  n_fingers,
+          double                 dx,
+          double                 dy,
+          PhocGestureRecognizer *recognizer)
+{
+  PhocOutput *output;
+  double lx, ly;
+
+  switch (state) {
+  case PHOC_GESTURE_STATE_BEGIN:
+    if (!phoc_gesture_recognizer_get_center (recognizer, &lx, &ly))
+      return FALSE;
+    output = get_output_at (lx, ly);
+    if (output == NULL || output->fullscreen_view == NULL ||
+        get_shell_edges (output) == WLR_EDGE_NONE)
+      return FALSE;
+    set_gesture_output (self, output);
+    return TRUE;
+  case PHOC_GESTURE_STATE_UPDATE:
+    return TRUE;
+  case PHOC_GESTURE_STATE_END:
+    if (self->gesture_output && fabs (dy) > fabs (dx))
+      set_shell_reveal (self->gesture_output, dy > 0);
+    set_gesture_output (self, NULL);
+    return TRUE;
+  case PHOC_GESTURE_STATE_CANCEL:
+    set_gesture_output (self, NULL);
+    return TRUE;
+  default:
+    g_assert_not_reached ();
+  }
+
+  return FALSE;
+}
+
+/*
+ * Pinching in on the focused fullscreen view leaves fullscreen. Other
+ * pinches are left to clients.
+ */
+static gboolean
+on_pinch (PhocCursor            *self,
+          PhocGestureState       state,
+          guint                  n_fingers,
+          double                 scale,
+          PhocGestureRecognizer *recognizer)
+{
+  struct roots_view *view = phoc_seat_get_focus (self->seat);
+  PhocOutput *output;
+  double lx, ly;
+
+  switch (state) {
+  case PHOC_GESTURE_STATE_BEGIN:
+    if (view == NULL || view->fullscreen_output == NULL)
+      return FALSE;
+    if (!phoc_gesture_recognizer_get_center (recognizer, &lx, &ly))
+      return FALSE;
+    output = get_output_at (lx, ly);
+    if (output != view->fullscreen_output)
+      return FALSE;
+    set_gesture_output (self, output);
+    return TRUE;
+  case PHOC_GESTURE_STATE_UPDATE:
+    return TRUE;
+  case PHOC_GESTURE_STATE_END:
+    if (view && view->fullscreen_output &&
+        view->fullscreen_output == self->gesture_output &&
+        scale < PHOC_PINCH_UNFULLSCREEN_SCALE)
+      view_set_fullscreen (view, false, NULL);
+    set_gesture_output (self, NULL);
+    return TRUE;
+  case PHOC_GESTURE_STATE_CANCEL:
+    set_gesture_output (self, NULL);
+    return TRUE;
+  default:
+    g_assert_not_reached ();
+  }
+
+  return FALSE;
+}
+
+static void
+on_touch_cancel (PhocCursor            *self,
+                 int                    touch_id,
+                 guint                  time,
+                 PhocGestureRecognizer *recognizer)
+{
+  /* wlroots has no touch cancel so end the client's touch sequence */
+  if (wlr_seat_touch_get_point (self->seat->seat, touch_id))
+    wlr_seat_touch_notify_up (self->seat->seat, time, touch_id);
+}
+
+static bool
+phoc_cursor_gesture_touch_down (PhocCursor         *self,
+                                struct wlr_surface *surface,
+                                int                 touch_id,
+                                uint32_t            time,
+                                double              lx,
+                                double              ly)
+{
+  PhocServer *server = phoc_server_get_default ();
+  PhocDesktop *desktop = server->desktop;
+  struct wlr_output *wlr_output;
+  PhocOutput *output;
+  uint32_t edges = WLR_EDGE_NONE;
+  bool on_layer_surface = surface && is_layer_surface_tree (surface);
+  bool claimed;
+
+  wlr_output = wlr_output_layout_output_at (desktop->layout, lx, ly);
+  if (wlr_output == NULL)
+    return false;
+  output = wlr_output->data;
+
+  if (!on_layer_surface)
+    edges = get_shell_edges (output);
+
+  claimed = phoc_gesture_recognizer_touch_down (self->gestures, touch_id, time, lx, ly,
+                                                wlr_output_layout_get_box (desktop->layout, wlr_output),
+                                                edges, output->edge_zone);
+  /* Touching anything but the shell hides it again */
+  if (!claimed && !on_layer_surface)
+    set_shell_reveal (output, false);
+
+  return claimed;
+}
+
 static void
 roots_passthrough_cursor (PhocCursor *self,
                           uint32_t    time)
@@ -290,6 +557,18 @@ timespec_to_msec (const struct timespec *a)
 }
 
 
+static void
+phoc_cursor_finalize (GObject *object)
+{
+  PhocCursor *self = PHOC_CURSOR (object);
+
+  set_gesture_output (self, NULL);
+  g_clear_object (&self->gestures);
+
+  G_OBJECT_CLASS (phoc_cursor_parent_class)->finalize (object);
+}
+
+
 static void
 phoc_cursor_class_init (PhocCursorClass *klass)
 {
@@ -297,6 +576,7 @@ phoc_cursor_class_init (PhocCursorClass *klass)
 
   object_class->get_property = phoc_cursor_get_property;
   object_class->set_property = phoc_cursor_set_property;
+  object_class->finalize = phoc_cursor_finalize;
 
   props[PROP_SEAT] =
     g_param_spec_pointer ("seat",
@@ -313,6 +593,16 @@ phoc_cursor_init (PhocCursor *self)
 {
   self->cursor = wlr_cursor_create ();
   self->default_xcursor = ROOTS_XCURSOR_DEFAULT;
+
+  self->gestures = phoc_gesture_recognizer_new ();
+  g_signal_connect_swapped (self->gestures, "edge-swipe",
+                            G_CALLBACK (on_edge_swipe), self);
+  g_signal_connect_swapped (self->gestures, "swipe",
+                            G_CALLBACK (on_swipe), self);
+  g_signal_connect_swapped (self->gestures, "pinch",
+                            G_CALLBACK (on_pinch), self);
+  g_signal_connect_swapped (self->gestures, "touch-cancel",
+                            G_CALLBACK (on_touch_cancel), self);
 }
 
 
@@ -326,6 +616,68 @@ phoc_cursor_update_focus (PhocCursor *self)
   roots_passthrough_cursor (self, timespec_to_msec (&now));
 }
 
+/*
+ * The time (in msec) at which a frame rendered for the next frame
+ * event on the given output will be shown on screen.
+ */
+static uint32_t
+get_expected_presentation_time (struct wlr_output *wlr_output)
+{
+  PhocOutput *output = wlr_output->data;
+  struct timespec now;
+  int64_t now_ms, next_ms, refresh_ms;
+
+  clock_gettime (CLOCK_MONOTONIC, &now);
+  now_ms = timespec_to_msec (&now);
+
+  refresh_ms = wlr_output->refresh > 0 ? 1000000 / wlr_output->refresh : 16;
+  refresh_ms = MAX (refresh_ms, 1);
+
+  next_ms = timespec_to_msec (&output->last_frame) + refresh_ms;
+  if (next_ms < now_ms)
+    next_ms += ((now_ms - next_ms) / refresh_ms + 1) * refresh_ms;
+
+  /* What we render on the next frame event hits the screen one refresh later */
+  return (uint32_t)(next_ms + refresh_ms);
+}
+
+/*
+ * Get the position to use for compositor driven grabs. With input
+ * prediction enabled this is the cursor position extrapolated to the
+ * expected presentation time, otherwise the current cursor position.
+ */
+static void
+phoc_cursor_get_grab_position (PhocCursor *self,
+                               uint32_t    time,
+                               double     *x,
+                               double     *y)
+{
+  PhocServer *server = phoc_server_get_default ();
+  PhocDesktop *desktop = server->desktop;
+  struct wlr_output *wlr_output;
+  double px, py;
+
+  *x = self->cursor->x;
+  *y = self->cursor->y;
+
+  if (!server->config->input_prediction)
+    return;
+
+  phoc_input_predictor_add_sample (&self->predictor, time, *x, *y);
+
+  wlr_output = wlr_output_layout_output_at (desktop->layout, *x, *y);
+  if (wlr_output == NULL)
+    return;
+
+  if (!phoc_input_predictor_predict (&self->predictor,
+                                     get_expected_presentation_time (wlr_output),
+                                     &px, &py))
+    return;
+
+  /* Don't let the prediction leave the output layout */
+  wlr_output_layout_closest_point (desktop->layout, NULL, px, py, x, y);
+}
+
 void
 phoc_cursor_update_position (PhocCursor *self,
                              uint32_t    time)
@@ -343,22 +695,27 @@ phoc_cursor_update_position (PhocCursor *self,
     view = phoc_seat_get_focus (seat);
     if (view != NULL) {
       struct wlr_box geom;
+      double px, py;
+      /* Snap on the real position, a prediction might overshoot the edge */
+      double cx = self->cursor->x;
+      double cy = self->cursor->y;
       view_get_geometry (view, &geom);
-      double dx = self->cursor->x - self->offs_x;
-      double dy = self->cursor->y - self->offs_y;
+      phoc_cursor_get_grab_position (self, time, &px, &py);
+      double dx = px - self->offs_x;
+      double dy = py - self->offs_y;
 
-      struct wlr_output *wlr_output = wlr_output_layout_output_at (desktop->layout, self->cursor->x, self->cursor->y);
+      struct wlr_output *wlr_output = wlr_output_layout_output_at (desktop->layout, cx, cy);
       struct wlr_box *output_box = wlr_output_layout_get_box (desktop->layout, wlr_output);
 
       bool output_is_landscape = output_box->width > output_box->height;
 
       if (view_is_fullscreen (view)) {
         view_set_fullscreen (view, true, wlr_output);
-      } else if (self->cursor->y < output_box->y + PHOC_EDGE_SNAP_THRESHOLD) {
+      } else if (cy < output_box->y + PHOC_EDGE_SNAP_THRESHOLD) {
         view_maximize (view, wlr_output);
-      } else if (output_is_landscape && self->cursor->x < output_box->x + PHOC_EDGE_SNAP_THRESHOLD) {
+      } else if (output_is_landscape && cx < output_box->x + PHOC_EDGE_SNAP_THRESHOLD) {
         view_tile (view, PHOC_VIEW_TILE_LEFT, wlr_output);
-      } else if (output_is_landscape && self->cursor->x > output_box->x + output_box->width - PHOC_EDGE_SNAP_THRESHOLD) {
+      } else if (output_is_landscape && cx > output_box->x + output_box->width - PHOC_EDGE_SNAP_THRESHOLD) {
         view_tile (view, PHOC_VIEW_TILE_RIGHT, wlr_output);
       } else {
         view_restore (view);
@@ -371,9 +728,11 @@ phoc_cursor_update_position (PhocCursor *self,
     view = phoc_seat_get_focus (seat);
     if (view != NULL) {
       struct wlr_box geom;
+      double cx, cy;
       view_get_geometry (view, &geom);
-      double dx = self->cursor->x - self->offs_x;
-      double dy = self->cursor->y - self->offs_y;
+      phoc_cursor_get_grab_position (self, time, &cx, &cy);
+      double dx = cx - self->offs_x;
+      double dy = cy - self->offs_y;
       double x = view->box.x;
       double y = view->box.y;
       int width = self->view_width;
@@ -406,6 +765,26 @@ phoc_cursor_update_position (PhocCursor *self,
   }
 }
 
+/*
+ * End a compositor driven grab. The last update uses the real cursor
+ * position so the view doesn't stay where the prediction put it.
+ */
+static void
+phoc_cursor_end_grab (PhocCursor *self,
+                      uint32_t    time)
+{
+  if (self->mode == PHOC_CURSOR_PASSTHROUGH)
+    return;
+
+  /* Without samples the predictor can't extrapolate */
+  phoc_input_predictor_reset (&self->predictor);
+  phoc_cursor_update_position (self, time);
+  phoc_input_predictor_reset (&self->predictor);
+
+  self->mode = PHOC_CURSOR_PASSTHROUGH;
+  phoc_cursor_update_focus (self);
+}
+
 static void
 phoc_cursor_press_button (PhocCursor *self,
                           struct wlr_input_device *device, uint32_t time, uint32_t button,
@@ -455,11 +834,8 @@ phoc_cursor_press_button (PhocCursor *self,
                              sx, sy, button, state);
     }
 
-    if (state == WLR_BUTTON_RELEASED &&
-        self->mode != PHOC_CURSOR_PASSTHROUGH) {
-      self->mode = PHOC_CURSOR_PASSTHROUGH;
-      phoc_cursor_update_focus (self);
-    }
+    if (state == WLR_BUTTON_RELEASED)
+      phoc_cursor_end_grab (self, time);
 
     if (state == WLR_BUTTON_PRESSED) {
       if (view) {
@@ -601,9 +977,10 @@ phoc_cursor_handle_touch_down (PhocCursor                  *self,
   struct roots_view *view;
   struct wlr_surface *surface = phoc_desktop_surface_at (
     desktop, lx, ly, &sx, &sy, &view);
-  bool shell_revealed = roots_handle_shell_reveal (surface, lx, ly, PHOC_SHELL_REVEAL_TOUCH_THRESHOLD);
+  bool claimed = phoc_cursor_gesture_touch_down (self, surface, event->touch_id,
+                                                 event->time_msec, lx, ly);
 
-  if (!shell_revealed && surface && phoc_seat_allow_input (seat, surface->resource)) {
+  if (!claimed && surface && phoc_seat_allow_input (seat, surface->resource)) {
     wlr_seat_touch_notify_down (seat->seat, surface,
                                 event->time_msec, event->touch_id, sx, sy);
     wlr_seat_touch_point_focus (seat->seat, surface,
@@ -649,13 +1026,13 @@ phoc_cursor_handle_touch_up (PhocCursor                *self,
   if (self->seat->touch_id == event->touch_id)
     self->seat->touch_id = -1;
 
+  if (phoc_gesture_recognizer_touch_up (self->gestures, event->touch_id, event->time_msec))
+    return;
+
   if (!point)
     return;
 
-  if (self->mode != PHOC_CURSOR_PASSTHROUGH) {
-    self->mode = PHOC_CURSOR_PASSTHROUGH;
-    phoc_cursor_update_focus (self);
-  }
+  phoc_cursor_end_grab (self, event->time_msec);
 
   wlr_seat_touch_notify_up (self->seat->seat, event->time_msec,
                             event->touch_id);
@@ -669,14 +1046,18 @@ phoc_cursor_handle_touch_motion (PhocCursor                    *self,
   PhocDesktop *desktop = server->desktop;
   struct wlr_touch_point *point =
     wlr_seat_touch_get_point (self->seat->seat, event->touch_id);
-
-  if (!point)
-    return;
-
   double lx, ly;
 
   wlr_cursor_absolute_to_layout_coords (self->cursor, event->device,
                                         event->x, event->y, &lx, &ly);
+
+  if (phoc_gesture_recognizer_touch_motion (self->gestures, event->touch_id,
+                                            event->time_msec, lx, ly))
+    return;
+
+  if (!point)
+    return;
+
   struct wlr_output *wlr_output =
     wlr_output_layout_output_at (desktop->layout, lx, ly);
 
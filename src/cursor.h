@@ -7,6 +7,8 @@
 #pragma once
 
 #include <wlr/types/wlr_pointer_constraints_v1.h>
+#include "gesture-recognizer.h"
+#include "input-predictor.h"
 #include "seat.h"
 
 #include <glib-object.h>
@@ -20,6 +22,8 @@ G_DECLARE_FINAL_TYPE (PhocCursor, phoc_cursor, PHOC, CURSOR, GObject)
 #define PHOC_SHELL_REVEAL_TOUCH_THRESHOLD 10
 #define PHOC_SHELL_REVEAL_POINTER_THRESHOLD 0
 #define PHOC_EDGE_SNAP_THRESHOLD 20
+/* Finger spread relative to the start of a pinch below which a fullscreen view leaves fullscreen */
+#define PHOC_PINCH_UNFULLSCREEN_SCALE 0.7
 
 typedef enum {
   PHOC_CURSOR_PASSTHROUGH = 0,
@@ -43,12 +47,14 @@ typedef struct _PhocCursor {
   PhocCursorMode                    mode;
 
   // state from input (review if this is necessary)
-  struct wlr_xcursor_manager       *xcursor_manager;
   struct wlr_seat                  *wl_seat;
   struct wl_client                 *cursor_client;
   int                               offs_x, offs_y;
   int                               view_x, view_y, view_width, view_height;
   uint32_t                          resize_edges;
+  PhocInputPredictor                predictor;
+  PhocGestureRecognizer            *gestures;
+  PhocOutput                       *gesture_output;
 
   PhocSeatView                     *pointer_view;
   struct wlr_surface               *wlr_surface;
@@ -22,6 +22,9 @@
 #include <wlr/types/wlr_pointer_constraints_v1.h>
 #include <wlr/types/wlr_server_decoration.h>
 #include <wlr/types/wlr_tablet_v2.h>
+#ifdef PHOC_HAVE_WLR_VIEWPORTER
+#include <wlr/types/wlr_viewporter.h>
+#endif
 #include <wlr/types/wlr_xcursor_manager.h>
 #include <wlr/types/wlr_xdg_output_v1.h>
 #include <wlr/types/wlr_xdg_output_v1.h>
@@ -437,6 +440,39 @@ scale_to_fit_changed_cb (PhocDesktop *self,
     phoc_desktop_set_scale_to_fit (self, max);
 }
 
+static void
+handle_idle_activity (struct wl_listener *listener, void *data)
+{
+  PhocDesktop *self = wl_container_of (listener, self, idle_activity);
+  PhocOutput *output;
+
+  wl_list_for_each (output, &self->outputs, link)
+    phoc_output_notify_activity (output, FALSE);
+}
+
+static void
+handle_content_type_changed (struct wlr_surface *surface,
+                             PhocContentType     content_type,
+                             int                 content_rate,
+                             gpointer            user_data)
+{
+  struct roots_view *view;
+
+  /* Video is often shown in a subsurface, attribute it to the toplevel */
+  while (wlr_surface_is_subsurface (surface)) {
+    struct wlr_subsurface *subsurface = wlr_subsurface_from_wlr_surface (surface);
+
+    /* Orphaned subsurfaces aren't shown anywhere */
+    if (subsurface == NULL || subsurface->parent == NULL)
+      return;
+    surface = subsurface->parent;
+  }
+
+  view = roots_view_from_wlr_surface (surface);
+  if (view)
+    view_set_content_type (view, content_type, content_rate);
+}
+
 #ifdef PHOC_XWAYLAND
 static const char *atom_map[XWAYLAND_ATOM_LAST] = {
 	"_NET_WM_WINDOW_TYPE_NORMAL",
@@ -447,6 +483,21 @@ static
 void handle_xwayland_ready(struct wl_listener *listener, void *data) {
   PhocDesktop *desktop = wl_container_of (
         listener, desktop, xwayland_ready);
+  struct wlr_xcursor_manager *xcursor_manager;
+
+  /* Only load the cursor theme once Xwayland actually runs */
+  xcursor_manager = phoc_desktop_get_xcursor_manager (desktop, 1);
+  if (xcursor_manager) {
+    struct wlr_xcursor *xcursor =
+      wlr_xcursor_manager_get_xcursor (xcursor_manager, ROOTS_XCURSOR_DEFAULT, 1);
+    if (xcursor != NULL) {
+      struct wlr_xcursor_image *image = xcursor->images[0];
+      wlr_xwayland_set_cursor (desktop->xwayland, image->buffer,
+                               image->width * 4, image->width, image->height,
+                               image->hotspot_x, image->hotspot_y);
+    }
+  }
+
   xcb_connection_t *xcb_conn = xcb_connect (NULL, NULL);
 
   int err = xcb_connection_has_error (xcb_conn);
@@ -517,6 +568,37 @@ handle_output_destroy (PhocOutput *destroyed_output)
 	g_object_unref (destroyed_output);
 }
 
+/* Hook up outputs configured to mirror another one */
+static void
+update_mirrors (PhocDesktop *self)
+{
+  PhocOutput *output, *source;
+
+  wl_list_for_each (output, &self->outputs, link) {
+    struct roots_output_config *oc = roots_config_get_output (self->config, output->wlr_output);
+
+    if (oc == NULL || oc->mirror == NULL || output->mirror_source)
+      continue;
+
+    wl_list_for_each (source, &self->outputs, link) {
+      gboolean match;
+
+      if (source == output || source->mirrored_by)
+        continue;
+
+      if (g_strcmp0 (oc->mirror, "builtin") == 0)
+        match = phoc_output_is_builtin (source);
+      else
+        match = g_strcmp0 (oc->mirror, source->wlr_output->name) == 0;
+
+      if (match) {
+        phoc_output_set_mirror_source (output, source);
+        break;
+      }
+    }
+  }
+}
+
 static void
 handle_new_output (struct wl_listener *listener, void *data)
 {
@@ -526,6 +608,44 @@ handle_new_output (struct wl_listener *listener, void *data)
 	g_signal_connect (output, "output-destroyed",
 			  G_CALLBACK (handle_output_destroy),
 			  NULL);
+	phoc_output_set_thermal_pressure (output, self->thermal_pressure);
+	update_mirrors (self);
+}
+
+/* Hysteresis in millidegrees Celsius to avoid flipping render scales */
+#define PHOC_THERMAL_HYSTERESIS 5000
+
+static gboolean
+on_thermal_poll (gpointer data)
+{
+  PhocDesktop *self = PHOC_DESKTOP (data);
+  g_autofree char *contents = NULL;
+  g_autoptr (GError) err = NULL;
+  gboolean pressure = self->thermal_pressure;
+  PhocOutput *output;
+  long temp;
+
+  if (!g_file_get_contents (self->config->thermal_zone, &contents, NULL, &err)) {
+    g_warning ("Failed to read thermal zone, disabling: %s", err->message);
+    self->thermal_poll_id = 0;
+    return G_SOURCE_REMOVE;
+  }
+
+  temp = strtol (contents, NULL, 10);
+  if (temp >= self->config->thermal_threshold)
+    pressure = TRUE;
+  else if (temp < self->config->thermal_threshold - PHOC_THERMAL_HYSTERESIS)
+    pressure = FALSE;
+
+  if (pressure == self->thermal_pressure)
+    return G_SOURCE_CONTINUE;
+
+  g_debug ("Thermal pressure %s at %ld millidegrees", pressure ? "on" : "off", temp);
+  self->thermal_pressure = pressure;
+  wl_list_for_each (output, &self->outputs, link)
+    phoc_output_set_thermal_pressure (output, pressure);
+
+  return G_SOURCE_CONTINUE;
 }
 
 static void
@@ -561,9 +681,6 @@ phoc_desktop_constructed (GObject *object)
   self->tablet_v2 = wlr_tablet_v2_create(server->wl_display);
 
   const char *cursor_theme = NULL;
-#ifdef PHOC_XWAYLAND
-  const char *cursor_default = ROOTS_XCURSOR_DEFAULT;
-#endif
 
   char cursor_size_fmt[16];
   snprintf(cursor_size_fmt, sizeof(cursor_size_fmt),
@@ -574,10 +691,6 @@ phoc_desktop_constructed (GObject *object)
   }
 
 #ifdef PHOC_XWAYLAND
-  self->xcursor_manager = wlr_xcursor_manager_create(cursor_theme,
-						     ROOTS_XCURSOR_SIZE);
-  g_return_if_fail (self->xcursor_manager);
-
   if (config->xwayland) {
     self->xwayland = wlr_xwayland_create(server->wl_display,
 					 server->compositor, config->xwayland_lazy);
@@ -596,18 +709,6 @@ phoc_desktop_constructed (GObject *object)
 #endif
 
     setenv("DISPLAY", self->xwayland->display_name, true);
-
-    if (!wlr_xcursor_manager_load(self->xcursor_manager, 1)) {
-      wlr_log(WLR_ERROR, "Cannot load XWayland XCursor theme");
-    }
-    struct wlr_xcursor *xcursor = wlr_xcursor_manager_get_xcursor(
-								  self->xcursor_manager, cursor_default, 1);
-    if (xcursor != NULL) {
-      struct wlr_xcursor_image *image = xcursor->images[0];
-      wlr_xwayland_set_cursor(self->xwayland, image->buffer,
-			      image->width * 4, image->width, image->height, image->hotspot_x,
-			      image->hotspot_y);
-    }
   }
 #endif
 
@@ -618,7 +719,25 @@ phoc_desktop_constructed (GObject *object)
     wlr_server_decoration_manager_create(server->wl_display);
   wlr_server_decoration_manager_set_default_mode(self->server_decoration_manager,
 						 WLR_SERVER_DECORATION_MANAGER_MODE_CLIENT);
+  if (config->thermal_zone) {
+    self->thermal_poll_id = g_timeout_add_seconds (5, on_thermal_poll, self);
+    g_source_set_name_by_id (self->thermal_poll_id, "[phoc] thermal poll");
+  } else {
+    struct roots_output_config *oc;
+
+    /* There's no reliable way to tell which zone matters on a device */
+    wl_list_for_each (oc, &config->outputs, link) {
+      if (oc->thermal_render_scale < 1.0) {
+        g_warning ("Output '%s' has a thermal-render-scale but no thermal-zone is configured",
+                   oc->name);
+        break;
+      }
+    }
+  }
+
   self->idle = wlr_idle_create(server->wl_display);
+  self->idle_activity.notify = handle_idle_activity;
+  wl_signal_add(&self->idle->events.activity_notify, &self->idle_activity);
   self->primary_selection_device_manager =
     wlr_gtk_primary_selection_device_manager_create(server->wl_display);
   self->input_inhibit =
@@ -636,6 +755,14 @@ phoc_desktop_constructed (GObject *object)
   self->text_input = wlr_text_input_manager_v3_create(server->wl_display);
 
   self->gtk_shell = phoc_gtk_shell_create(self, server->wl_display);
+#ifdef PHOC_HAVE_WLR_VIEWPORTER
+  /* Fractional scaling needs wp_viewport to set the surface size */
+  wlr_viewporter_create(server->wl_display);
+  self->fractional_scale = phoc_fractional_scale_manager_create(server->wl_display);
+#endif
+  self->content_type = phoc_content_type_manager_create(server->wl_display,
+                                                        handle_content_type_changed,
+                                                        self);
   self->phosh = phoc_phosh_private_new ();
   self->virtual_keyboard = wlr_virtual_keyboard_manager_v1_create(
 								  server->wl_display);
@@ -712,6 +839,13 @@ phoc_desktop_finalize (GObject *object)
 
   g_clear_object (&self->phosh);
   g_clear_pointer (&self->gtk_shell, phoc_gtk_shell_destroy);
+  g_clear_pointer (&self->fractional_scale, phoc_fractional_scale_manager_destroy);
+  g_clear_pointer (&self->content_type, phoc_content_type_manager_destroy);
+  g_clear_pointer (&self->xcursor_manager, wlr_xcursor_manager_destroy);
+  if (self->thermal_poll_id) {
+    g_source_remove (self->thermal_poll_id);
+    self->thermal_poll_id = 0;
+  }
 
   g_hash_table_remove_all (self->input_output_map);
   g_hash_table_unref (self->input_output_map);
@@ -828,3 +962,55 @@ phoc_desktop_get_scale_to_fit (PhocDesktop *self)
 {
     return self->scale_to_fit;
 }
+
+/**
+ * phoc_desktop_get_xcursor_manager:
+ * @self: The desktop
+ * @scale: The scale the cursor theme is needed for
+ *
+ * Get the xcursor manager shared by all seats and Xwayland. The manager is
+ * created and the theme is loaded for @scale on first use so themes aren't
+ * parsed for scales nobody shows a cursor on.
+ *
+ * Returns: (transfer none) (nullable): The xcursor manager
+ */
+struct wlr_xcursor_manager *
+phoc_desktop_get_xcursor_manager (PhocDesktop *self, float scale)
+{
+  g_return_val_if_fail (PHOC_IS_DESKTOP (self), NULL);
+
+  if (self->xcursor_manager == NULL) {
+    self->xcursor_manager = wlr_xcursor_manager_create (NULL, ROOTS_XCURSOR_SIZE);
+    if (self->xcursor_manager == NULL) {
+      g_warning ("Cannot create XCursor manager for theme");
+      return NULL;
+    }
+  }
+
+  /* A no-op if the theme is already loaded at that scale */
+  if (!wlr_xcursor_manager_load (self->xcursor_manager, scale))
+    g_warning ("Cannot load xcursor theme with scale %f", scale);
+
+  return self->xcursor_manager;
+}
+
+/**
+ * phoc_desktop_set_surface_scale:
+ * @self: The desktop
+ * @surface: The surface
+ * @scale: The scale
+ *
+ * Tell the client the (possibly fractional) scale it should render
+ * @surface at. Clients that don't support fractional scaling keep
+ * using the integer scale sent via wl_output.
+ */
+void
+phoc_desktop_set_surface_scale (PhocDesktop *self, struct wlr_surface *surface, float scale)
+{
+  g_return_if_fail (PHOC_IS_DESKTOP (self));
+
+  if (self->fractional_scale == NULL)
+    return;
+
+  phoc_fractional_scale_manager_set_surface_scale (self->fractional_scale, surface, scale);
+}
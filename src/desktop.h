@@ -30,6 +30,8 @@
 
 #include <gio/gio.h>
 
+#include "content-type.h"
+#include "fractional-scale.h"
 #include "settings.h"
 
 #ifdef PHOC_XWAYLAND
@@ -96,6 +98,7 @@ struct _PhocDesktop {
 	struct wl_listener output_manager_apply;
 	struct wl_listener output_manager_test;
 	struct wl_listener output_power_manager_set_mode;
+	struct wl_listener idle_activity;
 
 #ifdef PHOC_XWAYLAND
 	struct wlr_xwayland *xwayland;
@@ -109,9 +112,14 @@ struct _PhocDesktop {
 	gboolean maximize, scale_to_fit;
 	GHashTable *input_output_map;
 
+	guint thermal_poll_id;
+	gboolean thermal_pressure;
+
 	/* Protocols without upstreamable implementations */
 	PhocPhoshPrivate *phosh;
 	PhocGtkShell *gtk_shell;
+	PhocFractionalScaleManager *fractional_scale;
+	PhocContentTypeManager *content_type;
 };
 
 PhocDesktop *phoc_desktop_new (struct roots_config *config);
@@ -120,6 +128,8 @@ void         phoc_desktop_set_auto_maximize (PhocDesktop *self, gboolean on);
 gboolean     phoc_desktop_get_auto_maximize (PhocDesktop *self);
 void         phoc_desktop_set_scale_to_fit (PhocDesktop *self, gboolean on);
 gboolean     phoc_desktop_get_scale_to_fit (PhocDesktop *self);
+struct wlr_xcursor_manager *phoc_desktop_get_xcursor_manager (PhocDesktop *self, float scale);
+void         phoc_desktop_set_surface_scale (PhocDesktop *self, struct wlr_surface *surface, float scale);
 
 struct wlr_surface *phoc_desktop_surface_at(PhocDesktop *desktop,
 		double lx, double ly, double *sx, double *sy,
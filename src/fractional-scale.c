@@ -0,0 +1,255 @@
+/*
+ * Copyright (C) 2021 Purism SPC
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#define G_LOG_DOMAIN "phoc-fractional-scale"
+
+#include "config.h"
+
+#include <fractional-scale-v1-protocol.h>
+#include "fractional-scale.h"
+
+#include <math.h>
+
+/* The protocol's scales are numerators of a fraction with denominator 120 */
+#define PHOC_FRACTIONAL_SCALE_DENOMINATOR 120
+
+/**
+ * PhocFractionalScaleManager:
+ *
+ * Implements wp_fractional_scale_manager_v1 so clients can render
+ * exactly at an output's fractional scale (using wp_viewport to set
+ * the surface size) rather than at the next integer scale that then
+ * gets downscaled by the compositor.
+ */
+struct _PhocFractionalScaleManager {
+  struct wl_global *global;
+  /* wlr_surface -> PhocFractionalScale */
+  GHashTable       *scales;
+};
+
+/*
+ * The preferred scale of a surface. It's tracked from the first time
+ * phoc picks a scale for the surface, whether or not the client created
+ * a fractional scale object yet, so a late object still gets the right
+ * scale.
+ */
+typedef struct {
+  struct wl_resource         *resource;
+  struct wlr_surface         *wlr_surface;
+  PhocFractionalScaleManager *manager;
+  float                       preferred;
+  guint32                     sent;
+
+  struct wl_listener          surface_destroy;
+} PhocFractionalScale;
+
+
+static void
+fractional_scale_send (PhocFractionalScale *fractional_scale)
+{
+  guint32 value = round (fractional_scale->preferred * PHOC_FRACTIONAL_SCALE_DENOMINATOR);
+
+  if (fractional_scale->resource == NULL || value == 0 || value == fractional_scale->sent)
+    return;
+
+  fractional_scale->sent = value;
+  wp_fractional_scale_v1_send_preferred_scale (fractional_scale->resource, value);
+}
+
+
+static void
+fractional_scale_free (PhocFractionalScale *fractional_scale)
+{
+  if (fractional_scale->resource)
+    wl_resource_set_user_data (fractional_scale->resource, NULL);
+  wl_list_remove (&fractional_scale->surface_destroy.link);
+  g_free (fractional_scale);
+}
+
+
+static void
+handle_surface_destroy (struct wl_listener *listener, void *data)
+{
+  PhocFractionalScale *fractional_scale =
+    wl_container_of (listener, fractional_scale, surface_destroy);
+
+  g_hash_table_remove (fractional_scale->manager->scales, fractional_scale->wlr_surface);
+}
+
+
+static PhocFractionalScale *
+fractional_scale_ensure (PhocFractionalScaleManager *self, struct wlr_surface *wlr_surface)
+{
+  PhocFractionalScale *fractional_scale = g_hash_table_lookup (self->scales, wlr_surface);
+
+  if (fractional_scale)
+    return fractional_scale;
+
+  fractional_scale = g_new0 (PhocFractionalScale, 1);
+  fractional_scale->manager = self;
+  fractional_scale->wlr_surface = wlr_surface;
+  fractional_scale->surface_destroy.notify = handle_surface_destroy;
+  wl_signal_add (&wlr_surface->events.destroy, &fractional_scale->surface_destroy);
+  g_hash_table_insert (self->scales, wlr_surface, fractional_scale);
+
+  return fractional_scale;
+}
+
+
+static void
+fractional_scale_handle_resource_destroy (struct wl_resource *resource)
+{
+  PhocFractionalScale *fractional_scale = wl_resource_get_user_data (resource);
+
+  /* The surface is gone already */
+  if (fractional_scale == NULL)
+    return;
+
+  fractional_scale->resource = NULL;
+  fractional_scale->sent = 0;
+}
+
+
+static void
+handle_destroy (struct wl_client *client, struct wl_resource *resource)
+{
+  wl_resource_destroy (resource);
+}
+
+
+static const struct wp_fractional_scale_v1_interface fractional_scale_impl = {
+  .destroy = handle_destroy,
+};
+
+
+static void
+handle_get_fractional_scale (struct wl_client   *client,
+                             struct wl_resource *manager_resource,
+                             uint32_t            id,
+                             struct wl_resource *surface_resource)
+{
+  PhocFractionalScaleManager *self = wl_resource_get_user_data (manager_resource);
+  struct wlr_surface *wlr_surface = wlr_surface_from_resource (surface_resource);
+  PhocFractionalScale *fractional_scale;
+  struct wl_resource *resource;
+
+  fractional_scale = g_hash_table_lookup (self->scales, wlr_surface);
+  if (fractional_scale && fractional_scale->resource) {
+    wl_resource_post_error (manager_resource,
+                            WP_FRACTIONAL_SCALE_MANAGER_V1_ERROR_FRACTIONAL_SCALE_EXISTS,
+                            "wl_surface already has a fractional scale object");
+    return;
+  }
+
+  resource = wl_resource_create (client, &wp_fractional_scale_v1_interface,
+                                 wl_resource_get_version (manager_resource),
+                                 id);
+  if (resource == NULL) {
+    wl_client_post_no_memory (client);
+    return;
+  }
+
+  fractional_scale = fractional_scale_ensure (self, wlr_surface);
+  fractional_scale->resource = resource;
+  wl_resource_set_implementation (resource,
+                                  &fractional_scale_impl,
+                                  fractional_scale,
+                                  fractional_scale_handle_resource_destroy);
+
+  /* Only send a scale once phoc picked one for the surface */
+  fractional_scale_send (fractional_scale);
+}
+
+
+static const struct wp_fractional_scale_manager_v1_interface fractional_scale_manager_impl = {
+  .destroy = handle_destroy,
+  .get_fractional_scale = handle_get_fractional_scale,
+};
+
+
+static void
+fractional_scale_manager_bind (struct wl_client *client, void *data, uint32_t version, uint32_t id)
+{
+  PhocFractionalScaleManager *self = data;
+  struct wl_resource *resource;
+
+  resource = wl_resource_create (client, &wp_fractional_scale_manager_v1_interface, version, id);
+  if (resource == NULL) {
+    wl_client_post_no_memory (client);
+    return;
+  }
+
+  wl_resource_set_implementation (resource, &fractional_scale_manager_impl, self, NULL);
+}
+
+/**
+ * phoc_fractional_scale_manager_create:
+ * @display: The wayland display
+ *
+ * Create the wp_fractional_scale_manager_v1 global.
+ *
+ * Returns: The new fractional scale manager
+ */
+PhocFractionalScaleManager *
+phoc_fractional_scale_manager_create (struct wl_display *display)
+{
+  PhocFractionalScaleManager *self = g_new0 (PhocFractionalScaleManager, 1);
+
+  g_info ("Initializing fractional scale interface");
+  self->global = wl_global_create (display, &wp_fractional_scale_manager_v1_interface,
+                                   1, self, fractional_scale_manager_bind);
+  if (self->global == NULL) {
+    g_free (self);
+    return NULL;
+  }
+
+  self->scales = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL,
+                                        (GDestroyNotify)fractional_scale_free);
+
+  return self;
+}
+
+/**
+ * phoc_fractional_scale_manager_destroy:
+ * @self: The fractional scale manager
+ *
+ * Destroy the global. Fractional scale objects of clients stay around
+ * until the clients destroy them but become inert.
+ */
+void
+phoc_fractional_scale_manager_destroy (PhocFractionalScaleManager *self)
+{
+  g_hash_table_destroy (self->scales);
+  wl_global_destroy (self->global);
+  g_free (self);
+}
+
+/**
+ * phoc_fractional_scale_manager_set_surface_scale:
+ * @self: The fractional scale manager
+ * @surface: The surface
+ * @scale: The preferred scale of the surface
+ *
+ * Let the client know the scale the surface should be rendered at.
+ * This is usually the scale of the output the surface is on. If the
+ * surface has no fractional scale object yet the scale is sent once
+ * the client creates one.
+ */
+void
+phoc_fractional_scale_manager_set_surface_scale (PhocFractionalScaleManager *self,
+                                                 struct wlr_surface         *surface,
+                                                 float                       scale)
+{
+  PhocFractionalScale *fractional_scale;
+
+  g_return_if_fail (self);
+  g_return_if_fail (surface);
+  g_return_if_fail (scale > 0.0);
+
+  fractional_scale = fractional_scale_ensure (self, surface);
+  fractional_scale->preferred = scale;
+  fractional_scale_send (fractional_scale);
+}
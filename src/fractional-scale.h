@@ -0,0 +1,23 @@
+/*
+ * Copyright (C) 2021 Purism SPC
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <glib.h>
+#include <wayland-server-core.h>
+#include <wlr/types/wlr_surface.h>
+
+G_BEGIN_DECLS
+
+typedef struct _PhocFractionalScaleManager PhocFractionalScaleManager;
+
+PhocFractionalScaleManager *phoc_fractional_scale_manager_create  (struct wl_display *display);
+void                        phoc_fractional_scale_manager_destroy (PhocFractionalScaleManager *self);
+void                        phoc_fractional_scale_manager_set_surface_scale (PhocFractionalScaleManager *self,
+                                                                             struct wlr_surface         *surface,
+                                                                             float                       scale);
+
+G_END_DECLS
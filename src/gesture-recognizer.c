@@ -0,0 +1,511 @@
+/*
+ * Copyright (C) 2021 Purism SPC
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#define G_LOG_DOMAIN "phoc-gesture-recognizer"
+
+#include "config.h"
+#include "gesture-recognizer.h"
+
+#include <math.h>
+#include <wlr/util/edges.h>
+
+/* All fingers of a multi finger gesture must go down within this time */
+#define PHOC_GESTURE_MULTI_FINGER_WINDOW_MS 250
+/* Centroid movement in px after which a multi finger swipe is detected */
+#define PHOC_GESTURE_SWIPE_THRESHOLD 30.0
+/* Relative change in finger spread after which a pinch is detected */
+#define PHOC_GESTURE_PINCH_THRESHOLD 0.15
+
+/**
+ * PhocGestureRecognizer:
+ *
+ * Recognizes edge swipes, multi finger swipes and pinches on raw touch
+ * events. Touch events are fed in via the phoc_gesture_recognizer_touch_*
+ * functions which return %TRUE if the recognizer claimed the event. Claimed
+ * events must not be forwarded to clients, all other events go to clients
+ * unchanged.
+ *
+ * Gestures are only claimed if a handler of the corresponding signal
+ * returns %TRUE for %PHOC_GESTURE_STATE_BEGIN so unhandled gestures
+ * never take events away from clients.
+ */
+
+typedef enum {
+  PHOC_GESTURE_MODE_NONE,
+  PHOC_GESTURE_MODE_EDGE,
+  PHOC_GESTURE_MODE_MULTI,
+  PHOC_GESTURE_MODE_SWIPE,
+  PHOC_GESTURE_MODE_PINCH,
+  PHOC_GESTURE_MODE_CLAIMED,
+  PHOC_GESTURE_MODE_IGNORE,
+} PhocGestureMode;
+
+typedef struct {
+  int    id;
+  double x, y;
+} PhocGesturePoint;
+
+enum {
+  EDGE_SWIPE,
+  SWIPE,
+  PINCH,
+  TOUCH_CANCEL,
+  N_SIGNALS
+};
+static guint signals[N_SIGNALS] = { 0 };
+
+struct _PhocGestureRecognizer {
+  GObject          parent;
+
+  GArray          *points;
+  PhocGestureMode  mode;
+  guint32          first_down;
+
+  int              edge_touch_id;
+  guint32          edge;
+
+  double           start_cx, start_cy;
+  double           start_spread;
+};
+
+G_DEFINE_TYPE (PhocGestureRecognizer, phoc_gesture_recognizer, G_TYPE_OBJECT)
+
+
+static PhocGesturePoint *
+find_point (PhocGestureRecognizer *self, int touch_id, guint *index)
+{
+  for (guint i = 0; i < self->points->len; i++) {
+    PhocGesturePoint *p = &g_array_index (self->points, PhocGesturePoint, i);
+
+    if (p->id == touch_id) {
+      if (index)
+        *index = i;
+      return p;
+    }
+  }
+  return NULL;
+}
+
+
+static void
+get_centroid (PhocGestureRecognizer *self, double *cx, double *cy, double *spread)
+{
+  guint n = self->points->len;
+
+  *cx = *cy = *spread = 0.0;
+  if (n == 0)
+    return;
+
+  for (guint i = 0; i < n; i++) {
+    PhocGesturePoint *p = &g_array_index (self->points, PhocGesturePoint, i);
+    *cx += p->x;
+    *cy += p->y;
+  }
+  *cx /= n;
+  *cy /= n;
+
+  for (guint i = 0; i < n; i++) {
+    PhocGesturePoint *p = &g_array_index (self->points, PhocGesturePoint, i);
+    *spread += hypot (p->x - *cx, p->y - *cy);
+  }
+  *spread /= n;
+}
+
+
+static void
+reset_multi_finger_start (PhocGestureRecognizer *self)
+{
+  get_centroid (self, &self->start_cx, &self->start_cy, &self->start_spread);
+}
+
+
+static guint32
+get_edge (const struct wlr_box *box, guint32 edges, int zone, double lx, double ly)
+{
+  if (box == NULL || zone < 0)
+    return WLR_EDGE_NONE;
+
+  if ((edges & WLR_EDGE_TOP) && ly <= box->y + zone)
+    return WLR_EDGE_TOP;
+  if ((edges & WLR_EDGE_BOTTOM) && ly >= box->y + box->height - 1 - zone)
+    return WLR_EDGE_BOTTOM;
+  if ((edges & WLR_EDGE_LEFT) && lx <= box->x + zone)
+    return WLR_EDGE_LEFT;
+  if ((edges & WLR_EDGE_RIGHT) && lx >= box->x + box->width - 1 - zone)
+    return WLR_EDGE_RIGHT;
+
+  return WLR_EDGE_NONE;
+}
+
+
+static void
+claim_points (PhocGestureRecognizer *self, guint32 time)
+{
+  /* Clients saw the touch down of these already */
+  for (guint i = 0; i < self->points->len; i++) {
+    PhocGesturePoint *p = &g_array_index (self->points, PhocGesturePoint, i);
+    g_signal_emit (self, signals[TOUCH_CANCEL], 0, p->id, time);
+  }
+}
+
+
+static gboolean
+emit_multi_finger (PhocGestureRecognizer *self, PhocGestureState state)
+{
+  gboolean handled = FALSE;
+  double cx, cy, spread;
+
+  get_centroid (self, &cx, &cy, &spread);
+
+  if (self->mode == PHOC_GESTURE_MODE_SWIPE) {
+    g_signal_emit (self, signals[SWIPE], 0, state, self->points->len,
+                   cx - self->start_cx, cy - self->start_cy, &handled);
+  } else if (self->mode == PHOC_GESTURE_MODE_PINCH) {
+    g_signal_emit (self, signals[PINCH], 0, state, self->points->len,
+                   self->start_spread > 0.0 ? spread / self->start_spread : 1.0, &handled);
+  }
+
+  return handled;
+}
+
+
+static void
+phoc_gesture_recognizer_finalize (GObject *object)
+{
+  PhocGestureRecognizer *self = PHOC_GESTURE_RECOGNIZER (object);
+
+  g_array_unref (self->points);
+
+  G_OBJECT_CLASS (phoc_gesture_recognizer_parent_class)->finalize (object);
+}
+
+
+static void
+phoc_gesture_recognizer_class_init (PhocGestureRecognizerClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->finalize = phoc_gesture_recognizer_finalize;
+
+  /**
+   * PhocGestureRecognizer::edge-swipe
+   * @self: The recognizer emitting the signal
+   * @state: The #PhocGestureState
+   * @edge: The `wlr_edges` the swipe started on
+   * @touch_id: The touch point's id
+   * @time: The event time in msec
+   * @lx: The x layout coordinate of the touch point
+   * @ly: The y layout coordinate of the touch point
+   *
+   * Emitted when a touch point goes down in an output's edge zone and on
+   * further motion of that touch point. Handlers return %TRUE on
+   * %PHOC_GESTURE_STATE_BEGIN to claim the touch sequence.
+   */
+  signals[EDGE_SWIPE] = g_signal_new ("edge-swipe",
+                                      G_TYPE_FROM_CLASS (klass),
+                                      G_SIGNAL_RUN_LAST,
+                                      0, g_signal_accumulator_true_handled, NULL, NULL,
+                                      G_TYPE_BOOLEAN, 6,
+                                      G_TYPE_INT, G_TYPE_UINT, G_TYPE_INT,
+                                      G_TYPE_UINT, G_TYPE_DOUBLE, G_TYPE_DOUBLE);
+  /**
+   * PhocGestureRecognizer::swipe
+   * @self: The recognizer emitting the signal
+   * @state: The #PhocGestureState
+   * @n_fingers: The number of fingers
+   * @dx: The x offset of the fingers' centroid since the gesture started
+   * @dy: The y offset of the fingers' centroid since the gesture started
+   *
+   * Emitted for multi finger swipes. Handlers return %TRUE on
+   * %PHOC_GESTURE_STATE_BEGIN to claim the touch sequences.
+   */
+  signals[SWIPE] = g_signal_new ("swipe",
+                                 G_TYPE_FROM_CLASS (klass),
+                                 G_SIGNAL_RUN_LAST,
+                                 0, g_signal_accumulator_true_handled, NULL, NULL,
+                                 G_TYPE_BOOLEAN, 4,
+                                 G_TYPE_INT, G_TYPE_UINT, G_TYPE_DOUBLE, G_TYPE_DOUBLE);
+  /**
+   * PhocGestureRecognizer::pinch
+   * @self: The recognizer emitting the signal
+   * @state: The #PhocGestureState
+   * @n_fingers: The number of fingers
+   * @scale: The spread of the fingers relative to the start of the gesture
+   *
+   * Emitted for multi finger pinches. Handlers return %TRUE on
+   * %PHOC_GESTURE_STATE_BEGIN to claim the touch sequences.
+   */
+  signals[PINCH] = g_signal_new ("pinch",
+                                 G_TYPE_FROM_CLASS (klass),
+                                 G_SIGNAL_RUN_LAST,
+                                 0, g_signal_accumulator_true_handled, NULL, NULL,
+                                 G_TYPE_BOOLEAN, 3,
+                                 G_TYPE_INT, G_TYPE_UINT, G_TYPE_DOUBLE);
+  /**
+   * PhocGestureRecognizer::touch-cancel
+   * @self: The recognizer emitting the signal
+   * @touch_id: The touch point's id
+   * @time: The event time in msec
+   *
+   * Emitted for touch points that were passed on to clients but got
+   * claimed by a multi finger gesture later on. The client's touch
+   * sequence should be ended.
+   */
+  signals[TOUCH_CANCEL] = g_signal_new ("touch-cancel",
+                                        G_TYPE_FROM_CLASS (klass),
+                                        G_SIGNAL_RUN_LAST,
+                                        0, NULL, NULL, NULL,
+                                        G_TYPE_NONE, 2, G_TYPE_INT, G_TYPE_UINT);
+}
+
+
+static void
+phoc_gesture_recognizer_init (PhocGestureRecognizer *self)
+{
+  self->points = g_array_new (FALSE, TRUE, sizeof (PhocGesturePoint));
+  self->edge_touch_id = -1;
+}
+
+
+PhocGestureRecognizer *
+phoc_gesture_recognizer_new (void)
+{
+  return g_object_new (PHOC_TYPE_GESTURE_RECOGNIZER, NULL);
+}
+
+/**
+ * phoc_gesture_recognizer_touch_down:
+ * @self: The gesture recognizer
+ * @touch_id: The touch point's id
+ * @time: The event time in msec
+ * @lx: The x layout coordinate
+ * @ly: The y layout coordinate
+ * @output_box: (nullable): The layout box of the output the point is on
+ * @edges: The `wlr_edges` of the output that accept edge swipes
+ * @edge_zone: The size of the edge zone in layout coordinates
+ *
+ * Feed a touch down event into the recognizer.
+ *
+ * Returns: %TRUE if the event was claimed by a gesture
+ */
+gboolean
+phoc_gesture_recognizer_touch_down (PhocGestureRecognizer *self,
+                                    int                    touch_id,
+                                    guint32                time,
+                                    double                 lx,
+                                    double                 ly,
+                                    const struct wlr_box  *output_box,
+                                    guint32                edges,
+                                    int                    edge_zone)
+{
+  PhocGesturePoint point = { touch_id, lx, ly };
+  gboolean handled = FALSE;
+  guint32 edge;
+
+  g_return_val_if_fail (PHOC_IS_GESTURE_RECOGNIZER (self), FALSE);
+
+  if (find_point (self, touch_id, NULL))
+    return FALSE;
+
+  g_array_append_val (self->points, point);
+
+  if (self->points->len == 1) {
+    self->first_down = time;
+    self->mode = PHOC_GESTURE_MODE_NONE;
+
+    edge = get_edge (output_box, edges, edge_zone, lx, ly);
+    if (edge == WLR_EDGE_NONE)
+      return FALSE;
+
+    g_signal_emit (self, signals[EDGE_SWIPE], 0, PHOC_GESTURE_STATE_BEGIN,
+                   edge, touch_id, time, lx, ly, &handled);
+    if (handled) {
+      self->mode = PHOC_GESTURE_MODE_EDGE;
+      self->edge = edge;
+      self->edge_touch_id = touch_id;
+    }
+    return handled;
+  }
+
+  switch (self->mode) {
+  case PHOC_GESTURE_MODE_NONE:
+    if (self->points->len < PHOC_GESTURE_MIN_FINGERS)
+      return FALSE;
+    if (time - self->first_down > PHOC_GESTURE_MULTI_FINGER_WINDOW_MS) {
+      self->mode = PHOC_GESTURE_MODE_IGNORE;
+      return FALSE;
+    }
+    self->mode = PHOC_GESTURE_MODE_MULTI;
+    reset_multi_finger_start (self);
+    return FALSE;
+  case PHOC_GESTURE_MODE_MULTI:
+    reset_multi_finger_start (self);
+    return FALSE;
+  case PHOC_GESTURE_MODE_SWIPE:
+  case PHOC_GESTURE_MODE_PINCH:
+  case PHOC_GESTURE_MODE_CLAIMED:
+    return TRUE;
+  case PHOC_GESTURE_MODE_EDGE:
+  case PHOC_GESTURE_MODE_IGNORE:
+  default:
+    return FALSE;
+  }
+}
+
+/**
+ * phoc_gesture_recognizer_touch_motion:
+ * @self: The gesture recognizer
+ * @touch_id: The touch point's id
+ * @time: The event time in msec
+ * @lx: The x layout coordinate
+ * @ly: The y layout coordinate
+ *
+ * Feed a touch motion event into the recognizer.
+ *
+ * Returns: %TRUE if the event was claimed by a gesture
+ */
+gboolean
+phoc_gesture_recognizer_touch_motion (PhocGestureRecognizer *self,
+                                      int                    touch_id,
+                                      guint32                time,
+                                      double                 lx,
+                                      double                 ly)
+{
+  PhocGesturePoint *point;
+  gboolean handled = FALSE;
+  double cx, cy, spread;
+
+  g_return_val_if_fail (PHOC_IS_GESTURE_RECOGNIZER (self), FALSE);
+
+  point = find_point (self, touch_id, NULL);
+  if (point == NULL)
+    return FALSE;
+
+  point->x = lx;
+  point->y = ly;
+
+  switch (self->mode) {
+  case PHOC_GESTURE_MODE_EDGE:
+    if (touch_id != self->edge_touch_id)
+      return FALSE;
+    g_signal_emit (self, signals[EDGE_SWIPE], 0, PHOC_GESTURE_STATE_UPDATE,
+                   self->edge, touch_id, time, lx, ly, &handled);
+    return TRUE;
+  case PHOC_GESTURE_MODE_MULTI:
+    get_centroid (self, &cx, &cy, &spread);
+    if (hypot (cx - self->start_cx, cy - self->start_cy) > PHOC_GESTURE_SWIPE_THRESHOLD) {
+      self->mode = PHOC_GESTURE_MODE_SWIPE;
+    } else if (self->start_spread > 0.0 &&
+               fabs (spread / self->start_spread - 1.0) > PHOC_GESTURE_PINCH_THRESHOLD) {
+      self->mode = PHOC_GESTURE_MODE_PINCH;
+    } else {
+      return FALSE;
+    }
+
+    if (!emit_multi_finger (self, PHOC_GESTURE_STATE_BEGIN)) {
+      g_debug ("Unhandled %u finger gesture", self->points->len);
+      self->mode = PHOC_GESTURE_MODE_IGNORE;
+      return FALSE;
+    }
+    claim_points (self, time);
+    return TRUE;
+  case PHOC_GESTURE_MODE_SWIPE:
+  case PHOC_GESTURE_MODE_PINCH:
+    emit_multi_finger (self, PHOC_GESTURE_STATE_UPDATE);
+    return TRUE;
+  case PHOC_GESTURE_MODE_CLAIMED:
+    return TRUE;
+  case PHOC_GESTURE_MODE_NONE:
+  case PHOC_GESTURE_MODE_IGNORE:
+  default:
+    return FALSE;
+  }
+}
+
+/**
+ * phoc_gesture_recognizer_touch_up:
+ * @self: The gesture recognizer
+ * @touch_id: The touch point's id
+ * @time: The event time in msec
+ *
+ * Feed a touch up event into the recognizer.
+ *
+ * Returns: %TRUE if the event was claimed by a gesture
+ */
+gboolean
+phoc_gesture_recognizer_touch_up (PhocGestureRecognizer *self,
+                                  int                    touch_id,
+                                  guint32                time)
+{
+  PhocGesturePoint *point;
+  gboolean handled = FALSE, claimed = FALSE;
+  guint index;
+
+  g_return_val_if_fail (PHOC_IS_GESTURE_RECOGNIZER (self), FALSE);
+
+  point = find_point (self, touch_id, &index);
+  if (point == NULL)
+    return FALSE;
+
+  switch (self->mode) {
+  case PHOC_GESTURE_MODE_EDGE:
+    if (touch_id == self->edge_touch_id) {
+      g_signal_emit (self, signals[EDGE_SWIPE], 0, PHOC_GESTURE_STATE_END,
+                     self->edge, touch_id, time, point->x, point->y, &handled);
+      self->edge_touch_id = -1;
+      self->mode = PHOC_GESTURE_MODE_IGNORE;
+      claimed = TRUE;
+    }
+    break;
+  case PHOC_GESTURE_MODE_SWIPE:
+  case PHOC_GESTURE_MODE_PINCH:
+    /* The gesture ends with the first finger going up */
+    emit_multi_finger (self, PHOC_GESTURE_STATE_END);
+    self->mode = PHOC_GESTURE_MODE_CLAIMED;
+    claimed = TRUE;
+    break;
+  case PHOC_GESTURE_MODE_CLAIMED:
+    claimed = TRUE;
+    break;
+  case PHOC_GESTURE_MODE_MULTI:
+    self->mode = PHOC_GESTURE_MODE_IGNORE;
+    break;
+  case PHOC_GESTURE_MODE_NONE:
+  case PHOC_GESTURE_MODE_IGNORE:
+  default:
+    break;
+  }
+
+  g_array_remove_index (self->points, index);
+  if (self->points->len == 0)
+    self->mode = PHOC_GESTURE_MODE_NONE;
+
+  return claimed;
+}
+
+/**
+ * phoc_gesture_recognizer_get_center:
+ * @self: The gesture recognizer
+ * @lx: (out): The x layout coordinate
+ * @ly: (out): The y layout coordinate
+ *
+ * Get the centroid of the current touch points, e.g. to find the
+ * output a multi finger gesture happens on.
+ *
+ * Returns: %TRUE if there are touch points, %FALSE otherwise
+ */
+gboolean
+phoc_gesture_recognizer_get_center (PhocGestureRecognizer *self,
+                                    double                *lx,
+                                    double                *ly)
+{
+  double spread;
+
+  g_return_val_if_fail (PHOC_IS_GESTURE_RECOGNIZER (self), FALSE);
+
+  get_centroid (self, lx, ly, &spread);
+  return self->points->len > 0;
+}
@@ -0,0 +1,49 @@
+/*
+ * Copyright (C) 2021 Purism SPC
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <glib-object.h>
+#include <wlr/types/wlr_box.h>
+
+G_BEGIN_DECLS
+
+/* Number of fingers needed for multi finger swipes and pinches */
+#define PHOC_GESTURE_MIN_FINGERS 3
+
+typedef enum {
+  PHOC_GESTURE_STATE_BEGIN = 0,
+  PHOC_GESTURE_STATE_UPDATE = 1,
+  PHOC_GESTURE_STATE_END = 2,
+  PHOC_GESTURE_STATE_CANCEL = 3,
+} PhocGestureState;
+
+#define PHOC_TYPE_GESTURE_RECOGNIZER (phoc_gesture_recognizer_get_type ())
+
+G_DECLARE_FINAL_TYPE (PhocGestureRecognizer, phoc_gesture_recognizer, PHOC, GESTURE_RECOGNIZER, GObject)
+
+PhocGestureRecognizer *phoc_gesture_recognizer_new          (void);
+gboolean               phoc_gesture_recognizer_touch_down   (PhocGestureRecognizer *self,
+                                                             int                    touch_id,
+                                                             guint32                time,
+                                                             double                 lx,
+                                                             double                 ly,
+                                                             const struct wlr_box  *output_box,
+                                                             guint32                edges,
+                                                             int                    edge_zone);
+gboolean               phoc_gesture_recognizer_touch_motion (PhocGestureRecognizer *self,
+                                                             int                    touch_id,
+                                                             guint32                time,
+                                                             double                 lx,
+                                                             double                 ly);
+gboolean               phoc_gesture_recognizer_touch_up     (PhocGestureRecognizer *self,
+                                                             int                    touch_id,
+                                                             guint32                time);
+gboolean               phoc_gesture_recognizer_get_center   (PhocGestureRecognizer *self,
+                                                             double                *lx,
+                                                             double                *ly);
+
+G_END_DECLS
@@ -0,0 +1,153 @@
+/*
+ * Copyright (C) 2021 Purism SPC
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#define G_LOG_DOMAIN "phoc-input-predictor"
+
+#include "config.h"
+#include "input-predictor.h"
+
+/* Only samples this recent are used to estimate the velocity */
+#define PHOC_INPUT_PREDICTOR_WINDOW_MS 50
+/* Never extrapolate further than this into the future */
+#define PHOC_INPUT_PREDICTOR_MAX_HORIZON_MS 40
+
+/**
+ * phoc_input_predictor_reset:
+ * @self: The predictor
+ *
+ * Drop all samples, e.g. when a new grab starts.
+ */
+void
+phoc_input_predictor_reset (PhocInputPredictor *self)
+{
+  g_return_if_fail (self);
+
+  self->n_samples = 0;
+  self->head = 0;
+}
+
+/**
+ * phoc_input_predictor_add_sample:
+ * @self: The predictor
+ * @time: The event time in milliseconds
+ * @x: The x coordinate
+ * @y: The y coordinate
+ *
+ * Feed a new sample into the predictor. Samples are expected in
+ * chronological order, samples going back in time reset the predictor.
+ */
+void
+phoc_input_predictor_add_sample (PhocInputPredictor *self,
+                                 guint32             time,
+                                 double              x,
+                                 double              y)
+{
+  PhocInputPredictorSample *last;
+
+  g_return_if_fail (self);
+
+  if (self->n_samples) {
+    last = &self->samples[(self->head + PHOC_INPUT_PREDICTOR_MAX_SAMPLES - 1) %
+                          PHOC_INPUT_PREDICTOR_MAX_SAMPLES];
+    if (time < last->time) {
+      phoc_input_predictor_reset (self);
+    } else if (time == last->time) {
+      /* Several events in the same msec, keep the latest position */
+      last->x = x;
+      last->y = y;
+      return;
+    }
+  }
+
+  self->samples[self->head] = (PhocInputPredictorSample) { time, x, y };
+  self->head = (self->head + 1) % PHOC_INPUT_PREDICTOR_MAX_SAMPLES;
+  if (self->n_samples < PHOC_INPUT_PREDICTOR_MAX_SAMPLES)
+    self->n_samples++;
+}
+
+/**
+ * phoc_input_predictor_predict:
+ * @self: The predictor
+ * @time: The time in milliseconds to predict the position for
+ * @x: (out): The predicted x coordinate
+ * @y: (out): The predicted y coordinate
+ *
+ * Extrapolate the position at @time using a least squares fit of
+ * the velocity over the most recent samples.
+ *
+ * Returns: %TRUE if a prediction could be made. If %FALSE the
+ *   position of the latest sample (if any) is returned.
+ */
+gboolean
+phoc_input_predictor_predict (PhocInputPredictor *self,
+                              guint32             time,
+                              double             *x,
+                              double             *y)
+{
+  const PhocInputPredictorSample *last;
+  double mean_t = 0.0, mean_x = 0.0, mean_y = 0.0;
+  double var_t = 0.0, cov_x = 0.0, cov_y = 0.0;
+  gint64 horizon;
+  guint n = 0;
+
+  g_return_val_if_fail (self, FALSE);
+  g_return_val_if_fail (x && y, FALSE);
+
+  if (self->n_samples == 0)
+    return FALSE;
+
+  last = &self->samples[(self->head + PHOC_INPUT_PREDICTOR_MAX_SAMPLES - 1) %
+                        PHOC_INPUT_PREDICTOR_MAX_SAMPLES];
+  *x = last->x;
+  *y = last->y;
+
+  horizon = (gint64)time - last->time;
+  if (horizon <= 0)
+    return FALSE;
+  horizon = MIN (horizon, PHOC_INPUT_PREDICTOR_MAX_HORIZON_MS);
+
+  /* Times are taken relative to the latest sample to keep numbers small */
+  for (guint i = 0; i < self->n_samples; i++) {
+    const PhocInputPredictorSample *s =
+      &self->samples[(self->head + PHOC_INPUT_PREDICTOR_MAX_SAMPLES - 1 - i) %
+                     PHOC_INPUT_PREDICTOR_MAX_SAMPLES];
+    double dt = (double)s->time - last->time;
+
+    if (-dt > PHOC_INPUT_PREDICTOR_WINDOW_MS)
+      break;
+
+    mean_t += dt;
+    mean_x += s->x;
+    mean_y += s->y;
+    n++;
+  }
+
+  if (n < 2)
+    return FALSE;
+
+  mean_t /= n;
+  mean_x /= n;
+  mean_y /= n;
+
+  for (guint i = 0; i < n; i++) {
+    const PhocInputPredictorSample *s =
+      &self->samples[(self->head + PHOC_INPUT_PREDICTOR_MAX_SAMPLES - 1 - i) %
+                     PHOC_INPUT_PREDICTOR_MAX_SAMPLES];
+    double dt = ((double)s->time - last->time) - mean_t;
+
+    var_t += dt * dt;
+    cov_x += dt * (s->x - mean_x);
+    cov_y += dt * (s->y - mean_y);
+  }
+
+  if (var_t == 0.0)
+    return FALSE;
+
+  *x = last->x + cov_x / var_t * horizon;
+  *y = last->y + cov_y / var_t * horizon;
+
+  return TRUE;
+}
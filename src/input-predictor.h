@@ -0,0 +1,43 @@
+/*
+ * Copyright (C) 2021 Purism SPC
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+#define PHOC_INPUT_PREDICTOR_MAX_SAMPLES 8
+
+typedef struct _PhocInputPredictorSample {
+  guint32 time;  /* msec */
+  double  x;
+  double  y;
+} PhocInputPredictorSample;
+
+/**
+ * PhocInputPredictor:
+ *
+ * Extrapolates a position from recent timestamped samples. Used to
+ * hide a frame of latency in compositor driven grabs.
+ */
+typedef struct _PhocInputPredictor {
+  PhocInputPredictorSample samples[PHOC_INPUT_PREDICTOR_MAX_SAMPLES];
+  guint                    n_samples;
+  guint                    head;
+} PhocInputPredictor;
+
+void     phoc_input_predictor_reset      (PhocInputPredictor *self);
+void     phoc_input_predictor_add_sample (PhocInputPredictor *self,
+                                          guint32             time,
+                                          double              x,
+                                          double              y);
+gboolean phoc_input_predictor_predict    (PhocInputPredictor *self,
+                                          guint32             time,
+                                          double             *x,
+                                          double             *y);
+
+G_END_DECLS
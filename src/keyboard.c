@@ -15,6 +15,7 @@
 #include <wlr/util/log.h>
 #include <xkbcommon/xkbcommon.h>
 #include "keyboard.h"
+#include "keymap-cache.h"
 #include "phosh-private.h"
 #include "seat.h"
 
@@ -358,7 +359,6 @@ static void
 set_fallback_keymap (PhocKeyboard *self)
 {
   struct xkb_rule_names rules = { 0 };
-  struct xkb_context *context;
 
   rules.rules = KEYBOARD_DEFAULT_XKB_RULES;
   rules.model = KEYBOARD_DEFAULT_XKB_MODEL;
@@ -366,15 +366,8 @@ set_fallback_keymap (PhocKeyboard *self)
   rules.variant = "";
   rules.options = "";
 
-  context = xkb_context_new (XKB_CONTEXT_NO_FLAGS);
-  if (context == NULL) {
-       return;
-  }
-
   xkb_keymap_unref (self->keymap);
-  self->keymap = xkb_keymap_new_from_names (context, &rules,
-                                            XKB_KEYMAP_COMPILE_NO_FLAGS);
-  xkb_context_unref (context);
+  self->keymap = phoc_keymap_cache_lookup (phoc_keymap_cache_get_default (), &rules);
 
   g_return_if_fail (self->device);
   wlr_keyboard_set_keymap(self->device->keyboard, self->keymap);
@@ -385,7 +378,6 @@ static void
 set_xkb_keymap (PhocKeyboard *self, const gchar *layout, const gchar *variant, const gchar *options)
 {
   struct xkb_rule_names rules = { 0 };
-  struct xkb_context *context = NULL;
   struct xkb_keymap *keymap = NULL;
 
   g_return_if_fail (self->device);
@@ -397,21 +389,11 @@ set_xkb_keymap (PhocKeyboard *self, const gchar *layout, const gchar *variant, c
   rules.variant = variant;
   rules.options = options;
 
-  context = xkb_context_new(XKB_CONTEXT_NO_FLAGS);
-  if (context == NULL) {
-    g_warning ("Cannot create XKB context");
-    goto out;
-  }
-
-  keymap = xkb_map_new_from_names(context, &rules, XKB_KEYMAP_COMPILE_NO_FLAGS);
+  keymap = phoc_keymap_cache_lookup (phoc_keymap_cache_get_default (), &rules);
   if (keymap == NULL) {
     g_warning ("Cannot create XKB keymap");
   }
 
- out:
-  if (context)
-    xkb_context_unref(context);
-
   if (keymap) {
     xkb_keymap_unref (self->keymap);
     self->keymap = keymap;
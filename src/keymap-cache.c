@@ -0,0 +1,284 @@
+/*
+ * Copyright (C) 2021 Purism SPC
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#define G_LOG_DOMAIN "phoc-keymap-cache"
+
+#include "config.h"
+#include "keymap-cache.h"
+
+#include <gio/gio.h>
+#include <glib/gstdio.h>
+#include <sys/stat.h>
+
+/**
+ * PhocKeymapCache:
+ *
+ * A process wide cache of compiled XKB keymaps keyed by their rule
+ * names. Keymaps are shared between all keyboards using the same
+ * rules, model, layout, variant and options. Compiled keymaps are
+ * additionally stored as strings in the user's cache directory so
+ * loading them on the next start avoids the (slow) compilation from
+ * rule names.
+ */
+struct _PhocKeymapCache {
+  GObject             parent;
+
+  struct xkb_context *context;
+  GHashTable         *keymaps;
+  char               *cache_dir;
+};
+
+G_DEFINE_TYPE (PhocKeymapCache, phoc_keymap_cache, G_TYPE_OBJECT)
+
+
+/* libxkbcommon treats a NULL name differently from an empty one
+ * (e.g. NULL options fall back to XKB_DEFAULT_OPTIONS) so keep them
+ * apart */
+static void
+append_name (GString *key, const char *name)
+{
+  if (name)
+    g_string_append_printf (key, "=%s", name);
+  g_string_append_c (key, '\x1f');
+}
+
+
+static char *
+build_key (const struct xkb_rule_names *names)
+{
+  GString *key = g_string_new (NULL);
+
+  append_name (key, names->rules);
+  append_name (key, names->model);
+  append_name (key, names->layout);
+  append_name (key, names->variant);
+  append_name (key, names->options);
+
+  return g_string_free (key, FALSE);
+}
+
+
+static void
+append_dir_stamp (GString *stamp, const char *dir, int depth)
+{
+  g_autoptr (GDir) gdir = NULL;
+  const char *name;
+  struct stat st;
+
+  if (stat (dir, &st) != 0)
+    return;
+
+  g_string_append_printf (stamp, "%s:%" G_GINT64_FORMAT ":%" G_GINT64_FORMAT ";",
+                          dir, (gint64)st.st_mtime, (gint64)st.st_size);
+
+  if (!S_ISDIR (st.st_mode) || depth == 0)
+    return;
+
+  gdir = g_dir_open (dir, 0, NULL);
+  if (gdir == NULL)
+    return;
+
+  while ((name = g_dir_read_name (gdir))) {
+    g_autofree char *path = g_build_filename (dir, name, NULL);
+
+    append_dir_stamp (stamp, path, depth - 1);
+  }
+}
+
+/*
+ * The on disk cache becomes stale when the XKB data, the user's
+ * overrides or libxkbcommon get updated so mix everything a keymap
+ * is compiled from into the file name: the library version, the
+ * include paths and the modification times of the XKB files in them
+ * and the environment providing defaults for unset rule names. This
+ * only happens once per keymap and process and stat'ing the files is
+ * still way cheaper than compiling the keymap.
+ */
+static char *
+build_cache_path (PhocKeymapCache *self, const char *key)
+{
+  static const char * const subdirs[] = { "rules", "keycodes", "types", "compat", "symbols" };
+  static const char * const env_vars[] = { "XKB_CONFIG_ROOT", "XKB_CONFIG_EXTRA_PATH",
+                                           "XKB_DEFAULT_RULES", "XKB_DEFAULT_MODEL",
+                                           "XKB_DEFAULT_LAYOUT", "XKB_DEFAULT_VARIANT",
+                                           "XKB_DEFAULT_OPTIONS" };
+  g_autoptr (GString) input = g_string_new (key);
+  g_autofree char *checksum = NULL;
+  g_autofree char *filename = NULL;
+
+  g_string_append_printf (input, "xkbcommon-%s\x1f", PHOC_XKBCOMMON_VERSION);
+
+  for (unsigned int i = 0; i < G_N_ELEMENTS (env_vars); i++)
+    g_string_append_printf (input, "%s=%s\x1f", env_vars[i], g_getenv (env_vars[i]) ?: "");
+
+  for (unsigned int i = 0; i < xkb_context_num_include_paths (self->context); i++) {
+    const char *include_path = xkb_context_include_path_get (self->context, i);
+
+    g_string_append_printf (input, "%s\x1f", include_path);
+    for (unsigned int j = 0; j < G_N_ELEMENTS (subdirs); j++) {
+      g_autofree char *dir = g_build_filename (include_path, subdirs[j], NULL);
+
+      /* symbols has vendor subdirectories */
+      append_dir_stamp (input, dir, 2);
+    }
+  }
+
+  checksum = g_compute_checksum_for_string (G_CHECKSUM_SHA256, input->str, input->len);
+  filename = g_strdup_printf ("%s.xkb", checksum);
+
+  return g_build_filename (self->cache_dir, filename, NULL);
+}
+
+
+static struct xkb_keymap *
+load_keymap (PhocKeymapCache *self, const char *path)
+{
+  g_autofree char *contents = NULL;
+  struct xkb_keymap *keymap;
+
+  if (!g_file_get_contents (path, &contents, NULL, NULL))
+    return NULL;
+
+  keymap = xkb_keymap_new_from_string (self->context, contents,
+                                       XKB_KEYMAP_FORMAT_TEXT_V1,
+                                       XKB_KEYMAP_COMPILE_NO_FLAGS);
+  if (keymap == NULL) {
+    g_warning ("Dropping invalid cached keymap %s", path);
+    g_unlink (path);
+  }
+
+  return keymap;
+}
+
+
+static void
+store_keymap (PhocKeymapCache *self, const char *path, struct xkb_keymap *keymap)
+{
+  g_autofree char *contents = NULL;
+  g_autoptr (GError) err = NULL;
+
+  contents = xkb_keymap_get_as_string (keymap, XKB_KEYMAP_FORMAT_TEXT_V1);
+  if (contents == NULL)
+    return;
+
+  if (g_mkdir_with_parents (self->cache_dir, 0700) != 0) {
+    g_debug ("Failed to create keymap cache dir %s", self->cache_dir);
+    return;
+  }
+
+  if (!g_file_set_contents (path, contents, -1, &err))
+    g_debug ("Failed to store keymap %s: %s", path, err->message);
+}
+
+
+static void
+phoc_keymap_cache_finalize (GObject *object)
+{
+  PhocKeymapCache *self = PHOC_KEYMAP_CACHE (object);
+
+  g_clear_pointer (&self->keymaps, g_hash_table_destroy);
+  g_clear_pointer (&self->context, xkb_context_unref);
+  g_clear_pointer (&self->cache_dir, g_free);
+
+  G_OBJECT_CLASS (phoc_keymap_cache_parent_class)->finalize (object);
+}
+
+
+static void
+phoc_keymap_cache_class_init (PhocKeymapCacheClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->finalize = phoc_keymap_cache_finalize;
+}
+
+
+static void
+phoc_keymap_cache_init (PhocKeymapCache *self)
+{
+  self->context = xkb_context_new (XKB_CONTEXT_NO_FLAGS);
+  self->keymaps = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                                         (GDestroyNotify)xkb_keymap_unref);
+  self->cache_dir = g_build_filename (g_get_user_cache_dir (), "phoc", "keymaps", NULL);
+}
+
+/**
+ * phoc_keymap_cache_get_default:
+ *
+ * Get the keymap cache singleton.
+ *
+ * Returns: (transfer none): The keymap cache singleton
+ */
+PhocKeymapCache *
+phoc_keymap_cache_get_default (void)
+{
+  static PhocKeymapCache *instance;
+
+  if (G_UNLIKELY (instance == NULL)) {
+    instance = g_object_new (PHOC_TYPE_KEYMAP_CACHE, NULL);
+    g_object_add_weak_pointer (G_OBJECT (instance), (gpointer *)&instance);
+  }
+
+  return instance;
+}
+
+/**
+ * phoc_keymap_cache_lookup:
+ * @self: The keymap cache
+ * @names: The rule names to look up the keymap for
+ *
+ * Look up a keymap in the cache. If it's not cached in memory yet
+ * it's loaded from disk or compiled from the rule names.
+ *
+ * Returns: (transfer full): The keymap or %NULL if it can't be compiled
+ */
+struct xkb_keymap *
+phoc_keymap_cache_lookup (PhocKeymapCache *self, const struct xkb_rule_names *names)
+{
+  g_autofree char *key = NULL;
+  g_autofree char *path = NULL;
+  struct xkb_keymap *keymap;
+
+  g_return_val_if_fail (PHOC_IS_KEYMAP_CACHE (self), NULL);
+  g_return_val_if_fail (names, NULL);
+
+  if (self->context == NULL)
+    return NULL;
+
+  key = build_key (names);
+  keymap = g_hash_table_lookup (self->keymaps, key);
+  if (keymap)
+    return xkb_keymap_ref (keymap);
+
+  path = build_cache_path (self, key);
+  keymap = load_keymap (self, path);
+  if (keymap == NULL) {
+    g_debug ("Compiling keymap %s/%s/%s", names->layout, names->variant, names->options);
+    keymap = xkb_keymap_new_from_names (self->context, names, XKB_KEYMAP_COMPILE_NO_FLAGS);
+    if (keymap == NULL)
+      return NULL;
+    store_keymap (self, path, keymap);
+  }
+
+  g_hash_table_insert (self->keymaps, g_steal_pointer (&key), keymap);
+  return xkb_keymap_ref (keymap);
+}
+
+/**
+ * phoc_keymap_cache_clear:
+ * @self: The keymap cache
+ *
+ * Drop all in memory keymaps. Keymaps still in use by keyboards
+ * stay alive until they're no longer referenced. Persisted keymaps
+ * are kept.
+ */
+void
+phoc_keymap_cache_clear (PhocKeymapCache *self)
+{
+  g_return_if_fail (PHOC_IS_KEYMAP_CACHE (self));
+
+  g_hash_table_remove_all (self->keymaps);
+}
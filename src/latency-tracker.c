@@ -0,0 +1,417 @@
+/*
+ * Copyright (C) 2021 Purism SPC
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#define G_LOG_DOMAIN "phoc-latency-tracker"
+
+#include "config.h"
+#include "latency-tracker.h"
+
+/**
+ * PhocLatencyTracker:
+ *
+ * Measures input to photon latency. Input events are tagged with their
+ * timestamp and arrival time. The first commit of the focused surface
+ * that follows is then correlated with the output commit that renders
+ * it and that commit's presentation time. Results are collected in
+ * histograms per seat and per input device.
+ */
+
+/* Upper bounds of the histogram buckets in msec, the last bucket is open */
+static const gint64 bucket_limits_ms[] = { 8, 16, 24, 33, 50, 67, 100, 150, 250 };
+#define PHOC_LATENCY_N_BUCKETS (G_N_ELEMENTS (bucket_limits_ms) + 1)
+
+typedef enum {
+  PHOC_LATENCY_SAMPLE_PENDING,
+  PHOC_LATENCY_SAMPLE_COMMITTED,
+  PHOC_LATENCY_SAMPLE_RENDERED,
+  PHOC_LATENCY_SAMPLE_PRESENTING,
+} PhocLatencySampleState;
+
+typedef struct {
+  PhocLatencyTracker    *tracker;
+  PhocLatencySampleState state;
+
+  struct wlr_surface    *surface;
+  struct wlr_output     *output;
+  char                  *seat;
+  char                  *device;
+
+  gint64                 input_us;
+  gint64                 arrival_us;
+  gint64                 commit_us;
+  gint64                 output_commit_us;
+
+  struct wl_listener     surface_commit;
+  struct wl_listener     surface_destroy;
+} PhocLatencySample;
+
+typedef struct {
+  guint64 buckets[PHOC_LATENCY_N_BUCKETS];
+  guint64 count;
+  gint64  min_us, max_us, sum_us;
+  /* Per stage sums */
+  gint64  sum_dispatch_us, sum_client_us, sum_render_us, sum_present_us;
+} PhocLatencyHistogram;
+
+struct _PhocLatencyTracker {
+  GObject     parent;
+
+  GHashTable *samples;     /* wlr_surface -> PhocLatencySample */
+  GList      *presenting;  /* PhocLatencySample waiting for presentation */
+  GHashTable *histograms;  /* name -> PhocLatencyHistogram */
+};
+
+G_DEFINE_TYPE (PhocLatencyTracker, phoc_latency_tracker, G_TYPE_OBJECT)
+
+
+static void
+sample_detach_surface (PhocLatencySample *sample)
+{
+  if (sample->surface == NULL)
+    return;
+
+  wl_list_remove (&sample->surface_commit.link);
+  wl_list_remove (&sample->surface_destroy.link);
+  sample->surface = NULL;
+}
+
+
+static void
+sample_free (PhocLatencySample *sample)
+{
+  sample_detach_surface (sample);
+  g_free (sample->seat);
+  g_free (sample->device);
+  g_free (sample);
+}
+
+
+static void
+handle_surface_commit (struct wl_listener *listener, void *data)
+{
+  PhocLatencySample *sample = wl_container_of (listener, sample, surface_commit);
+
+  if (sample->state != PHOC_LATENCY_SAMPLE_PENDING)
+    return;
+
+  sample->commit_us = g_get_monotonic_time ();
+  sample->state = PHOC_LATENCY_SAMPLE_COMMITTED;
+}
+
+
+static void
+handle_surface_destroy (struct wl_listener *listener, void *data)
+{
+  PhocLatencySample *sample = wl_container_of (listener, sample, surface_destroy);
+
+  /* Frees the sample */
+  g_hash_table_remove (sample->tracker->samples, sample->surface);
+}
+
+
+static void
+histogram_add (PhocLatencyTracker *self, const char *name, PhocLatencySample *sample, gint64 present_us)
+{
+  PhocLatencyHistogram *histogram = g_hash_table_lookup (self->histograms, name);
+  gint64 latency_us = present_us - sample->input_us;
+  guint i;
+
+  if (histogram == NULL) {
+    histogram = g_new0 (PhocLatencyHistogram, 1);
+    histogram->min_us = G_MAXINT64;
+    g_hash_table_insert (self->histograms, g_strdup (name), histogram);
+  }
+
+  for (i = 0; i < G_N_ELEMENTS (bucket_limits_ms); i++) {
+    if (latency_us < bucket_limits_ms[i] * 1000)
+      break;
+  }
+  histogram->buckets[i]++;
+  histogram->count++;
+  histogram->sum_us += latency_us;
+  histogram->min_us = MIN (histogram->min_us, latency_us);
+  histogram->max_us = MAX (histogram->max_us, latency_us);
+
+  histogram->sum_dispatch_us += sample->arrival_us - sample->input_us;
+  histogram->sum_client_us += sample->commit_us - sample->arrival_us;
+  histogram->sum_render_us += sample->output_commit_us - sample->commit_us;
+  histogram->sum_present_us += present_us - sample->output_commit_us;
+}
+
+
+static void
+phoc_latency_tracker_finalize (GObject *object)
+{
+  PhocLatencyTracker *self = PHOC_LATENCY_TRACKER (object);
+
+  g_clear_pointer (&self->samples, g_hash_table_destroy);
+  g_list_free_full (self->presenting, (GDestroyNotify)sample_free);
+  self->presenting = NULL;
+  g_clear_pointer (&self->histograms, g_hash_table_destroy);
+
+  G_OBJECT_CLASS (phoc_latency_tracker_parent_class)->finalize (object);
+}
+
+
+static void
+phoc_latency_tracker_class_init (PhocLatencyTrackerClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->finalize = phoc_latency_tracker_finalize;
+}
+
+
+static void
+phoc_latency_tracker_init (PhocLatencyTracker *self)
+{
+  self->samples = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL,
+                                         (GDestroyNotify)sample_free);
+  self->histograms = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+}
+
+
+PhocLatencyTracker *
+phoc_latency_tracker_new (void)
+{
+  return g_object_new (PHOC_TYPE_LATENCY_TRACKER, NULL);
+}
+
+/**
+ * phoc_latency_tracker_input_event:
+ * @self: The latency tracker
+ * @seat: The name of the seat the event happened on
+ * @device: The input device
+ * @time_msec: The event's timestamp
+ * @surface: (nullable): The surface the event was delivered to
+ *
+ * Tag an input event. Only the first input event since the last commit of
+ * @surface is tracked.
+ */
+void
+phoc_latency_tracker_input_event (PhocLatencyTracker      *self,
+                                  const char              *seat,
+                                  struct wlr_input_device *device,
+                                  guint32                  time_msec,
+                                  struct wlr_surface      *surface)
+{
+  PhocLatencySample *sample;
+  gint64 now_us;
+  guint32 age_ms;
+
+  g_return_if_fail (PHOC_IS_LATENCY_TRACKER (self));
+
+  if (surface == NULL || g_hash_table_contains (self->samples, surface))
+    return;
+
+  now_us = g_get_monotonic_time ();
+  /* Event times are CLOCK_MONOTONIC in msec and wrap at 32 bit */
+  age_ms = (guint32)(now_us / 1000) - time_msec;
+
+  sample = g_new0 (PhocLatencySample, 1);
+  sample->tracker = self;
+  sample->state = PHOC_LATENCY_SAMPLE_PENDING;
+  sample->surface = surface;
+  sample->seat = g_strdup (seat);
+  sample->device = g_strdup (device ? device->name : "unknown");
+  sample->arrival_us = now_us;
+  sample->input_us = now_us - (gint64)age_ms * 1000;
+
+  sample->surface_commit.notify = handle_surface_commit;
+  wl_signal_add (&surface->events.commit, &sample->surface_commit);
+  sample->surface_destroy.notify = handle_surface_destroy;
+  wl_signal_add (&surface->events.destroy, &sample->surface_destroy);
+
+  g_hash_table_insert (self->samples, surface, sample);
+}
+
+/**
+ * phoc_latency_tracker_surface_rendered:
+ * @self: The latency tracker
+ * @surface: The surface
+ * @output: The output the surface got rendered on
+ *
+ * Note that @surface's current content is part of the frame being
+ * rendered on @output.
+ */
+void
+phoc_latency_tracker_surface_rendered (PhocLatencyTracker *self,
+                                       struct wlr_surface *surface,
+                                       struct wlr_output  *output)
+{
+  PhocLatencySample *sample;
+
+  g_return_if_fail (PHOC_IS_LATENCY_TRACKER (self));
+
+  sample = g_hash_table_lookup (self->samples, surface);
+  if (sample == NULL || sample->state != PHOC_LATENCY_SAMPLE_COMMITTED)
+    return;
+
+  sample->state = PHOC_LATENCY_SAMPLE_RENDERED;
+  sample->output = output;
+}
+
+/**
+ * phoc_latency_tracker_output_commit:
+ * @self: The latency tracker
+ * @output: The output
+ * @committed: Whether the output commit succeeded
+ *
+ * Correlate the surfaces rendered on @output with the output commit.
+ */
+void
+phoc_latency_tracker_output_commit (PhocLatencyTracker *self,
+                                    struct wlr_output  *output,
+                                    gboolean            committed)
+{
+  PhocLatencySample *sample;
+  GHashTableIter iter;
+  gint64 now_us = g_get_monotonic_time ();
+
+  g_return_if_fail (PHOC_IS_LATENCY_TRACKER (self));
+
+  g_hash_table_iter_init (&iter, self->samples);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *)&sample)) {
+    if (sample->state != PHOC_LATENCY_SAMPLE_RENDERED || sample->output != output)
+      continue;
+
+    if (!committed) {
+      /* Try again with the next frame */
+      sample->state = PHOC_LATENCY_SAMPLE_COMMITTED;
+      sample->output = NULL;
+      continue;
+    }
+
+    g_hash_table_iter_steal (&iter);
+    sample_detach_surface (sample);
+    sample->output_commit_us = now_us;
+    sample->state = PHOC_LATENCY_SAMPLE_PRESENTING;
+    self->presenting = g_list_prepend (self->presenting, sample);
+  }
+}
+
+/**
+ * phoc_latency_tracker_output_present:
+ * @self: The latency tracker
+ * @output: The output
+ * @when: The presentation time (CLOCK_MONOTONIC)
+ *
+ * Finish all samples committed to @output and add them to the histograms.
+ */
+void
+phoc_latency_tracker_output_present (PhocLatencyTracker    *self,
+                                     struct wlr_output     *output,
+                                     const struct timespec *when)
+{
+  gint64 present_us;
+  GList *l = NULL;
+
+  g_return_if_fail (PHOC_IS_LATENCY_TRACKER (self));
+
+  if (when)
+    present_us = (gint64)when->tv_sec * G_USEC_PER_SEC + when->tv_nsec / 1000;
+  else
+    present_us = g_get_monotonic_time ();
+
+  l = self->presenting;
+  while (l) {
+    PhocLatencySample *sample = l->data;
+    GList *next = l->next;
+
+    if (sample->output == output) {
+      g_autofree char *device = g_strdup_printf ("%s/%s", sample->seat, sample->device);
+
+      histogram_add (self, sample->seat, sample, present_us);
+      histogram_add (self, device, sample, present_us);
+
+      self->presenting = g_list_delete_link (self->presenting, l);
+      sample_free (sample);
+    }
+    l = next;
+  }
+}
+
+/**
+ * phoc_latency_tracker_output_destroyed:
+ * @self: The latency tracker
+ * @output: The output
+ *
+ * Drop all references to @output.
+ */
+void
+phoc_latency_tracker_output_destroyed (PhocLatencyTracker *self,
+                                       struct wlr_output  *output)
+{
+  PhocLatencySample *sample;
+  GHashTableIter iter;
+  GList *l;
+
+  g_return_if_fail (PHOC_IS_LATENCY_TRACKER (self));
+
+  g_hash_table_iter_init (&iter, self->samples);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *)&sample)) {
+    if (sample->output == output) {
+      sample->state = PHOC_LATENCY_SAMPLE_COMMITTED;
+      sample->output = NULL;
+    }
+  }
+
+  l = self->presenting;
+  while (l) {
+    GList *next = l->next;
+
+    sample = l->data;
+    if (sample->output == output) {
+      self->presenting = g_list_delete_link (self->presenting, l);
+      sample_free (sample);
+    }
+    l = next;
+  }
+}
+
+/**
+ * phoc_latency_tracker_to_string:
+ * @self: The latency tracker
+ *
+ * Get a human readable summary of the collected latency histograms.
+ *
+ * Returns: (transfer full): The summary
+ */
+char *
+phoc_latency_tracker_to_string (PhocLatencyTracker *self)
+{
+  g_autoptr (GList) names = NULL;
+  GString *str;
+
+  g_return_val_if_fail (PHOC_IS_LATENCY_TRACKER (self), NULL);
+
+  str = g_string_new ("Input to photon latency:\n");
+  names = g_list_sort (g_hash_table_get_keys (self->histograms), (GCompareFunc)g_strcmp0);
+
+  for (GList *l = names; l; l = l->next) {
+    PhocLatencyHistogram *h = g_hash_table_lookup (self->histograms, l->data);
+    double n = h->count;
+
+    g_string_append_printf (str, "  %s: n=%" G_GUINT64_FORMAT
+                            " min=%.1fms avg=%.1fms max=%.1fms"
+                            " (dispatch %.1fms, client %.1fms, render %.1fms, present %.1fms)\n",
+                            (char *)l->data, h->count,
+                            h->min_us / 1000.0, h->sum_us / n / 1000.0, h->max_us / 1000.0,
+                            h->sum_dispatch_us / n / 1000.0, h->sum_client_us / n / 1000.0,
+                            h->sum_render_us / n / 1000.0, h->sum_present_us / n / 1000.0);
+    g_string_append (str, "   ");
+    for (guint i = 0; i < PHOC_LATENCY_N_BUCKETS; i++) {
+      if (i < G_N_ELEMENTS (bucket_limits_ms))
+        g_string_append_printf (str, " <%" G_GINT64_FORMAT "ms:", bucket_limits_ms[i]);
+      else
+        g_string_append (str, " more:");
+      g_string_append_printf (str, "%" G_GUINT64_FORMAT, h->buckets[i]);
+    }
+    g_string_append_c (str, '\n');
+  }
+
+  return g_string_free (str, FALSE);
+}
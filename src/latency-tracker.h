@@ -0,0 +1,40 @@
+/*
+ * Copyright (C) 2021 Purism SPC
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <glib-object.h>
+#include <time.h>
+#include <wlr/types/wlr_compositor.h>
+#include <wlr/types/wlr_input_device.h>
+#include <wlr/types/wlr_output.h>
+
+G_BEGIN_DECLS
+
+#define PHOC_TYPE_LATENCY_TRACKER (phoc_latency_tracker_get_type ())
+
+G_DECLARE_FINAL_TYPE (PhocLatencyTracker, phoc_latency_tracker, PHOC, LATENCY_TRACKER, GObject)
+
+PhocLatencyTracker *phoc_latency_tracker_new              (void);
+void                phoc_latency_tracker_input_event      (PhocLatencyTracker      *self,
+                                                           const char              *seat,
+                                                           struct wlr_input_device *device,
+                                                           guint32                  time_msec,
+                                                           struct wlr_surface      *surface);
+void                phoc_latency_tracker_surface_rendered (PhocLatencyTracker      *self,
+                                                           struct wlr_surface      *surface,
+                                                           struct wlr_output       *output);
+void                phoc_latency_tracker_output_commit    (PhocLatencyTracker      *self,
+                                                           struct wlr_output       *output,
+                                                           gboolean                 committed);
+void                phoc_latency_tracker_output_present   (PhocLatencyTracker      *self,
+                                                           struct wlr_output       *output,
+                                                           const struct timespec   *when);
+void                phoc_latency_tracker_output_destroyed (PhocLatencyTracker      *self,
+                                                           struct wlr_output       *output);
+char               *phoc_latency_tracker_to_string        (PhocLatencyTracker      *self);
+
+G_END_DECLS
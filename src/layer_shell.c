@@ -16,10 +16,12 @@
 #include <wlr/types/wlr_surface.h>
 #include <wlr/types/wlr_layer_shell_v1.h>
 #include <wlr/util/log.h>
+#include "client.h"
 #include "desktop.h"
 #include "layers.h"
 #include "output.h"
 #include "server.h"
+#include "trace.h"
 
 #define LAYER_SHELL_LAYER_COUNT 4
 
@@ -243,6 +245,7 @@ static void change_osk(const struct osk_origin *osk, struct wl_list layers[LAYER
 }
 
 void arrange_layers(PhocOutput *output) {
+	PHOC_TRACE_SCOPE("arrange_layers");
 	struct wlr_box usable_area = { 0 };
 	PhocServer *server = phoc_server_get_default ();
 
@@ -341,11 +344,13 @@ static void handle_output_destroy(struct wl_listener *listener, void *data) {
 }
 
 static void handle_surface_commit(struct wl_listener *listener, void *data) {
+	PHOC_TRACE_SCOPE("layer_shell: handle_surface_commit");
 	PhocServer *server = phoc_server_get_default ();
 	struct roots_layer_surface *layer =
 		wl_container_of(listener, layer, surface_commit);
 	struct wlr_layer_surface_v1 *layer_surface = layer->layer_surface;
 	struct wlr_output *wlr_output = layer_surface->output;
+	gint64 start = phoc_client_commit_begin();
 	if (wlr_output != NULL) {
 		PhocOutput *output = wlr_output->data;
 		struct wlr_box old_geo = layer->geo;
@@ -383,6 +388,7 @@ static void handle_surface_commit(struct wl_listener *listener, void *data) {
 							      layer->geo.x, layer->geo.y);
 		}
 	}
+	phoc_client_commit_end(layer_surface->surface, start);
 }
 
 static void unmap(struct wlr_layer_surface_v1 *layer_surface) {
@@ -518,6 +524,8 @@ static void popup_handle_map(struct wl_listener *listener, void *data) {
 	wl_signal_add(&popup->wlr_popup->base->surface->events.new_subsurface, &popup->new_subsurface);
 
 	wlr_surface_send_enter(popup->wlr_popup->base->surface, wlr_output);
+	phoc_desktop_set_surface_scale(server->desktop,
+		popup->wlr_popup->base->surface, wlr_output->scale);
 	popup_damage(popup, true);
 	phoc_input_update_cursor_focus(server->input);
 }
@@ -639,6 +647,8 @@ static void subsurface_handle_map(struct wl_listener *listener, void *data) {
 	wl_signal_add(&subsurface->wlr_subsurface->surface->events.new_subsurface, &subsurface->new_subsurface);
 
 	wlr_surface_send_enter(subsurface->wlr_subsurface->surface, subsurface_get_root_layer(subsurface)->layer_surface->output);
+	phoc_desktop_set_surface_scale(server->desktop, subsurface->wlr_subsurface->surface,
+		subsurface_get_root_layer(subsurface)->layer_surface->output->scale);
 	subsurface_damage(subsurface, true);
 	phoc_input_update_cursor_focus(server->input);
 }
@@ -780,6 +790,10 @@ void handle_layer_shell_surface(struct wl_listener *listener, void *data) {
 		}
 	}
 
+	/* Let the client pick a matching buffer size before its first commit */
+	phoc_desktop_set_surface_scale(desktop, layer_surface->surface,
+		layer_surface->output->scale);
+
 	struct roots_layer_surface *roots_surface =
 		calloc(1, sizeof(struct roots_layer_surface));
 	if (!roots_surface) {
@@ -71,6 +71,18 @@ static GDebugKey debug_keys[] =
  { .key = "no-quit",
    .value = PHOC_SERVER_DEBUG_FLAG_NO_QUIT,
  },
+ { .key = "latency",
+   .value = PHOC_SERVER_DEBUG_FLAG_LATENCY,
+ },
+ { .key = "client-stats",
+   .value = PHOC_SERVER_DEBUG_FLAG_CLIENT_STATS,
+ },
+ { .key = "trace",
+   .value = PHOC_SERVER_DEBUG_FLAG_TRACE,
+ },
+ { .key = "views",
+   .value = PHOC_SERVER_DEBUG_FLAG_VIEWS,
+ },
 };
 
 
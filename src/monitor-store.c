@@ -0,0 +1,226 @@
+/*
+ * Copyright (C) 2021 Purism SPC
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#define G_LOG_DOMAIN "phoc-monitor-store"
+
+#include "config.h"
+#include "monitor-store.h"
+
+#include <glib/gstdio.h>
+
+/**
+ * PhocMonitorStore:
+ *
+ * Persists the last applied configuration (mode, scale, transform and
+ * position) of monitors keyed by their make, model and serial so it
+ * can be restored with a single modeset when the monitor shows up
+ * again. Monitors without make and model (e.g. lacking an EDID) can't
+ * be told apart so nothing is stored for them.
+ */
+struct _PhocMonitorStore {
+  GObject   parent;
+
+  GKeyFile *keyfile;
+  char     *path;
+};
+
+G_DEFINE_TYPE (PhocMonitorStore, phoc_monitor_store, G_TYPE_OBJECT)
+
+
+static char *
+build_group (struct wlr_output *wlr_output)
+{
+  if (!wlr_output->make[0] || !wlr_output->model[0])
+    return NULL;
+
+  return g_strdup_printf ("%s %s %s",
+                          wlr_output->make,
+                          wlr_output->model,
+                          wlr_output->serial[0] ? wlr_output->serial : "Unknown");
+}
+
+
+static void
+phoc_monitor_store_finalize (GObject *object)
+{
+  PhocMonitorStore *self = PHOC_MONITOR_STORE (object);
+
+  g_clear_pointer (&self->keyfile, g_key_file_unref);
+  g_clear_pointer (&self->path, g_free);
+
+  G_OBJECT_CLASS (phoc_monitor_store_parent_class)->finalize (object);
+}
+
+
+static void
+phoc_monitor_store_class_init (PhocMonitorStoreClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->finalize = phoc_monitor_store_finalize;
+}
+
+
+static void
+phoc_monitor_store_init (PhocMonitorStore *self)
+{
+  g_autoptr (GError) err = NULL;
+
+  self->path = g_build_filename (g_get_user_config_dir (), "phoc", "monitors.ini", NULL);
+  self->keyfile = g_key_file_new ();
+
+  if (!g_key_file_load_from_file (self->keyfile, self->path, G_KEY_FILE_NONE, &err)) {
+    if (!g_error_matches (err, G_FILE_ERROR, G_FILE_ERROR_NOENT))
+      g_warning ("Failed to load monitor configuration %s: %s", self->path, err->message);
+  }
+}
+
+/**
+ * phoc_monitor_store_get_default:
+ *
+ * Get the monitor store singleton.
+ *
+ * Returns: (transfer none): The monitor store singleton
+ */
+PhocMonitorStore *
+phoc_monitor_store_get_default (void)
+{
+  static PhocMonitorStore *instance;
+
+  if (G_UNLIKELY (instance == NULL)) {
+    instance = g_object_new (PHOC_TYPE_MONITOR_STORE, NULL);
+    g_object_add_weak_pointer (G_OBJECT (instance), (gpointer *)&instance);
+  }
+
+  return instance;
+}
+
+/**
+ * phoc_monitor_store_lookup:
+ * @self: The monitor store
+ * @wlr_output: The output to look up the stored configuration for
+ * @config: (out): The stored configuration
+ *
+ * Look up the last applied configuration of the monitor connected to
+ * @wlr_output.
+ *
+ * Returns: %TRUE if a configuration was found, %FALSE otherwise
+ */
+gboolean
+phoc_monitor_store_lookup (PhocMonitorStore  *self,
+                           struct wlr_output *wlr_output,
+                           PhocMonitorConfig *config)
+{
+  g_autofree char *group = NULL;
+  g_autoptr (GError) err = NULL;
+
+  g_return_val_if_fail (PHOC_IS_MONITOR_STORE (self), FALSE);
+  g_return_val_if_fail (wlr_output, FALSE);
+  g_return_val_if_fail (config, FALSE);
+
+  group = build_group (wlr_output);
+  if (group == NULL || !g_key_file_has_group (self->keyfile, group))
+    return FALSE;
+
+  config->enabled = g_key_file_get_boolean (self->keyfile, group, "enabled", &err);
+  if (err)
+    goto invalid;
+  config->width = g_key_file_get_integer (self->keyfile, group, "width", &err);
+  if (err)
+    goto invalid;
+  config->height = g_key_file_get_integer (self->keyfile, group, "height", &err);
+  if (err)
+    goto invalid;
+  config->refresh = g_key_file_get_integer (self->keyfile, group, "refresh", &err);
+  if (err)
+    goto invalid;
+  config->scale = g_key_file_get_double (self->keyfile, group, "scale", &err);
+  if (err)
+    goto invalid;
+  config->transform = g_key_file_get_integer (self->keyfile, group, "transform", &err);
+  if (err)
+    goto invalid;
+  config->x = g_key_file_get_integer (self->keyfile, group, "x", &err);
+  if (err)
+    goto invalid;
+  config->y = g_key_file_get_integer (self->keyfile, group, "y", &err);
+  if (err)
+    goto invalid;
+
+  if (config->scale <= 0.0 || config->transform > WL_OUTPUT_TRANSFORM_FLIPPED_270)
+    goto invalid;
+
+  return TRUE;
+
+ invalid:
+  g_warning ("Ignoring invalid stored configuration for '%s'", group);
+  return FALSE;
+}
+
+/**
+ * phoc_monitor_store_update:
+ * @self: The monitor store
+ * @wlr_output: The output to store the configuration of
+ * @x: The output's x position in the layout
+ * @y: The output's y position in the layout
+ *
+ * Update the stored configuration of the monitor connected to
+ * @wlr_output with its current state. Use phoc_monitor_store_save()
+ * to write the changes to disk.
+ */
+void
+phoc_monitor_store_update (PhocMonitorStore  *self,
+                           struct wlr_output *wlr_output,
+                           int                x,
+                           int                y)
+{
+  g_autofree char *group = NULL;
+
+  g_return_if_fail (PHOC_IS_MONITOR_STORE (self));
+  g_return_if_fail (wlr_output);
+
+  group = build_group (wlr_output);
+  if (group == NULL) {
+    g_debug ("Not storing configuration of unidentifiable output '%s'", wlr_output->name);
+    return;
+  }
+
+  g_key_file_set_boolean (self->keyfile, group, "enabled", wlr_output->enabled);
+  /* Keep the last mode of disabled monitors */
+  if (wlr_output->enabled || !g_key_file_has_key (self->keyfile, group, "width", NULL)) {
+    g_key_file_set_integer (self->keyfile, group, "width", wlr_output->width);
+    g_key_file_set_integer (self->keyfile, group, "height", wlr_output->height);
+    g_key_file_set_integer (self->keyfile, group, "refresh", wlr_output->refresh);
+    g_key_file_set_double (self->keyfile, group, "scale", wlr_output->scale);
+    g_key_file_set_integer (self->keyfile, group, "transform", wlr_output->transform);
+    g_key_file_set_integer (self->keyfile, group, "x", x);
+    g_key_file_set_integer (self->keyfile, group, "y", y);
+  }
+}
+
+/**
+ * phoc_monitor_store_save:
+ * @self: The monitor store
+ *
+ * Write the stored configurations to disk.
+ */
+void
+phoc_monitor_store_save (PhocMonitorStore *self)
+{
+  g_autofree char *dir = NULL;
+  g_autoptr (GError) err = NULL;
+
+  g_return_if_fail (PHOC_IS_MONITOR_STORE (self));
+
+  dir = g_path_get_dirname (self->path);
+  if (g_mkdir_with_parents (dir, 0700) != 0) {
+    g_debug ("Failed to create monitor store dir %s", dir);
+    return;
+  }
+
+  if (!g_key_file_save_to_file (self->keyfile, self->path, &err))
+    g_warning ("Failed to store monitor configuration %s: %s", self->path, err->message);
+}
@@ -0,0 +1,49 @@
+/*
+ * Copyright (C) 2021 Purism SPC
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <glib-object.h>
+#include <wlr/types/wlr_output.h>
+
+G_BEGIN_DECLS
+
+/**
+ * PhocMonitorConfig:
+ * @enabled: Whether the monitor is enabled
+ * @width: The mode's width in pixels
+ * @height: The mode's height in pixels
+ * @refresh: The mode's refresh rate in mHz
+ * @scale: The output scale
+ * @transform: The output transform
+ * @x: The x position in the output layout
+ * @y: The y position in the output layout
+ *
+ * The last applied configuration of a monitor.
+ */
+typedef struct _PhocMonitorConfig {
+  gboolean                 enabled;
+  int                      width, height, refresh;
+  float                    scale;
+  enum wl_output_transform transform;
+  int                      x, y;
+} PhocMonitorConfig;
+
+#define PHOC_TYPE_MONITOR_STORE (phoc_monitor_store_get_type ())
+
+G_DECLARE_FINAL_TYPE (PhocMonitorStore, phoc_monitor_store, PHOC, MONITOR_STORE, GObject)
+
+PhocMonitorStore *phoc_monitor_store_get_default (void);
+gboolean          phoc_monitor_store_lookup      (PhocMonitorStore  *self,
+                                                  struct wlr_output *wlr_output,
+                                                  PhocMonitorConfig *config);
+void              phoc_monitor_store_update      (PhocMonitorStore  *self,
+                                                  struct wlr_output *wlr_output,
+                                                  int                x,
+                                                  int                y);
+void              phoc_monitor_store_save        (PhocMonitorStore  *self);
+
+G_END_DECLS
@@ -4,6 +4,7 @@
 
 #define _POSIX_C_SOURCE 200809L
 #include <assert.h>
+#include <math.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <time.h>
@@ -17,7 +18,9 @@
 #include <wlr/util/region.h>
 #include "settings.h"
 #include "layers.h"
+#include "monitor-store.h"
 #include "output.h"
+#include "presentation-time-protocol.h"
 #include "render.h"
 #include "server.h"
 #include "utils.h"
@@ -29,6 +32,8 @@ enum {
   PROP_0,
   PROP_DESKTOP,
   PROP_WLR_OUTPUT,
+  PROP_LOW_REFRESH,
+  PROP_RENDER_SCALE,
   PROP_LAST_PROP
 };
 static GParamSpec *props[PROP_LAST_PROP];
@@ -60,6 +65,7 @@ get_surface_box (struct surface_iterator_data *data,
     return false;
   }
 
+  /* With a viewport this is already the destination size */
   int sw = surface->current.width;
   int sh = surface->current.height;
 
@@ -113,6 +119,9 @@ phoc_output_set_property (GObject      *object,
     self->wlr_output = g_value_get_pointer (value);
     g_object_notify_by_pspec (G_OBJECT (self), props[PROP_WLR_OUTPUT]);
     break;
+  case PROP_RENDER_SCALE:
+    phoc_output_set_render_scale (self, g_value_get_float (value));
+    break;
   default:
     G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
     break;
@@ -134,15 +143,253 @@ phoc_output_get_property (GObject    *object,
   case PROP_WLR_OUTPUT:
     g_value_set_pointer (value, self->wlr_output);
     break;
+  case PROP_LOW_REFRESH:
+    g_value_set_boolean (value, phoc_output_get_low_refresh (self));
+    break;
+  case PROP_RENDER_SCALE:
+    g_value_set_float (value, self->render_scale);
+    break;
   default:
     G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
     break;
   }
 }
 
+/* Ignore damage caused by the mode switch itself */
+#define PHOC_LOW_REFRESH_GRACE_USEC (G_USEC_PER_SEC / 2)
+
+static gboolean on_idle_refresh_timeout (gpointer data);
+static void update_output_manager_config (PhocDesktop *desktop);
+
+static void
+schedule_idle_refresh (PhocOutput *self, guint timeout)
+{
+  if (self->idle_refresh_id)
+    g_source_remove (self->idle_refresh_id);
+
+  self->idle_refresh_id = g_timeout_add_seconds (timeout, on_idle_refresh_timeout, self);
+  g_source_set_name_by_id (self->idle_refresh_id, "[phoc] idle refresh");
+}
+
+
+static struct wlr_output_mode *
+find_low_refresh_mode (struct wlr_output *wlr_output)
+{
+  struct wlr_output_mode *mode, *current = wlr_output->current_mode, *lowest = NULL;
+
+  /* Custom modes can't be switched reliably */
+  if (current == NULL)
+    return NULL;
+
+  wl_list_for_each (mode, &wlr_output->modes, link) {
+    if (mode->width != current->width || mode->height != current->height)
+      continue;
+
+    if (mode->refresh >= current->refresh)
+      continue;
+
+    if (lowest == NULL || mode->refresh < lowest->refresh)
+      lowest = mode;
+  }
+
+  return lowest;
+}
+
+
+static gboolean
+on_idle_refresh_timeout (gpointer data)
+{
+  PhocOutput *self = PHOC_OUTPUT (data);
+  struct wlr_output_mode *low;
+  gint64 idle_usec = g_get_monotonic_time () - self->last_activity;
+  gint64 timeout_usec = (gint64)self->idle_refresh_timeout * G_USEC_PER_SEC;
+
+  self->idle_refresh_id = 0;
+
+  if (idle_usec < timeout_usec) {
+    guint remaining = (timeout_usec - idle_usec + G_USEC_PER_SEC - 1) / G_USEC_PER_SEC;
+
+    schedule_idle_refresh (self, MAX (remaining, 1));
+    return G_SOURCE_REMOVE;
+  }
+
+  if (!self->wlr_output->enabled)
+    goto rearm;
+
+  low = find_low_refresh_mode (self->wlr_output);
+  if (low == NULL)
+    goto rearm;
+
+  self->full_refresh_mode = self->wlr_output->current_mode;
+  wlr_output_set_mode (self->wlr_output, low);
+  if (!wlr_output_commit (self->wlr_output)) {
+    g_warning ("Failed to switch %s to %d mHz", self->wlr_output->name, low->refresh);
+    wlr_output_rollback (self->wlr_output);
+    self->full_refresh_mode = NULL;
+    goto rearm;
+  }
+
+  g_debug ("Switched idle output %s to %d mHz", self->wlr_output->name, low->refresh);
+  self->low_refresh_mode = low;
+  self->low_refresh_since = g_get_monotonic_time ();
+  g_object_notify_by_pspec (G_OBJECT (self), props[PROP_LOW_REFRESH]);
+  update_output_manager_config (self->desktop);
+  return G_SOURCE_REMOVE;
+
+ rearm:
+  schedule_idle_refresh (self, self->idle_refresh_timeout);
+  return G_SOURCE_REMOVE;
+}
+
+
+static gboolean
+on_restore_refresh (gpointer data)
+{
+  PhocOutput *self = PHOC_OUTPUT (data);
+
+  self->restore_refresh_id = 0;
+
+  if (self->low_refresh_mode == NULL)
+    return G_SOURCE_REMOVE;
+
+  /* Only switch back if nobody changed the mode meanwhile */
+  if (!self->wlr_output->enabled || self->wlr_output->current_mode != self->low_refresh_mode)
+    return G_SOURCE_REMOVE;
+
+  wlr_output_set_mode (self->wlr_output, self->full_refresh_mode);
+  if (!wlr_output_commit (self->wlr_output)) {
+    g_warning ("Failed to restore refresh rate of %s", self->wlr_output->name);
+    wlr_output_rollback (self->wlr_output);
+    return G_SOURCE_REMOVE;
+  }
+
+  g_debug ("Restored refresh rate of %s", self->wlr_output->name);
+  self->low_refresh_mode = NULL;
+  self->full_refresh_mode = NULL;
+  g_object_notify_by_pspec (G_OBJECT (self), props[PROP_LOW_REFRESH]);
+  update_output_manager_config (self->desktop);
+
+  schedule_idle_refresh (self, self->idle_refresh_timeout);
+  /* A video mode switch might have been held back */
+  phoc_output_update_content_policy (self);
+  return G_SOURCE_REMOVE;
+}
+
+
+/*
+ * Find the lowest refresh rate of at least 48Hz at the current
+ * resolution that is an integer multiple of the content's rate so
+ * every frame is shown for the same number of refresh cycles.
+ */
+static struct wlr_output_mode *
+find_video_mode (PhocOutput *self, int content_rate)
+{
+  struct wlr_output_mode *mode, *best = NULL;
+  struct wlr_output_mode *base = self->pre_video_mode ?: self->full_refresh_mode;
+
+  if (base == NULL)
+    base = self->wlr_output->current_mode;
+
+  if (base == NULL)
+    return NULL;
+
+  wl_list_for_each (mode, &self->wlr_output->modes, link) {
+    double ratio = (double)mode->refresh / content_rate;
+
+    if (mode->width != base->width || mode->height != base->height)
+      continue;
+
+    if (mode->refresh < 48000 || ratio < 1.0)
+      continue;
+
+    if (fabs (ratio - round (ratio)) / round (ratio) > 0.005)
+      continue;
+
+    if (best == NULL || mode->refresh < best->refresh)
+      best = mode;
+  }
+
+  return best;
+}
+
+
+static gboolean
+on_content_policy (gpointer data)
+{
+  PhocOutput *self = PHOC_OUTPUT (data);
+  struct roots_view *view = self->fullscreen_view;
+  struct wlr_output_mode *mode = NULL;
+
+  self->content_policy_id = 0;
+
+  if (!self->wlr_output->enabled)
+    return G_SOURCE_REMOVE;
+
+  if (view && view->content_type == PHOC_CONTENT_TYPE_VIDEO && view->content_rate)
+    mode = find_video_mode (self, view->content_rate);
+
+  if (mode) {
+    if (mode == self->wlr_output->current_mode)
+      return G_SOURCE_REMOVE;
+
+    if (self->pre_video_mode == NULL)
+      self->pre_video_mode = self->full_refresh_mode ?: self->wlr_output->current_mode;
+    wlr_output_set_mode (self->wlr_output, mode);
+    if (!wlr_output_commit (self->wlr_output)) {
+      g_warning ("Failed to switch %s to %d mHz for video", self->wlr_output->name, mode->refresh);
+      wlr_output_rollback (self->wlr_output);
+      if (self->video_refresh_mode == NULL)
+        self->pre_video_mode = NULL;
+      return G_SOURCE_REMOVE;
+    }
+    g_debug ("Switched %s to %d mHz for %d mHz video", self->wlr_output->name,
+             mode->refresh, view->content_rate);
+    self->video_refresh_mode = mode;
+
+    /* Playing video is activity, the video mode replaces the idle one */
+    if (self->restore_refresh_id) {
+      g_source_remove (self->restore_refresh_id);
+      self->restore_refresh_id = 0;
+    }
+    if (self->low_refresh_mode) {
+      self->low_refresh_mode = NULL;
+      self->full_refresh_mode = NULL;
+      g_object_notify_by_pspec (G_OBJECT (self), props[PROP_LOW_REFRESH]);
+      schedule_idle_refresh (self, self->idle_refresh_timeout);
+    }
+    update_output_manager_config (self->desktop);
+    return G_SOURCE_REMOVE;
+  }
+
+  if (self->pre_video_mode == NULL)
+    return G_SOURCE_REMOVE;
+
+  if (self->low_refresh_mode) {
+    /* Idle from the video mode, leaving idle restores the mode before the video */
+    if (self->full_refresh_mode == self->video_refresh_mode)
+      self->full_refresh_mode = self->pre_video_mode;
+  } else if (self->wlr_output->current_mode == self->video_refresh_mode) {
+    /* Only switch back if nobody changed the mode meanwhile */
+    wlr_output_set_mode (self->wlr_output, self->pre_video_mode);
+    if (wlr_output_commit (self->wlr_output)) {
+      update_output_manager_config (self->desktop);
+    } else {
+      g_warning ("Failed to restore refresh rate of %s", self->wlr_output->name);
+      wlr_output_rollback (self->wlr_output);
+    }
+  }
+  self->pre_video_mode = NULL;
+  self->video_refresh_mode = NULL;
+
+  return G_SOURCE_REMOVE;
+}
+
+
 static void
 phoc_output_init (PhocOutput *self)
 {
+  self->render_scale = 1.0;
+  self->thermal_render_scale = 1.0;
 }
 
 PhocOutput *
@@ -180,12 +427,50 @@ static void
 phoc_output_handle_destroy (struct wl_listener *listener, void *data)
 {
   PhocOutput *self = wl_container_of (listener, self, output_destroy);
+  PhocServer *server = phoc_server_get_default ();
+
+  if (G_UNLIKELY (server->latency_tracker))
+    phoc_latency_tracker_output_destroyed (server->latency_tracker, self->wlr_output);
+
+  if (self->mirrored_by)
+    phoc_output_set_mirror_source (self->mirrored_by, NULL);
+  phoc_output_set_mirror_source (self, NULL);
+  phoc_output_set_scanout_feedback (self, NULL, 0);
 
   update_output_manager_config (self->desktop);
 
   g_signal_emit (self, signals[OUTPUT_DESTROY], 0);
 }
 
+static void
+phoc_output_handle_present (struct wl_listener *listener, void *data)
+{
+  PhocOutput *self = wl_container_of (listener, self, present);
+  PhocServer *server = phoc_server_get_default ();
+  struct wlr_output_event_present *event = data;
+
+  if (G_UNLIKELY (server->latency_tracker)) {
+    phoc_latency_tracker_output_present (server->latency_tracker,
+                                         self->wlr_output, event->when);
+  }
+
+  if (self->scanout_feedback == NULL || event->commit_seq != self->scanout_feedback_seq)
+    return;
+
+  if (event->presented) {
+    struct wlr_presentation_event presentation_event = { 0 };
+
+    /* Same vblank timestamp, refresh and flags the backend reports for
+     * composited frames, but the client buffer was put on the plane */
+    wlr_presentation_event_from_output (&presentation_event, event);
+    presentation_event.flags |= WP_PRESENTATION_FEEDBACK_KIND_ZERO_COPY;
+    wlr_presentation_feedback_send_presented (self->scanout_feedback, &presentation_event);
+  }
+  /* Destroying unsent feedback discards it */
+  wlr_presentation_feedback_destroy (self->scanout_feedback);
+  self->scanout_feedback = NULL;
+}
+
 static void
 phoc_output_handle_enable (struct wl_listener *listener, void *data)
 {
@@ -194,11 +479,63 @@ phoc_output_handle_enable (struct wl_listener *listener, void *data)
   update_output_manager_config (self->desktop);
 }
 
+/*
+ * External outputs render after all pending events got dispatched so a
+ * builtin panel's frame doesn't have to wait for a (large) external
+ * output's composition.
+ */
+static gboolean
+phoc_output_should_defer_render (PhocOutput *self)
+{
+  PhocOutput *output;
+
+  if (phoc_output_is_builtin (self))
+    return FALSE;
+
+  /* Games want their frames out as early as possible */
+  if (self->fullscreen_view && self->fullscreen_view->content_type == PHOC_CONTENT_TYPE_GAME)
+    return FALSE;
+
+  wl_list_for_each (output, &self->desktop->outputs, link) {
+    if (output != self && output->wlr_output->enabled && phoc_output_is_builtin (output))
+      return TRUE;
+  }
+
+  return FALSE;
+}
+
+static gboolean
+on_deferred_render (gpointer data)
+{
+  PhocOutput *self = PHOC_OUTPUT (data);
+
+  self->render_idle_id = 0;
+  output_render (self);
+
+  return G_SOURCE_REMOVE;
+}
+
 static void
 phoc_output_damage_handle_frame (struct wl_listener *listener,
                                  void               *data)
 {
   PhocOutput *self = wl_container_of (listener, self, damage_frame);
+  struct roots_view *view, *tmp;
+
+  /* Views that became visible need their deferred commits processed
+   * before they get rendered */
+  wl_list_for_each_safe (view, tmp, &self->desktop->views, link) {
+    if (view->commit_deferred && view_is_on_screen (view))
+      view_flush_deferred_commit (view);
+  }
+
+  if (self->desktop->config->defer_external_outputs && phoc_output_should_defer_render (self)) {
+    if (self->render_idle_id == 0) {
+      self->render_idle_id = g_idle_add_full (G_PRIORITY_HIGH_IDLE, on_deferred_render, self, NULL);
+      g_source_set_name_by_id (self->render_idle_id, "[phoc] deferred render");
+    }
+    return;
+  }
 
   output_render (self);
 }
@@ -262,6 +599,53 @@ phoc_output_set_mode (struct wlr_output *output, struct roots_output_config *oc)
   }
 }
 
+static gboolean
+phoc_output_has_other_enabled (PhocOutput *self)
+{
+  PhocOutput *output;
+
+  wl_list_for_each (output, &self->desktop->outputs, link) {
+    if (output != self && output->wlr_output->enabled)
+      return TRUE;
+  }
+
+  return FALSE;
+}
+
+
+static void
+phoc_output_apply_monitor_config (PhocOutput *self, PhocMonitorConfig *mc)
+{
+  struct wlr_output_mode *mode, *best = NULL;
+
+  /* Never leave the user with a black built in panel or no output at all */
+  if (!mc->enabled) {
+    if (!phoc_output_is_builtin (self) && phoc_output_has_other_enabled (self)) {
+      wlr_output_enable (self->wlr_output, false);
+      return;
+    }
+    g_debug ("Not restoring disabled state of %s", self->wlr_output->name);
+  }
+
+  wl_list_for_each (mode, &self->wlr_output->modes, link) {
+    if (mode->width == mc->width && mode->height == mc->height &&
+        mode->refresh == mc->refresh) {
+      best = mode;
+      break;
+    }
+  }
+  if (best == NULL)
+    best = wlr_output_preferred_mode (self->wlr_output);
+  if (best != NULL)
+    wlr_output_set_mode (self->wlr_output, best);
+
+  g_debug ("Restoring stored configuration of %s", self->wlr_output->name);
+  wlr_output_enable (self->wlr_output, true);
+  wlr_output_set_scale (self->wlr_output, mc->scale);
+  wlr_output_set_transform (self->wlr_output, mc->transform);
+  wlr_output_layout_add (self->desktop->layout, self->wlr_output, mc->x, mc->y);
+}
+
 static void
 phoc_output_constructed (GObject *object)
 {
@@ -296,6 +680,8 @@ phoc_output_constructed (GObject *object)
   wl_signal_add (&self->wlr_output->events.mode, &self->mode);
   self->transform.notify = phoc_output_handle_transform;
   wl_signal_add (&self->wlr_output->events.transform, &self->transform);
+  self->present.notify = phoc_output_handle_present;
+  wl_signal_add (&self->wlr_output->events.present, &self->present);
 
   self->damage_frame.notify = phoc_output_damage_handle_frame;
   wl_signal_add (&self->damage->events.frame, &self->damage_frame);
@@ -313,6 +699,17 @@ phoc_output_constructed (GObject *object)
 
   struct wlr_output_mode *preferred_mode =
     wlr_output_preferred_mode (self->wlr_output);
+  PhocMonitorConfig monitor_config;
+
+  self->edge_zone = PHOC_SHELL_REVEAL_TOUCH_THRESHOLD;
+  if (output_config && output_config->edge_zone >= 0)
+    self->edge_zone = output_config->edge_zone;
+  if (output_config) {
+    self->idle_refresh_timeout = output_config->idle_refresh_timeout;
+    self->render_scale = output_config->render_scale;
+    self->thermal_render_scale = output_config->thermal_render_scale;
+    self->adaptive_sync_mode = output_config->adaptive_sync;
+  }
 
   if (output_config) {
     if (output_config->enable) {
@@ -338,6 +735,9 @@ phoc_output_constructed (GObject *object)
     } else {
       wlr_output_enable (self->wlr_output, false);
     }
+  } else if (phoc_monitor_store_lookup (phoc_monitor_store_get_default (),
+                                        self->wlr_output, &monitor_config)) {
+    phoc_output_apply_monitor_config (self, &monitor_config);
   } else {
     if (preferred_mode != NULL) {
       wlr_output_set_mode (self->wlr_output, preferred_mode);
@@ -347,6 +747,13 @@ phoc_output_constructed (GObject *object)
   }
   wlr_output_commit (self->wlr_output);
 
+  /* Probe once so we don't fail frame commits later on */
+  wlr_output_enable_adaptive_sync (self->wlr_output, true);
+  self->adaptive_sync_supported = wlr_output_test (self->wlr_output);
+  wlr_output_rollback (self->wlr_output);
+  g_debug ("Output '%s' %s adaptive sync", self->wlr_output->name,
+           self->adaptive_sync_supported ? "supports" : "doesn't support");
+
   PhocSeat *seat;
   wl_list_for_each (seat, &input->seats, link) {
     phoc_seat_configure_cursor (seat);
@@ -358,6 +765,11 @@ phoc_output_constructed (GObject *object)
 
   update_output_manager_config (self->desktop);
 
+  if (self->idle_refresh_timeout) {
+    self->last_activity = g_get_monotonic_time ();
+    schedule_idle_refresh (self, self->idle_refresh_timeout);
+  }
+
   G_OBJECT_CLASS (phoc_output_parent_class)->constructed (object);
 
 }
@@ -372,10 +784,22 @@ phoc_output_finalize (GObject *object)
   wl_list_remove (&self->enable.link);
   wl_list_remove (&self->mode.link);
   wl_list_remove (&self->transform.link);
+  wl_list_remove (&self->present.link);
   wl_list_remove (&self->damage_frame.link);
   wl_list_remove (&self->damage_destroy.link);
   g_list_free_full (self->debug_touch_points, g_free);
 
+  if (self->idle_refresh_id)
+    g_source_remove (self->idle_refresh_id);
+  if (self->restore_refresh_id)
+    g_source_remove (self->restore_refresh_id);
+  if (self->render_idle_id)
+    g_source_remove (self->render_idle_id);
+  if (self->content_policy_id)
+    g_source_remove (self->content_policy_id);
+
+  phoc_renderer_release_output_buffer (phoc_server_get_default ()->renderer, self);
+
   size_t len = sizeof (self->layers) / sizeof (self->layers[0]);
   for (size_t i = 0; i < len; ++i) {
     wl_list_remove (&self->layers[i]);
@@ -410,6 +834,32 @@ phoc_output_class_init (PhocOutputClass *klass)
       "wlr-output",
       "The wlroots output object",
       G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | G_PARAM_EXPLICIT_NOTIFY);
+  /**
+   * PhocOutput:low-refresh:
+   *
+   * Whether the output was switched to a lower refresh rate since
+   * nothing happened on it for the configured idle timeout.
+   */
+  props[PROP_LOW_REFRESH] =
+    g_param_spec_boolean (
+      "low-refresh",
+      "Low refresh",
+      "Whether the output runs at a reduced refresh rate",
+      FALSE,
+      G_PARAM_READABLE | G_PARAM_STATIC_STRINGS | G_PARAM_EXPLICIT_NOTIFY);
+  /**
+   * PhocOutput:render-scale:
+   *
+   * The scale the scene is rendered at before it's upscaled to the
+   * output's resolution. Values below 1.0 trade sharpness for fill rate.
+   */
+  props[PROP_RENDER_SCALE] =
+    g_param_spec_float (
+      "render-scale",
+      "Render scale",
+      "The scale the scene is rendered at",
+      PHOC_OUTPUT_MIN_RENDER_SCALE, 1.0, 1.0,
+      G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | G_PARAM_EXPLICIT_NOTIFY);
   g_object_class_install_properties (object_class, PROP_LAST_PROP, props);
 
   signals[OUTPUT_DESTROY] = g_signal_new ("output-destroyed",
@@ -759,6 +1209,12 @@ damage_surface_iterator (PhocOutput *self, struct wlr_surface *surface, struct
       wlr_region_expand (&damage, &damage,
                          ceil (self->wlr_output->scale) - surface->current.scale);
     }
+#ifdef PHOC_HAVE_WLR_VIEWPORTER
+    else if (surface->current.viewport.has_src || surface->current.viewport.has_dst) {
+      // Viewport scaling filters across buffer pixels too
+      wlr_region_expand (&damage, &damage, ceil (self->wlr_output->scale));
+    }
+#endif
     pixman_region32_translate (&damage, box.x, box.y);
     wlr_region_rotated_bounds (&damage, &damage, rotation,
                                center_x, center_y);
@@ -846,58 +1302,223 @@ phoc_output_damage_from_local_surface (PhocOutput *self, struct wlr_surface
                                         damage_surface_iterator, &whole);
 }
 
-void
-handle_output_manager_apply (struct wl_listener *listener, void *data)
+typedef struct {
+  struct wlr_output         *output;
+  bool                       enabled;
+  struct wlr_output_mode    *mode;
+  int32_t                    width, height, refresh;
+  enum wl_output_transform   transform;
+  float                      scale;
+} PhocOutputSavedState;
+
+
+static void
+save_output_state (PhocOutputSavedState *saved, struct wlr_output *wlr_output)
 {
-  PhocDesktop *desktop =
-    wl_container_of (listener, desktop, output_manager_apply);
-  struct wlr_output_configuration_v1 *config = data;
+  saved->output = wlr_output;
+  saved->enabled = wlr_output->enabled;
+  saved->mode = wlr_output->current_mode;
+  saved->width = wlr_output->width;
+  saved->height = wlr_output->height;
+  saved->refresh = wlr_output->refresh;
+  saved->transform = wlr_output->transform;
+  saved->scale = wlr_output->scale;
+}
+
+
+static bool
+restore_output_state (PhocOutputSavedState *saved)
+{
+  struct wlr_output *wlr_output = saved->output;
+
+  wlr_output_enable (wlr_output, saved->enabled);
+  if (saved->enabled) {
+    if (saved->mode != NULL)
+      wlr_output_set_mode (wlr_output, saved->mode);
+    else
+      wlr_output_set_custom_mode (wlr_output, saved->width, saved->height, saved->refresh);
+    wlr_output_set_transform (wlr_output, saved->transform);
+    wlr_output_set_scale (wlr_output, saved->scale);
+  }
+  return wlr_output_commit (wlr_output);
+}
+
+/*
+ * Stage the head's state as pending state on its output. Returns
+ * %FALSE if the output doesn't need any change.
+ */
+static bool
+stage_head_state (struct wlr_output_configuration_head_v1 *config_head)
+{
+  struct wlr_output *wlr_output = config_head->state.output;
+
+  if (!config_head->state.enabled) {
+    if (!wlr_output->enabled)
+      return false;
+
+    wlr_output_enable (wlr_output, false);
+    return true;
+  }
+
+  wlr_output_enable (wlr_output, true);
+  if (config_head->state.mode != NULL) {
+    wlr_output_set_mode (wlr_output, config_head->state.mode);
+  } else {
+    wlr_output_set_custom_mode (wlr_output,
+                                config_head->state.custom_mode.width,
+                                config_head->state.custom_mode.height,
+                                config_head->state.custom_mode.refresh);
+  }
+  wlr_output_set_transform (wlr_output, config_head->state.transform);
+  wlr_output_set_scale (wlr_output, config_head->state.scale);
+#ifdef PHOC_HAVE_WLR_OUTPUT_HEAD_ADAPTIVE_SYNC
+  wlr_output_enable_adaptive_sync (wlr_output, config_head->state.adaptive_sync_enabled);
+#endif
+  return true;
+}
 
+/*
+ * Stage all heads and only then check them with the backend so each
+ * test sees the complete configuration pending on the other outputs.
+ * Leaves the staged state pending on success and rolls everything
+ * back on failure.
+ */
+static bool
+stage_and_test_config (struct wlr_output_configuration_v1 *config)
+{
+  struct wlr_output_configuration_head_v1 *config_head;
+  g_autofree bool *staged = g_new0 (bool, wl_list_length (&config->heads));
   bool ok = true;
+  guint i = 0;
+
+  wl_list_for_each (config_head, &config->heads, link)
+    staged[i++] = stage_head_state (config_head);
+
+  i = 0;
+  wl_list_for_each (config_head, &config->heads, link) {
+    struct wlr_output *wlr_output = config_head->state.output;
+
+    if (!staged[i++])
+      continue;
+
+    if (!wlr_output_test (wlr_output)) {
+      g_debug ("Output configuration for '%s' failed test", wlr_output->name);
+      ok = false;
+      break;
+    }
+  }
+
+  if (!ok) {
+    wl_list_for_each (config_head, &config->heads, link)
+      wlr_output_rollback (config_head->state.output);
+  }
+
+  return ok;
+}
+
+
+static bool
+commit_heads (struct wlr_output_configuration_v1 *config,
+              PhocOutputSavedState               *saved,
+              guint                              *n_committed,
+              bool                                enabled)
+{
   struct wlr_output_configuration_head_v1 *config_head;
 
-  // First disable outputs we need to disable
   wl_list_for_each (config_head, &config->heads, link) {
     struct wlr_output *wlr_output = config_head->state.output;
 
-    if (config_head->state.enabled)
+    if (config_head->state.enabled != enabled)
       continue;
 
-    if (!wlr_output->enabled)
+    /* Nothing staged (e.g. disabling an already disabled output) */
+    if (!config_head->state.enabled && !wlr_output->enabled)
       continue;
 
-    wlr_output_enable (wlr_output, false);
-    wlr_output_layout_remove (desktop->layout, wlr_output);
-    ok &= wlr_output_commit (wlr_output);
+    save_output_state (&saved[*n_committed], wlr_output);
+    if (!wlr_output_commit (wlr_output)) {
+      g_warning ("Failed to commit output configuration for '%s'", wlr_output->name);
+      return false;
+    }
+    (*n_committed)++;
+  }
+
+  return true;
+}
+
+
+void
+handle_output_manager_apply (struct wl_listener *listener, void *data)
+{
+  PhocDesktop *desktop =
+    wl_container_of (listener, desktop, output_manager_apply);
+  struct wlr_output_configuration_v1 *config = data;
+  struct wlr_output_configuration_head_v1 *config_head;
+  g_autofree PhocOutputSavedState *saved = NULL;
+  guint n_committed = 0;
+  bool ok;
+
+  ok = stage_and_test_config (config);
+  if (!ok)
+    goto out;
+
+  saved = g_new0 (PhocOutputSavedState, wl_list_length (&config->heads));
+  /* Disable outputs first so enabled outputs can pick up freed resources */
+  ok = commit_heads (config, saved, &n_committed, false);
+  if (ok)
+    ok = commit_heads (config, saved, &n_committed, true);
+
+  if (!ok) {
+    /* Drop what's still pending and undo what already got committed */
+    wl_list_for_each (config_head, &config->heads, link)
+      wlr_output_rollback (config_head->state.output);
+
+    for (int i = n_committed - 1; i >= 0; i--) {
+      if (!restore_output_state (&saved[i]))
+        g_warning ("Failed to restore output configuration for '%s'", saved[i].output->name);
+    }
+    goto out;
   }
 
-  // Then enable outputs that need to
   wl_list_for_each (config_head, &config->heads, link) {
     struct wlr_output *wlr_output = config_head->state.output;
     PhocOutput *output = wlr_output->data;
 
-    if (!config_head->state.enabled)
+    phoc_monitor_store_update (phoc_monitor_store_get_default (), wlr_output,
+                               config_head->state.x, config_head->state.y);
+
+    if (!config_head->state.enabled) {
+      wlr_output_layout_remove (desktop->layout, wlr_output);
       continue;
+    }
 
-    wlr_output_enable (wlr_output, true);
-    if (config_head->state.mode != NULL) {
-      wlr_output_set_mode (wlr_output, config_head->state.mode);
-    } else {
-      wlr_output_set_custom_mode (wlr_output,
-                                  config_head->state.custom_mode.width,
-                                  config_head->state.custom_mode.height,
-                                  config_head->state.custom_mode.refresh);
+    /* Mirrors show their source's frames and stay out of the layout */
+    if (output->mirror_source == NULL)
+      wlr_output_layout_add (desktop->layout, wlr_output,
+                             config_head->state.x, config_head->state.y);
+#ifdef PHOC_HAVE_WLR_OUTPUT_HEAD_ADAPTIVE_SYNC
+    /* Explicit requests override the configured policy */
+    if (config_head->state.adaptive_sync_enabled !=
+        (wlr_output->adaptive_sync_status == WLR_OUTPUT_ADAPTIVE_SYNC_ENABLED)) {
+      output->adaptive_sync_mode = config_head->state.adaptive_sync_enabled ?
+        ROOTS_ADAPTIVE_SYNC_ENABLED : ROOTS_ADAPTIVE_SYNC_DISABLED;
     }
-    wlr_output_layout_add (desktop->layout, wlr_output,
-                           config_head->state.x, config_head->state.y);
-    wlr_output_set_transform (wlr_output, config_head->state.transform);
-    wlr_output_set_scale (wlr_output, config_head->state.scale);
-    ok &= wlr_output_commit (wlr_output);
+#endif
     if (output->fullscreen_view) {
       view_set_fullscreen (output->fullscreen_view, true, wlr_output);
     }
   }
 
+  phoc_monitor_store_save (phoc_monitor_store_get_default ());
+
+  /* Scales might have changed */
+  {
+    struct roots_view *view;
+    wl_list_for_each (view, &desktop->views, link)
+      view_update_scale (view);
+  }
+
+ out:
   if (ok) {
     wlr_output_configuration_v1_send_succeeded (config);
   } else {
@@ -911,12 +1532,16 @@ handle_output_manager_apply (struct wl_listener *listener, void *data)
 void
 handle_output_manager_test (struct wl_listener *listener, void *data)
 {
-  PhocDesktop *desktop =
-    wl_container_of (listener, desktop, output_manager_test);
   struct wlr_output_configuration_v1 *config = data;
+  struct wlr_output_configuration_head_v1 *config_head;
 
-  // TODO: implement test-only mode
-  wlr_output_configuration_v1_send_succeeded (config);
+  if (stage_and_test_config (config)) {
+    wl_list_for_each (config_head, &config->heads, link)
+      wlr_output_rollback (config_head->state.output);
+    wlr_output_configuration_v1_send_succeeded (config);
+  } else {
+    wlr_output_configuration_v1_send_failed (config);
+  }
   wlr_output_configuration_v1_destroy (config);
 }
 
@@ -981,3 +1606,289 @@ phoc_output_is_builtin (PhocOutput *output)
 
   return FALSE;
 }
+
+/**
+ * phoc_output_notify_activity:
+ * @self: The output
+ * @from_damage: Whether the activity is the output being damaged
+ *
+ * Notify the output about input or damage. This restarts the idle
+ * timeout and switches back to the full refresh rate if the output
+ * was switched to a low refresh rate.
+ */
+void
+phoc_output_notify_activity (PhocOutput *self, gboolean from_damage)
+{
+  gint64 now;
+
+  g_return_if_fail (PHOC_IS_OUTPUT (self));
+
+  if (self->idle_refresh_timeout == 0)
+    return;
+
+  now = g_get_monotonic_time ();
+  self->last_activity = now;
+
+  if (self->low_refresh_mode == NULL || self->restore_refresh_id)
+    return;
+
+  if (from_damage && now - self->low_refresh_since < PHOC_LOW_REFRESH_GRACE_USEC)
+    return;
+
+  /* Don't modeset from within input or render handlers */
+  self->restore_refresh_id = g_idle_add_full (G_PRIORITY_HIGH, on_restore_refresh, self, NULL);
+  g_source_set_name_by_id (self->restore_refresh_id, "[phoc] restore refresh");
+}
+
+/**
+ * phoc_output_get_low_refresh:
+ * @self: The output
+ *
+ * Returns: %TRUE if the output got switched to a low refresh rate due
+ * to inactivity.
+ */
+gboolean
+phoc_output_get_low_refresh (PhocOutput *self)
+{
+  g_return_val_if_fail (PHOC_IS_OUTPUT (self), FALSE);
+
+  return self->low_refresh_mode != NULL;
+}
+
+/**
+ * phoc_output_set_render_scale:
+ * @self: The output
+ * @scale: The render scale
+ *
+ * Set the scale the scene is rendered at. With a scale below 1.0 the
+ * scene is rendered at a reduced resolution and upscaled in a final
+ * pass.
+ */
+void
+phoc_output_set_render_scale (PhocOutput *self, float scale)
+{
+  g_return_if_fail (PHOC_IS_OUTPUT (self));
+
+  scale = CLAMP (scale, PHOC_OUTPUT_MIN_RENDER_SCALE, 1.0);
+  if (self->render_scale == scale)
+    return;
+
+  self->render_scale = scale;
+  phoc_output_damage_whole (self);
+  g_object_notify_by_pspec (G_OBJECT (self), props[PROP_RENDER_SCALE]);
+}
+
+/**
+ * phoc_output_get_render_scale:
+ * @self: The output
+ *
+ * Get the scale the scene is currently rendered at. This takes thermal
+ * pressure into account.
+ *
+ * Returns: The effective render scale
+ */
+float
+phoc_output_get_render_scale (PhocOutput *self)
+{
+  g_return_val_if_fail (PHOC_IS_OUTPUT (self), 1.0);
+
+  if (self->thermal_pressure)
+    return MIN (self->render_scale, self->thermal_render_scale);
+
+  return self->render_scale;
+}
+
+/**
+ * phoc_output_set_thermal_pressure:
+ * @self: The output
+ * @pressure: Whether the device is under thermal pressure
+ *
+ * Under thermal pressure the output is rendered with at most its
+ * thermal render scale.
+ */
+void
+phoc_output_set_thermal_pressure (PhocOutput *self, gboolean pressure)
+{
+  float old_scale;
+
+  g_return_if_fail (PHOC_IS_OUTPUT (self));
+
+  if (self->thermal_pressure == !!pressure)
+    return;
+
+  old_scale = phoc_output_get_render_scale (self);
+  self->thermal_pressure = !!pressure;
+  if (old_scale != phoc_output_get_render_scale (self))
+    phoc_output_damage_whole (self);
+}
+
+/**
+ * phoc_output_set_mirror_source:
+ * @self: The output
+ * @source: (nullable): The output to mirror or %NULL to stop mirroring
+ *
+ * Mirror @source's content onto this output. The mirror is taken out of
+ * the layout and shows @source's composited frames scaled to fit.
+ * Only one output can mirror a given source.
+ */
+void
+phoc_output_set_mirror_source (PhocOutput *self, PhocOutput *source)
+{
+  g_return_if_fail (PHOC_IS_OUTPUT (self));
+  g_return_if_fail (source == NULL || PHOC_IS_OUTPUT (source));
+  g_return_if_fail (source != self);
+
+  if (self->mirror_source == source)
+    return;
+
+  if (source && source->mirrored_by) {
+    g_warning ("%s is already mirrored by %s", source->wlr_output->name,
+               source->mirrored_by->wlr_output->name);
+    return;
+  }
+
+  if (self->mirror_source) {
+    g_debug ("%s stops mirroring %s", self->wlr_output->name,
+             self->mirror_source->wlr_output->name);
+    self->mirror_source->mirrored_by = NULL;
+    /* Give the former source a chance to drop its offscreen buffer */
+    phoc_output_damage_whole (self->mirror_source);
+    self->mirror_source = NULL;
+
+    if (self->wlr_output->enabled)
+      wlr_output_layout_add_auto (self->desktop->layout, self->wlr_output);
+  }
+
+  if (source) {
+    g_debug ("%s mirrors %s", self->wlr_output->name, source->wlr_output->name);
+    wlr_output_layout_remove (self->desktop->layout, self->wlr_output);
+    self->mirror_source = source;
+    source->mirrored_by = self;
+    phoc_output_damage_whole (source);
+  }
+
+  phoc_output_damage_whole (self);
+}
+
+static gboolean
+phoc_output_wants_adaptive_sync (PhocOutput *self)
+{
+  switch (self->adaptive_sync_mode) {
+  case ROOTS_ADAPTIVE_SYNC_ENABLED:
+    return TRUE;
+  case ROOTS_ADAPTIVE_SYNC_FULLSCREEN:
+    /* Let a fullscreen client's commits drive the refresh */
+    return self->fullscreen_view != NULL;
+  case ROOTS_ADAPTIVE_SYNC_GAME:
+    return self->fullscreen_view != NULL &&
+      self->fullscreen_view->content_type == PHOC_CONTENT_TYPE_GAME;
+  case ROOTS_ADAPTIVE_SYNC_DISABLED:
+  default:
+    return FALSE;
+  }
+}
+
+/**
+ * phoc_output_stage_adaptive_sync:
+ * @self: The output
+ *
+ * Stage enabling or disabling adaptive sync according to the output's
+ * policy. Must be called right before committing a frame so the change
+ * goes out with it. The commit's result needs to be reported via
+ * phoc_output_adaptive_sync_committed().
+ */
+void
+phoc_output_stage_adaptive_sync (PhocOutput *self)
+{
+  gboolean enabled, wanted;
+
+  g_return_if_fail (PHOC_IS_OUTPUT (self));
+
+  self->adaptive_sync_staged = FALSE;
+  if (!self->adaptive_sync_supported)
+    return;
+
+  enabled = self->wlr_output->adaptive_sync_status == WLR_OUTPUT_ADAPTIVE_SYNC_ENABLED;
+  wanted = phoc_output_wants_adaptive_sync (self);
+  if (enabled == wanted)
+    return;
+
+  wlr_output_enable_adaptive_sync (self->wlr_output, wanted);
+  self->adaptive_sync_staged = TRUE;
+}
+
+/**
+ * phoc_output_adaptive_sync_committed:
+ * @self: The output
+ * @committed: Whether the frame commit succeeded
+ *
+ * Report the result of a commit that might have included a staged
+ * adaptive sync change. If the change made the commit fail adaptive
+ * sync won't be touched on this output again.
+ */
+void
+phoc_output_adaptive_sync_committed (PhocOutput *self, gboolean committed)
+{
+  g_return_if_fail (PHOC_IS_OUTPUT (self));
+
+  if (!self->adaptive_sync_staged)
+    return;
+
+  self->adaptive_sync_staged = FALSE;
+  if (committed) {
+    g_debug ("Adaptive sync on %s %s", self->wlr_output->name,
+             self->wlr_output->adaptive_sync_status == WLR_OUTPUT_ADAPTIVE_SYNC_ENABLED ?
+             "enabled" : "disabled");
+    return;
+  }
+
+  g_warning ("Failed to change adaptive sync on %s, disabling", self->wlr_output->name);
+  self->adaptive_sync_supported = FALSE;
+}
+
+/**
+ * phoc_output_update_content_policy:
+ * @self: The output
+ *
+ * Reevaluate policies depending on the content type of the output's
+ * fullscreen view, e.g. switch to a refresh rate matching a video's
+ * frame rate. This happens from an idle callback so it's safe to call
+ * from commit handlers.
+ */
+void
+phoc_output_update_content_policy (PhocOutput *self)
+{
+  g_return_if_fail (PHOC_IS_OUTPUT (self));
+
+  if (self->content_policy_id)
+    return;
+
+  self->content_policy_id = g_idle_add_full (G_PRIORITY_HIGH, on_content_policy, self, NULL);
+  g_source_set_name_by_id (self->content_policy_id, "[phoc] content policy");
+}
+
+/**
+ * phoc_output_set_scanout_feedback:
+ * @self: The output
+ * @feedback: (nullable) (transfer full): The feedback of the scanned out buffer
+ * @commit_seq: The output commit sequence number the buffer is committed with
+ *
+ * Track the presentation feedback of a buffer that gets committed for
+ * direct scanout. Set it before committing as backends might present
+ * from within the commit. It's sent with the zero copy flag once the
+ * commit with @commit_seq is presented. A pending feedback that didn't
+ * get presented is discarded.
+ */
+void
+phoc_output_set_scanout_feedback (PhocOutput                       *self,
+                                  struct wlr_presentation_feedback *feedback,
+                                  guint32                           commit_seq)
+{
+  g_assert (PHOC_IS_OUTPUT (self));
+
+  if (self->scanout_feedback)
+    wlr_presentation_feedback_destroy (self->scanout_feedback);
+
+  self->scanout_feedback = feedback;
+  self->scanout_feedback_seq = commit_seq;
+}
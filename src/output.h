@@ -8,9 +8,12 @@
 #include <wayland-server-core.h>
 #include <wlr/types/wlr_box.h>
 #include <wlr/types/wlr_output_damage.h>
+#include "settings.h"
 
 #define PHOC_TYPE_OUTPUT (phoc_output_get_type ())
 
+#define PHOC_OUTPUT_MIN_RENDER_SCALE ROOTS_CONFIG_MIN_RENDER_SCALE
+
 G_DECLARE_FINAL_TYPE (PhocOutput, phoc_output, PHOC, OUTPUT, GObject);
 
 /* These need to know about PhocOutput so we have them after the type definition.
@@ -30,8 +33,46 @@ struct _PhocOutput {
   struct roots_view        *fullscreen_view;
   struct wl_list            layers[4]; // layer_surface::link
   bool                      force_shell_reveal;
+  int                       edge_zone;
+
+  /* Idle low refresh rate policy */
+  guint                     idle_refresh_timeout;
+  guint                     idle_refresh_id;
+  guint                     restore_refresh_id;
+  gint64                    last_activity;
+  gint64                    low_refresh_since;
+  struct wlr_output_mode   *full_refresh_mode;
+  struct wlr_output_mode   *low_refresh_mode;
+
+  /* Scene rendering at reduced resolution */
+  float                     render_scale;
+  float                     thermal_render_scale;
+  gboolean                  thermal_pressure;
+  bool                      render_scale_active;
+  guint                     render_fbo;
+  guint                     render_tex;
+  int                       render_width, render_height;
+
+  /* Adaptive sync policy */
+  enum roots_adaptive_sync_mode adaptive_sync_mode;
+  gboolean                  adaptive_sync_supported;
+  gboolean                  adaptive_sync_staged;
+
+  /* Mirroring */
+  PhocOutput               *mirror_source;
+  PhocOutput               *mirrored_by;
+
+  /* Refresh rate matching fullscreen video content */
+  guint                     content_policy_id;
+  struct wlr_output_mode   *video_refresh_mode;
+  struct wlr_output_mode   *pre_video_mode;
+
+  /* Presentation feedback of a directly scanned out buffer */
+  struct wlr_presentation_feedback *scanout_feedback;
+  guint32                   scanout_feedback_seq;
 
   struct timespec           last_frame;
+  guint                     render_idle_id;
   struct wlr_output_damage *damage;
   GList                    *debug_touch_points;
 
@@ -40,6 +81,7 @@ struct _PhocOutput {
   struct wl_listener        enable;
   struct wl_listener        mode;
   struct wl_listener        transform;
+  struct wl_listener        present;
   struct wl_listener        damage_frame;
   struct wl_listener        damage_destroy;
   struct wl_listener        output_destroy;
@@ -105,5 +147,17 @@ void        phoc_output_scale_box (PhocOutput *self, struct wlr_box *box, float
 void        phoc_output_get_decoration_box (PhocOutput *self, struct roots_view *view,
                                             struct wlr_box *box);
 gboolean    phoc_output_is_builtin (PhocOutput *output);
+void        phoc_output_notify_activity (PhocOutput *self, gboolean from_damage);
+gboolean    phoc_output_get_low_refresh (PhocOutput *self);
+void        phoc_output_set_render_scale (PhocOutput *self, float scale);
+float       phoc_output_get_render_scale (PhocOutput *self);
+void        phoc_output_set_thermal_pressure (PhocOutput *self, gboolean pressure);
+void        phoc_output_set_mirror_source (PhocOutput *self, PhocOutput *source);
+void        phoc_output_stage_adaptive_sync (PhocOutput *self);
+void        phoc_output_adaptive_sync_committed (PhocOutput *self, gboolean committed);
+void        phoc_output_update_content_policy (PhocOutput *self);
+void        phoc_output_set_scanout_feedback (PhocOutput                       *self,
+                                              struct wlr_presentation_feedback *feedback,
+                                              guint32                           commit_seq);
 
 #endif
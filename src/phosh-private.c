@@ -14,8 +14,11 @@
 #include <assert.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <drm_fourcc.h>
 #include <wayland-server-core.h>
 #include <wlr/config.h>
+#include <wlr/render/drm_format_set.h>
+#include <wlr/types/wlr_linux_dmabuf_v1.h>
 #include <wlr/types/wlr_surface.h>
 #include <wlr/util/log.h>
 #include <wlr/render/wlr_texture.h>
@@ -25,6 +28,7 @@
 #include "server.h"
 #include "desktop.h"
 #include "render.h"
+#include "trace.h"
 #include "utils.h"
 
 /* help older (0.8.2) libxkbcommon */
@@ -75,6 +79,7 @@ typedef struct {
   uint32_t stride;
 
   struct wl_shm_buffer *buffer;
+  struct wlr_dmabuf_v1_buffer *dmabuf;
   struct roots_view *view;
 } PhocPhoshPrivateScreencopyFrame;
 
@@ -88,7 +93,8 @@ static PhocPhoshPrivateKeyboardEventData *phoc_phosh_private_keyboard_event_from
 static PhocPhoshPrivateScreencopyFrame *phoc_phosh_private_screencopy_frame_from_resource(struct wl_resource *resource);
 static PhocPhoshPrivateStartupTracker *phoc_phosh_private_startup_tracker_from_resource(struct wl_resource *resource);
 
-#define PHOSH_PRIVATE_VERSION 6
+#define PHOSH_PRIVATE_VERSION 7
+#define PHOSH_PRIVATE_THUMBNAIL_DMABUF_SINCE_VERSION 7
 
 
 static void
@@ -390,15 +396,79 @@ thumbnail_view_handle_destroy (struct wl_listener *listener, void *data)
 }
 
 
+static uint32_t
+thumbnail_drm_format (enum wl_shm_format format)
+{
+  switch (format) {
+  case WL_SHM_FORMAT_ARGB8888:
+    return DRM_FORMAT_ARGB8888;
+  case WL_SHM_FORMAT_XRGB8888:
+    return DRM_FORMAT_XRGB8888;
+  default:
+    /* All other shm formats use the fourcc code */
+    return format;
+  }
+}
+
+
+static void
+thumbnail_frame_send_ready (PhocPhoshPrivateScreencopyFrame *frame,
+                            enum zwlr_screencopy_frame_v1_flags flags)
+{
+  struct timespec now;
+
+  zwlr_screencopy_frame_v1_send_flags (frame->resource, flags);
+
+  clock_gettime (CLOCK_MONOTONIC, &now);
+  uint32_t tv_sec_hi = (sizeof(now.tv_sec) > 4) ? now.tv_sec >> 32 : 0;
+  uint32_t tv_sec_lo = now.tv_sec & 0xFFFFFFFF;
+  zwlr_screencopy_frame_v1_send_ready (frame->resource, tv_sec_hi, tv_sec_lo, now.tv_nsec);
+}
+
+
+static void
+thumbnail_frame_copy_dmabuf (PhocPhoshPrivateScreencopyFrame *frame,
+                             struct wl_resource              *buffer_resource)
+{
+  PHOC_TRACE_SCOPE ("phosh-private: thumbnail_frame_copy_dmabuf");
+  struct wlr_dmabuf_attributes *attribs;
+  struct roots_view *view;
+
+  frame->dmabuf = wlr_dmabuf_v1_buffer_from_buffer_resource (buffer_resource);
+  attribs = &frame->dmabuf->attributes;
+
+  if (attribs->format != thumbnail_drm_format (frame->format) ||
+      attribs->width != frame->width || attribs->height != frame->height) {
+    wl_resource_post_error (frame->resource,
+                            ZWLR_SCREENCOPY_FRAME_V1_ERROR_INVALID_BUFFER,
+                            "invalid buffer attributes");
+    return;
+  }
+
+  view = frame->view;
+  wl_list_remove (&frame->view_destroy.link);
+  frame->view = NULL;
+
+  if (!view_render_to_dmabuf (view, attribs)) {
+    zwlr_screencopy_frame_v1_send_failed (frame->resource);
+    return;
+  }
+
+  /* Rendered via GL like the shm path, hence same orientation */
+  thumbnail_frame_send_ready (frame, ZWLR_SCREENCOPY_FRAME_V1_FLAGS_Y_INVERT);
+}
+
+
 static void
 thumbnail_frame_handle_copy (struct wl_client   *wl_client,
                              struct wl_resource *frame_resource,
                              struct wl_resource *buffer_resource)
 {
+  PHOC_TRACE_SCOPE ("phosh-private: thumbnail_frame_handle_copy");
   PhocPhoshPrivateScreencopyFrame *frame = phoc_phosh_private_screencopy_frame_from_resource (frame_resource);
   g_return_if_fail (frame);
 
-  if (frame->buffer != NULL) {
+  if (frame->buffer != NULL || frame->dmabuf != NULL) {
     wl_resource_post_error (frame->resource,
                            ZWLR_SCREENCOPY_FRAME_V1_ERROR_ALREADY_USED,
                            "frame already used");
@@ -410,6 +480,11 @@ thumbnail_frame_handle_copy (struct wl_client   *wl_client,
     return;
   }
 
+  if (wlr_dmabuf_v1_resource_is_buffer (buffer_resource)) {
+    thumbnail_frame_copy_dmabuf (frame, buffer_resource);
+    return;
+  }
+
   frame->buffer = wl_shm_buffer_get (buffer_resource);
 
   if (frame->buffer == NULL) {
@@ -447,13 +522,7 @@ thumbnail_frame_handle_copy (struct wl_client   *wl_client,
   enum zwlr_screencopy_frame_v1_flags flags = (renderer_flags & WLR_RENDERER_READ_PIXELS_Y_INVERT) ? ZWLR_SCREENCOPY_FRAME_V1_FLAGS_Y_INVERT : 0;
   wl_shm_buffer_end_access (frame->buffer);
 
-  zwlr_screencopy_frame_v1_send_flags (frame->resource, flags);
-
-  struct timespec now;
-  clock_gettime (CLOCK_MONOTONIC, &now);
-  uint32_t tv_sec_hi = (sizeof(now.tv_sec) > 4) ? now.tv_sec >> 32 : 0;
-  uint32_t tv_sec_lo = now.tv_sec & 0xFFFFFFFF;
-  zwlr_screencopy_frame_v1_send_ready (frame->resource, tv_sec_hi, tv_sec_lo, now.tv_nsec);
+  thumbnail_frame_send_ready (frame, flags);
 }
 
 static void
@@ -488,6 +557,7 @@ handle_get_thumbnail (struct wl_client *client,
 		      uint32_t max_width,
 		      uint32_t max_height)
 {
+  PHOC_TRACE_SCOPE ("phosh-private: handle_get_thumbnail");
   PhocServer *server = phoc_server_get_default (); // FIXME: find a better way to get the preferred pixel_format
   PhocPhoshPrivateScreencopyFrame *frame = g_new0 (PhocPhoshPrivateScreencopyFrame, 1);
 
@@ -557,6 +627,18 @@ handle_get_thumbnail (struct wl_client *client,
 
   zwlr_screencopy_frame_v1_send_buffer (frame->resource, frame->format,
                                         frame->width, frame->height, frame->stride);
+
+  if (version >= PHOSH_PRIVATE_THUMBNAIL_DMABUF_SINCE_VERSION) {
+    struct wlr_renderer *wlr_renderer = wlr_backend_get_renderer (server->backend);
+    const struct wlr_drm_format_set *formats = wlr_renderer_get_dmabuf_formats (wlr_renderer);
+    uint32_t drm_format = thumbnail_drm_format (frame->format);
+
+    if (formats && wlr_drm_format_set_get (formats, drm_format)) {
+      zwlr_screencopy_frame_v1_send_linux_dmabuf (frame->resource, drm_format,
+                                                  frame->width, frame->height);
+    }
+    zwlr_screencopy_frame_v1_send_buffer_done (frame->resource);
+  }
 }
 
 
@@ -14,14 +14,18 @@
 #include "layers.h"
 #include "server.h"
 #include "render.h"
+#include "trace.h"
 
 #define _POSIX_C_SOURCE 200809L
 #include <assert.h>
+#include <math.h>
 #include <stdbool.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 #include <wlr/backend.h>
 #include <wlr/config.h>
+#include <wlr/render/egl.h>
 #include <wlr/render/wlr_renderer.h>
 #include <wlr/render/gles2.h>
 #include <wlr/types/wlr_compositor.h>
@@ -68,9 +72,31 @@ struct _PhocRenderer {
   GObject               parent;
 
   struct wlr_renderer  *wlr_renderer;
+
+  /* Upscaling of outputs rendered at a reduced render scale */
+  GLuint                blit_program;
+  GLint                 blit_pos_attrib;
+  GLint                 blit_proj_uniform;
+  GLint                 blit_tex_uniform;
+
+  /* wlr_surface → PhocSolidSurface */
+  GHashTable           *solid_surfaces;
+
+  /* Rendering into client provided dmabufs */
+  PFNGLEGLIMAGETARGETRENDERBUFFERSTORAGEOESPROC egl_image_target_renderbuffer_storage;
 };
 G_DEFINE_TYPE (PhocRenderer, phoc_renderer, G_TYPE_OBJECT)
 
+/* Color of a surface backed by a 1x1 buffer, refreshed on commit */
+typedef struct {
+  struct wlr_surface *surface;
+  struct wl_listener  commit;
+  struct wl_listener  destroy;
+  gboolean            dirty;
+  gboolean            solid;
+  float               color[4];
+} PhocSolidSurface;
+
 
 struct render_data {
 	pixman_region32_t *damage;
@@ -142,13 +168,28 @@ static void scissor_output(struct wlr_output *wlr_output,
 		wlr_output_transform_invert(wlr_output->transform);
 	wlr_box_transform(&box, &box, transform, ow, oh);
 
+	PhocOutput *output = wlr_output->data;
+	if (output->render_scale_active) {
+		// Rendering into the reduced size buffer, the renderer's
+		// viewport is still the output's so scissor ourselves
+		float scale = (float)output->render_width / wlr_output->width;
+		int x1 = floorf(box.x * scale);
+		int y1 = floorf(box.y * scale);
+		int x2 = ceilf((box.x + box.width) * scale);
+		int y2 = ceilf((box.y + box.height) * scale);
+
+		glEnable(GL_SCISSOR_TEST);
+		glScissor(x1, output->render_height - y2, x2 - x1, y2 - y1);
+		return;
+	}
+
 	wlr_renderer_scissor(renderer, &box);
 }
 
 static void render_texture(struct wlr_output *wlr_output,
 		pixman_region32_t *output_damage, struct wlr_texture *texture,
-		const struct wlr_box *box, const float matrix[static 9],
-		float rotation, float alpha) {
+		const struct wlr_fbox *src_box, const struct wlr_box *box,
+		const float matrix[static 9], float rotation, float alpha) {
 	struct wlr_renderer *renderer =
 		wlr_backend_get_renderer(wlr_output->backend);
 	assert(renderer);
@@ -170,6 +211,13 @@ static void render_texture(struct wlr_output *wlr_output,
 	pixman_box32_t *rects = pixman_region32_rectangles(&damage, &nrects);
 	for (int i = 0; i < nrects; ++i) {
 		scissor_output(wlr_output, &rects[i]);
+#ifdef PHOC_HAVE_WLR_VIEWPORTER
+		if (src_box) {
+			wlr_render_subtexture_with_matrix(renderer, texture, src_box,
+				matrix, alpha);
+			continue;
+		}
+#endif
 		wlr_render_texture_with_matrix(renderer, texture, matrix, alpha);
 	}
 
@@ -177,6 +225,141 @@ buffer_damage_finish:
 	pixman_region32_fini(&damage);
 }
 
+static void render_quad(struct wlr_output *wlr_output,
+		pixman_region32_t *output_damage, const float color[static 4],
+		const struct wlr_box *box, float rotation) {
+	struct wlr_renderer *renderer =
+		wlr_backend_get_renderer(wlr_output->backend);
+	assert(renderer);
+
+	struct wlr_box rotated;
+	wlr_box_rotated_bounds(&rotated, box, rotation);
+
+	pixman_region32_t damage;
+	pixman_region32_init(&damage);
+	pixman_region32_union_rect(&damage, &damage, rotated.x, rotated.y,
+		rotated.width, rotated.height);
+	pixman_region32_intersect(&damage, &damage, output_damage);
+	if (!pixman_region32_not_empty(&damage)) {
+		goto buffer_damage_finish;
+	}
+
+	float matrix[9];
+	wlr_matrix_project_box(matrix, box, WL_OUTPUT_TRANSFORM_NORMAL, rotation,
+		wlr_output->transform_matrix);
+
+	int nrects;
+	pixman_box32_t *rects = pixman_region32_rectangles(&damage, &nrects);
+	for (int i = 0; i < nrects; ++i) {
+		scissor_output(wlr_output, &rects[i]);
+		wlr_render_quad_with_matrix(renderer, color, matrix);
+	}
+
+buffer_damage_finish:
+	pixman_region32_fini(&damage);
+}
+
+static void
+solid_surface_free (PhocSolidSurface *solid)
+{
+  wl_list_remove (&solid->commit.link);
+  wl_list_remove (&solid->destroy.link);
+  g_free (solid);
+}
+
+static void
+solid_surface_handle_commit (struct wl_listener *listener, void *data)
+{
+  PhocSolidSurface *solid = wl_container_of (listener, solid, commit);
+
+  solid->dirty = TRUE;
+}
+
+static void
+solid_surface_handle_destroy (struct wl_listener *listener, void *data)
+{
+  PhocSolidSurface *solid = wl_container_of (listener, solid, destroy);
+  PhocServer *server = phoc_server_get_default ();
+
+  g_hash_table_remove (server->renderer->solid_surfaces, solid->surface);
+}
+
+/* Read back the single texel of a 1x1 texture */
+static gboolean
+read_texel (struct wlr_texture *texture, float color[static 4])
+{
+  struct wlr_gles2_texture_attribs attribs;
+  GLint prev_fbo;
+  GLuint fbo;
+  GLubyte px[4];
+  gboolean ok;
+
+  wlr_gles2_texture_get_attribs (texture, &attribs);
+  /* External (dmabuf) textures can't be attached to a FBO */
+  if (attribs.target != GL_TEXTURE_2D)
+    return FALSE;
+
+  glGetIntegerv (GL_FRAMEBUFFER_BINDING, &prev_fbo);
+  glGenFramebuffers (1, &fbo);
+  glBindFramebuffer (GL_FRAMEBUFFER, fbo);
+  glFramebufferTexture2D (GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                          GL_TEXTURE_2D, attribs.tex, 0);
+  ok = glCheckFramebufferStatus (GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+  if (ok)
+    glReadPixels (0, 0, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE, px);
+  glBindFramebuffer (GL_FRAMEBUFFER, prev_fbo);
+  glDeleteFramebuffers (1, &fbo);
+
+  if (!ok)
+    return FALSE;
+
+  /* Buffers are premultiplied already, as is what render_quad expects */
+  for (int i = 0; i < 4; i++)
+    color[i] = px[i] / 255.0f;
+  if (!attribs.has_alpha)
+    color[3] = 1.0f;
+
+  return TRUE;
+}
+
+/*
+ * If the surface is backed by a single pixel buffer (e.g. a 1x1 shm
+ * buffer used as scrim or background) get its color so it can be
+ * drawn without sampling.
+ */
+static gboolean
+get_solid_color (PhocRenderer *self, struct wlr_surface *surface,
+                 struct wlr_texture *texture, float color[static 4])
+{
+  PhocSolidSurface *solid;
+
+  if (surface->current.buffer_width != 1 || surface->current.buffer_height != 1)
+    return FALSE;
+
+  solid = g_hash_table_lookup (self->solid_surfaces, surface);
+  if (solid == NULL) {
+    solid = g_new0 (PhocSolidSurface, 1);
+    solid->surface = surface;
+    solid->dirty = TRUE;
+    solid->commit.notify = solid_surface_handle_commit;
+    wl_signal_add (&surface->events.commit, &solid->commit);
+    solid->destroy.notify = solid_surface_handle_destroy;
+    wl_signal_add (&surface->events.destroy, &solid->destroy);
+    g_hash_table_insert (self->solid_surfaces, surface, solid);
+  }
+
+  if (solid->dirty) {
+    solid->solid = read_texel (texture, solid->color);
+    solid->dirty = FALSE;
+  }
+
+  if (!solid->solid)
+    return FALSE;
+
+  memcpy (color, solid->color, sizeof (solid->color));
+  return TRUE;
+}
+
 static void
 collect_touch_points (PhocOutput *output, struct wlr_surface *surface, struct wlr_box box, float scale)
 {
@@ -202,6 +385,7 @@ collect_touch_points (PhocOutput *output, struct wlr_surface *surface, struct wl
 static void render_surface_iterator(PhocOutput *output,
 		struct wlr_surface *surface, struct wlr_box *_box, float rotation,
 		float scale, void *_data) {
+	PhocServer *server = phoc_server_get_default ();
 	struct render_data *data = _data;
 	struct wlr_output *wlr_output = output->wlr_output;
 	pixman_region32_t *output_damage = data->damage;
@@ -212,21 +396,44 @@ static void render_surface_iterator(PhocOutput *output,
 		return;
 	}
 
+	/* The box already has the viewport's destination size so only
+	 * the source crop needs handling, scaling happens via the matrix */
+	const struct wlr_fbox *src_box = NULL;
+#ifdef PHOC_HAVE_WLR_VIEWPORTER
+	struct wlr_fbox viewport_src;
+	if (surface->current.viewport.has_src) {
+		wlr_surface_get_buffer_source_box(surface, &viewport_src);
+		src_box = &viewport_src;
+	}
+#endif
+
 	struct wlr_box box = *_box;
 	phoc_output_scale_box(wlr_output->data, &box, scale);
 	phoc_output_scale_box(wlr_output->data, &box, wlr_output->scale);
 
-	float matrix[9];
-	enum wl_output_transform transform =
-		wlr_output_transform_invert(surface->current.transform);
-	wlr_matrix_project_box(matrix, &box, transform, rotation,
-		wlr_output->transform_matrix);
-
-	render_texture(wlr_output, output_damage,
-		texture, &box, matrix, rotation, alpha);
+	float color[4];
+	if (get_solid_color(server->renderer, surface, texture, color)) {
+		for (int i = 0; i < 4; i++) {
+			color[i] *= alpha;
+		}
+		render_quad(wlr_output, output_damage, color, &box, rotation);
+	} else {
+		float matrix[9];
+		enum wl_output_transform transform =
+			wlr_output_transform_invert(surface->current.transform);
+		wlr_matrix_project_box(matrix, &box, transform, rotation,
+			wlr_output->transform_matrix);
+
+		render_texture(wlr_output, output_damage,
+			texture, src_box, &box, matrix, rotation, alpha);
+	}
 
 	wlr_presentation_surface_sampled_on_output(output->desktop->presentation,
 		surface, wlr_output);
+	if (G_UNLIKELY (server->latency_tracker)) {
+		phoc_latency_tracker_surface_rendered(server->latency_tracker,
+			surface, wlr_output);
+	}
 
 	collect_touch_points(output, surface, box, scale);
 }
@@ -302,6 +509,56 @@ static void count_surface_iterator(PhocOutput *output,
 	n++;
 }
 
+#ifdef PHOC_HAVE_WLR_VIEWPORTER
+struct surface_box_data {
+	struct wlr_surface *surface;
+	struct wlr_box box;
+	bool found;
+};
+
+static void surface_box_iterator(PhocOutput *output,
+		struct wlr_surface *surface, struct wlr_box *box, float rotation,
+		float scale, void *_data) {
+	struct surface_box_data *data = _data;
+	if (surface == data->surface) {
+		data->box = *box;
+		data->found = true;
+	}
+}
+
+static bool viewport_can_scan_out(PhocOutput *output,
+		struct roots_view *view) {
+	struct wlr_output *wlr_output = output->wlr_output;
+	struct wlr_surface *surface = view->wlr_surface;
+	struct surface_box_data data = { .surface = surface };
+	struct wlr_fbox src;
+	int width, height;
+
+	wlr_surface_get_buffer_source_box(surface, &src);
+	if (src.x != 0 || src.y != 0 ||
+			src.width != surface->current.buffer_width ||
+			src.height != surface->current.buffer_height) {
+		return false;
+	}
+
+	/* Scaling is fine as long as the buffer matches the mode */
+	if (surface->current.buffer_width != wlr_output->width ||
+			surface->current.buffer_height != wlr_output->height) {
+		return false;
+	}
+
+	/* ...and the destination covers exactly the whole output */
+	phoc_output_view_for_each_surface(output, view,
+		surface_box_iterator, &data);
+	if (!data.found || data.box.x != 0 || data.box.y != 0) {
+		return false;
+	}
+	wlr_output_transformed_resolution(wlr_output, &width, &height);
+	return round(data.box.width * wlr_output->scale) == width &&
+		round(data.box.height * wlr_output->scale) == height;
+}
+#endif
+
 static bool scan_out_fullscreen_view(PhocOutput *output) {
 	struct wlr_output *wlr_output = output->wlr_output;
 	PhocServer *server = phoc_server_get_default ();
@@ -354,8 +611,19 @@ static bool scan_out_fullscreen_view(PhocOutput *output) {
 		return false;
 	}
 
-	if ((float)surface->current.scale != wlr_output->scale ||
-			surface->current.transform != wlr_output->transform) {
+	if (surface->current.transform != wlr_output->transform) {
+		return false;
+	}
+
+#ifdef PHOC_HAVE_WLR_VIEWPORTER
+	if (surface->current.viewport.has_src ||
+			surface->current.viewport.has_dst) {
+		if (!viewport_can_scan_out(output, view)) {
+			return false;
+		}
+	} else
+#endif
+	if ((float)surface->current.scale != wlr_output->scale) {
 		return false;
 	}
 
@@ -370,9 +638,29 @@ static bool scan_out_fullscreen_view(PhocOutput *output) {
 	}
 #endif
 
-	wlr_presentation_surface_sampled_on_output(output->desktop->presentation, surface, output->wlr_output);
+	struct wlr_presentation_feedback *feedback =
+		wlr_presentation_surface_sampled(output->desktop->presentation, surface);
+	if (G_UNLIKELY (server->latency_tracker)) {
+		phoc_latency_tracker_surface_rendered(server->latency_tracker,
+			surface, wlr_output);
+	}
+
+	phoc_output_stage_adaptive_sync(output);
+	// The commit gets the next sequence number, the present event
+	// might already fire from within wlr_output_commit()
+	phoc_output_set_scanout_feedback(output, feedback,
+		wlr_output->commit_seq + 1);
+	bool committed = wlr_output_commit(wlr_output);
+	phoc_output_adaptive_sync_committed(output, committed);
+	if (!committed && output->scanout_feedback == feedback) {
+		phoc_output_set_scanout_feedback(output, NULL, 0);
+	}
+	if (G_UNLIKELY (server->latency_tracker)) {
+		phoc_latency_tracker_output_commit(server->latency_tracker,
+			wlr_output, committed);
+	}
 
-	return wlr_output_commit(wlr_output);
+	return committed;
 }
 
 static void render_drag_icons(PhocOutput *output,
@@ -516,6 +804,15 @@ view_render_iterator (struct wlr_surface *surface, int sx, int sy, void *data)
                       1.0);
 }
 
+static void
+render_view_to_fbo (PhocRenderer *self, struct roots_view *view, int width, int height)
+{
+  wlr_renderer_begin (self->wlr_renderer, width, height);
+  wlr_renderer_clear (self->wlr_renderer, (float[])COLOR_TRANSPARENT);
+  wlr_surface_for_each_surface (view->wlr_surface, view_render_iterator, view);
+  wlr_renderer_end (self->wlr_renderer);
+}
+
 gboolean
 view_render_to_buffer (struct roots_view *view, enum wl_shm_format fmt, int width, int height, int stride, uint32_t *flags, void* data)
 {
@@ -549,10 +846,7 @@ view_render_to_buffer (struct roots_view *view, enum wl_shm_format fmt, int widt
   glBindFramebuffer (GL_FRAMEBUFFER, fbo);
   glFramebufferTexture2D (GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, tex, 0);
 
-  wlr_renderer_begin (self->wlr_renderer, width, height);
-  wlr_renderer_clear (self->wlr_renderer, (float[])COLOR_TRANSPARENT);
-  wlr_surface_for_each_surface (surface, view_render_iterator, view);
-  wlr_renderer_end (self->wlr_renderer);
+  render_view_to_fbo (self, view, width, height);
 
   wlr_renderer_read_pixels (self->wlr_renderer, fmt, flags, stride, width, height, 0, 0, 0, 0, data);
 
@@ -565,6 +859,394 @@ view_render_to_buffer (struct roots_view *view, enum wl_shm_format fmt, int widt
   return TRUE;
 }
 
+/**
+ * view_render_to_dmabuf:
+ * @view: The view to render
+ * @attribs: The dmabuf to render into
+ *
+ * Render the view's surfaces straight into a client provided dmabuf
+ * so no copy through CPU memory is needed. The resulting image has the
+ * same orientation as the one from view_render_to_buffer().
+ *
+ * Returns: %TRUE on success
+ */
+gboolean
+view_render_to_dmabuf (struct roots_view *view, struct wlr_dmabuf_attributes *attribs)
+{
+  PhocServer *server = phoc_server_get_default ();
+  PhocRenderer *self = server->renderer;
+  struct wlr_egl *egl = wlr_gles2_renderer_get_egl (self->wlr_renderer);
+  bool external_only = false;
+  EGLImageKHR image;
+  GLuint rbo, fbo;
+  gboolean ok;
+
+  if (!view->wlr_surface || !wlr_egl_make_current (egl, EGL_NO_SURFACE, NULL))
+    return FALSE;
+
+  if (!self->egl_image_target_renderbuffer_storage) {
+    self->egl_image_target_renderbuffer_storage = (PFNGLEGLIMAGETARGETRENDERBUFFERSTORAGEOESPROC)
+      eglGetProcAddress ("glEGLImageTargetRenderbufferStorageOES");
+    if (!self->egl_image_target_renderbuffer_storage) {
+      g_warning ("glEGLImageTargetRenderbufferStorageOES unsupported");
+      wlr_egl_unset_current (egl);
+      return FALSE;
+    }
+  }
+
+  image = wlr_egl_create_image_from_dmabuf (egl, attribs, &external_only);
+  if (image == EGL_NO_IMAGE_KHR || external_only) {
+    if (image != EGL_NO_IMAGE_KHR)
+      wlr_egl_destroy_image (egl, image);
+    wlr_egl_unset_current (egl);
+    return FALSE;
+  }
+
+  glGenRenderbuffers (1, &rbo);
+  glBindRenderbuffer (GL_RENDERBUFFER, rbo);
+  self->egl_image_target_renderbuffer_storage (GL_RENDERBUFFER, image);
+  glBindRenderbuffer (GL_RENDERBUFFER, 0);
+
+  glGenFramebuffers (1, &fbo);
+  glBindFramebuffer (GL_FRAMEBUFFER, fbo);
+  glFramebufferRenderbuffer (GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, rbo);
+
+  ok = glCheckFramebufferStatus (GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+  if (ok) {
+    render_view_to_fbo (self, view, attribs->width, attribs->height);
+    /* No explicit sync, make sure the client sees the final image */
+    glFinish ();
+  }
+
+  glDeleteFramebuffers (1, &fbo);
+  glDeleteRenderbuffers (1, &rbo);
+  glBindFramebuffer (GL_FRAMEBUFFER, 0);
+  wlr_egl_destroy_image (egl, image);
+
+  wlr_egl_unset_current (egl);
+
+  return ok;
+}
+
+static const GLchar blit_vertex_src[] =
+  "uniform mat3 proj;\n"
+  "attribute vec2 pos;\n"
+  "varying vec2 v_texcoord;\n"
+  "\n"
+  "void main() {\n"
+  "  gl_Position = vec4(proj * vec3(pos, 1.0), 1.0);\n"
+  "  v_texcoord = vec2(pos.x, pos.y);\n"
+  "}\n";
+
+static const GLchar blit_fragment_src[] =
+  "precision mediump float;\n"
+  "varying vec2 v_texcoord;\n"
+  "uniform sampler2D tex;\n"
+  "\n"
+  "void main() {\n"
+  "  gl_FragColor = texture2D(tex, v_texcoord);\n"
+  "}\n";
+
+static GLuint
+compile_shader (GLenum type, const GLchar *src)
+{
+  GLuint shader = glCreateShader (type);
+  GLint ok;
+
+  glShaderSource (shader, 1, &src, NULL);
+  glCompileShader (shader);
+  glGetShaderiv (shader, GL_COMPILE_STATUS, &ok);
+  if (ok == GL_FALSE) {
+    g_warning ("Failed to compile shader");
+    glDeleteShader (shader);
+    return 0;
+  }
+
+  return shader;
+}
+
+static gboolean
+ensure_blit_program (PhocRenderer *self)
+{
+  GLuint vert, frag, prog;
+  GLint ok;
+
+  if (self->blit_program)
+    return TRUE;
+
+  vert = compile_shader (GL_VERTEX_SHADER, blit_vertex_src);
+  if (!vert)
+    return FALSE;
+
+  frag = compile_shader (GL_FRAGMENT_SHADER, blit_fragment_src);
+  if (!frag) {
+    glDeleteShader (vert);
+    return FALSE;
+  }
+
+  prog = glCreateProgram ();
+  glAttachShader (prog, vert);
+  glAttachShader (prog, frag);
+  glLinkProgram (prog);
+  glDetachShader (prog, vert);
+  glDetachShader (prog, frag);
+  glDeleteShader (vert);
+  glDeleteShader (frag);
+
+  glGetProgramiv (prog, GL_LINK_STATUS, &ok);
+  if (ok == GL_FALSE) {
+    g_warning ("Failed to link blit program");
+    glDeleteProgram (prog);
+    return FALSE;
+  }
+
+  self->blit_program = prog;
+  self->blit_pos_attrib = glGetAttribLocation (prog, "pos");
+  self->blit_proj_uniform = glGetUniformLocation (prog, "proj");
+  self->blit_tex_uniform = glGetUniformLocation (prog, "tex");
+
+  return TRUE;
+}
+
+static void
+release_render_buffer (PhocOutput *output)
+{
+  glDeleteFramebuffers (1, &output->render_fbo);
+  glDeleteTextures (1, &output->render_tex);
+  output->render_fbo = output->render_tex = 0;
+  output->render_width = output->render_height = 0;
+}
+
+/*
+ * Make sure the output has an offscreen buffer to render the scene
+ * at the given scale. Sets @new_buffer if the buffer's content is
+ * undefined and needs a full redraw.
+ */
+static gboolean
+ensure_render_buffer (PhocOutput *output, float scale, gboolean *new_buffer)
+{
+  struct wlr_output *wlr_output = output->wlr_output;
+  int width = MAX (1, roundf (wlr_output->width * scale));
+  int height = MAX (1, roundf (wlr_output->height * scale));
+  GLenum status;
+
+  *new_buffer = FALSE;
+  if (output->render_fbo && output->render_width == width && output->render_height == height)
+    return TRUE;
+
+  if (output->render_fbo)
+    release_render_buffer (output);
+
+  glGenTextures (1, &output->render_tex);
+  glBindTexture (GL_TEXTURE_2D, output->render_tex);
+  glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexImage2D (GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+  glBindTexture (GL_TEXTURE_2D, 0);
+
+  glGenFramebuffers (1, &output->render_fbo);
+  glBindFramebuffer (GL_FRAMEBUFFER, output->render_fbo);
+  glFramebufferTexture2D (GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, output->render_tex, 0);
+  status = glCheckFramebufferStatus (GL_FRAMEBUFFER);
+  glBindFramebuffer (GL_FRAMEBUFFER, 0);
+
+  if (status != GL_FRAMEBUFFER_COMPLETE) {
+    g_warning ("Failed to create %dx%d render buffer for %s", width, height, wlr_output->name);
+    release_render_buffer (output);
+    return FALSE;
+  }
+
+  g_debug ("Rendering %s at %dx%d", wlr_output->name, width, height);
+  output->render_width = width;
+  output->render_height = height;
+  *new_buffer = TRUE;
+  return TRUE;
+}
+
+/*
+ * Draw an offscreen buffer's texture into @box of @wlr_output limited
+ * to @damage. The offscreen buffer is in @buffer_transform.
+ */
+static void
+render_offscreen_buffer (PhocRenderer             *self,
+                         struct wlr_output        *wlr_output,
+                         GLuint                    tex,
+                         const struct wlr_box     *box,
+                         enum wl_output_transform  buffer_transform,
+                         pixman_region32_t        *damage)
+{
+  static const GLfloat verts[] = {
+    0, 0,  1, 0,  0, 1,  1, 1,
+  };
+  float proj[9], matrix[9], gl_matrix[9];
+  pixman_box32_t *rects;
+  int nrects;
+
+  if (!ensure_blit_program (self))
+    return;
+
+  /* Same projection the gles2 renderer uses */
+  wlr_matrix_projection (proj, wlr_output->width, wlr_output->height,
+                         WL_OUTPUT_TRANSFORM_FLIPPED_180);
+  wlr_matrix_project_box (matrix, box, wlr_output_transform_invert (buffer_transform),
+                          0, wlr_output->transform_matrix);
+  wlr_matrix_multiply (gl_matrix, proj, matrix);
+  wlr_matrix_transpose (gl_matrix, gl_matrix);
+
+  glDisable (GL_BLEND);
+  glUseProgram (self->blit_program);
+  glActiveTexture (GL_TEXTURE0);
+  glBindTexture (GL_TEXTURE_2D, tex);
+  glUniform1i (self->blit_tex_uniform, 0);
+  glUniformMatrix3fv (self->blit_proj_uniform, 1, GL_FALSE, gl_matrix);
+
+  glVertexAttribPointer (self->blit_pos_attrib, 2, GL_FLOAT, GL_FALSE, 0, verts);
+  glEnableVertexAttribArray (self->blit_pos_attrib);
+
+  rects = pixman_region32_rectangles (damage, &nrects);
+  for (int i = 0; i < nrects; ++i) {
+    scissor_output (wlr_output, &rects[i]);
+    glDrawArrays (GL_TRIANGLE_STRIP, 0, 4);
+  }
+
+  glDisableVertexAttribArray (self->blit_pos_attrib);
+  glBindTexture (GL_TEXTURE_2D, 0);
+  glEnable (GL_BLEND);
+}
+
+/* Upscale the reduced size buffer to the bound framebuffer within damage */
+static void
+blit_render_buffer (PhocRenderer *self, PhocOutput *output, pixman_region32_t *damage)
+{
+  struct wlr_box box = { 0 };
+
+  wlr_output_transformed_resolution (output->wlr_output, &box.width, &box.height);
+  render_offscreen_buffer (self, output->wlr_output, output->render_tex, &box,
+                           output->wlr_output->transform, damage);
+}
+
+/* Where the mirrored output's content ends up on the mirror, letterboxed */
+static void
+get_mirror_box (PhocOutput *mirror, struct wlr_box *box)
+{
+  PhocOutput *source = mirror->mirror_source;
+  int sw, sh, tw, th;
+  double scale;
+
+  wlr_output_transformed_resolution (source->wlr_output, &sw, &sh);
+  wlr_output_transformed_resolution (mirror->wlr_output, &tw, &th);
+
+  scale = MIN ((double)tw / sw, (double)th / sh);
+  box->width = round (sw * scale);
+  box->height = round (sh * scale);
+  box->x = (tw - box->width) / 2;
+  box->y = (th - box->height) / 2;
+}
+
+static void
+render_mirror (PhocRenderer *self, PhocOutput *output, pixman_region32_t *damage)
+{
+  PhocOutput *source = output->mirror_source;
+  float clear_color[] = COLOR_BLACK;
+  struct wlr_box box;
+  pixman_box32_t *rects;
+  int nrects;
+
+  rects = pixman_region32_rectangles (damage, &nrects);
+  for (int i = 0; i < nrects; ++i) {
+    scissor_output (output->wlr_output, &rects[i]);
+    wlr_renderer_clear (self->wlr_renderer, clear_color);
+  }
+
+  /* Source didn't render a frame yet */
+  if (source->render_tex == 0)
+    return;
+
+  get_mirror_box (output, &box);
+  render_offscreen_buffer (self, output->wlr_output, source->render_tex, &box,
+                           source->wlr_output->transform, damage);
+}
+
+/* Propagate what changed on a mirrored output to its mirror */
+static void
+damage_mirror (PhocOutput *source, pixman_region32_t *damage)
+{
+  PhocOutput *mirror = source->mirrored_by;
+  struct wlr_box box;
+  pixman_region32_t mirror_damage;
+  pixman_box32_t *rects;
+  double scale;
+  int nrects, sw, sh;
+
+  get_mirror_box (mirror, &box);
+  wlr_output_transformed_resolution (source->wlr_output, &sw, &sh);
+  scale = (double)box.width / sw;
+
+  pixman_region32_init (&mirror_damage);
+  rects = pixman_region32_rectangles (damage, &nrects);
+  for (int i = 0; i < nrects; ++i) {
+    int x1 = floor (rects[i].x1 * scale) - 1;
+    int y1 = floor (rects[i].y1 * scale) - 1;
+    int x2 = ceil (rects[i].x2 * scale) + 1;
+    int y2 = ceil (rects[i].y2 * scale) + 1;
+
+    pixman_region32_union_rect (&mirror_damage, &mirror_damage,
+                                box.x + x1, box.y + y1, x2 - x1, y2 - y1);
+  }
+  wlr_output_damage_add (mirror->damage, &mirror_damage);
+  pixman_region32_fini (&mirror_damage);
+}
+
+/**
+ * phoc_renderer_release_output_buffer:
+ * @self: The renderer
+ * @output: The output
+ *
+ * Release the offscreen buffer used to render @output at a reduced
+ * render scale.
+ */
+void
+phoc_renderer_release_output_buffer (PhocRenderer *self, PhocOutput *output)
+{
+  struct wlr_egl *egl = wlr_gles2_renderer_get_egl (self->wlr_renderer);
+
+  if (output->render_fbo == 0)
+    return;
+
+  if (!wlr_egl_make_current (egl, EGL_NO_SURFACE, NULL))
+    return;
+
+  release_render_buffer (output);
+  wlr_egl_unset_current (egl);
+}
+
+/**
+ * phoc_renderer_drop_caches:
+ * @self: The renderer
+ *
+ * Drop state the renderer only keeps around to speed up later
+ * frames: the colors of single pixel surfaces and the offscreen
+ * buffers of outputs that aren't rendering. Everything gets recreated
+ * on demand.
+ */
+void
+phoc_renderer_drop_caches (PhocRenderer *self)
+{
+  PhocServer *server = phoc_server_get_default ();
+  PhocOutput *output;
+
+  g_return_if_fail (PHOC_IS_RENDERER (self));
+
+  g_hash_table_remove_all (self->solid_surfaces);
+
+  wl_list_for_each (output, &server->desktop->outputs, link) {
+    if (!output->wlr_output->enabled)
+      phoc_renderer_release_output_buffer (self, output);
+  }
+}
+
 static void surface_send_frame_done_iterator(PhocOutput *output,
 		struct wlr_surface *surface, struct wlr_box *box, float rotation,
 		float scale, void *data) {
@@ -586,8 +1268,13 @@ void output_render(PhocOutput *output) {
 		return;
 	}
 
+	/* Ends on every return path, including failing to attach a buffer */
+	PHOC_TRACE_SCOPE("output_render");
+
+	/* Use the clock presentation feedback uses so clients can relate
+	 * frame callbacks to presentation timestamps */
 	struct timespec now;
-	clock_gettime(CLOCK_MONOTONIC, &now);
+	clock_gettime(wlr_backend_get_presentation_clock(server->backend), &now);
 
 	float clear_color[] = COLOR_BLACK;
 
@@ -598,7 +1285,8 @@ void output_render(PhocOutput *output) {
 
 	// Check if we can delegate the fullscreen surface to the output
 	if (output->fullscreen_view != NULL &&
-			output->fullscreen_view->wlr_surface != NULL) {
+			output->fullscreen_view->wlr_surface != NULL &&
+			output->mirror_source == NULL) {
 		struct roots_view *view = output->fullscreen_view;
 
 		// Make sure the view is centered on screen
@@ -613,9 +1301,13 @@ void output_render(PhocOutput *output) {
 		// Fullscreen views are rendered on a black background
 		clear_color[0] = clear_color[1] = clear_color[2] = 0;
 
-		// Check if we can scan-out the fullscreen view
+		// Check if we can scan-out the fullscreen view. Mirrored
+		// outputs need the composited frame for their mirror.
+		PHOC_TRACE_BEGIN(trace_scan_out);
 		static bool last_scanned_out = false;
-		bool scanned_out = scan_out_fullscreen_view(output);
+		bool scanned_out = output->mirrored_by == NULL &&
+			scan_out_fullscreen_view(output);
+		PHOC_TRACE_END(trace_scan_out, "output_render: scan-out");
 
 		if (scanned_out && !last_scanned_out) {
 			wlr_log(WLR_DEBUG, "Scanning out fullscreen view");
@@ -626,20 +1318,23 @@ void output_render(PhocOutput *output) {
 		last_scanned_out = scanned_out;
 
 		if (scanned_out) {
+			phoc_output_notify_activity(output, TRUE);
 			goto send_frame_done;
 		}
 	}
 
 	bool needs_frame;
-	pixman_region32_t buffer_damage;
+	pixman_region32_t buffer_damage, scene_damage, upscale_damage;
 	pixman_region32_init(&buffer_damage);
 	if (!wlr_output_damage_attach_render(output->damage, &needs_frame,
 			&buffer_damage)) {
 		return;
 	}
+	pixman_region32_init(&scene_damage);
+	pixman_region32_init(&upscale_damage);
 
 	struct render_data data = {
-		.damage = &buffer_damage,
+		.damage = &scene_damage,
 		.alpha = 1.0,
 	};
 
@@ -661,20 +1356,68 @@ void output_render(PhocOutput *output) {
 		goto buffer_damage_finish;
 	}
 
+	phoc_output_notify_activity(output, TRUE);
+
 	wlr_renderer_begin(wlr_renderer, wlr_output->width, wlr_output->height);
 
-	if (!pixman_region32_not_empty(&buffer_damage)) {
+	float render_scale = phoc_output_get_render_scale(output);
+	gboolean new_buffer = FALSE;
+	bool scaled = false;
+	GLint output_fbo = 0;
+
+	if (output->mirror_source) {
+		PHOC_TRACE_SCOPE("output_render: mirror");
+		render_mirror(self, output, &buffer_damage);
+		goto scene_end;
+	}
+
+	// Mirrored outputs render through the offscreen buffer so
+	// their mirror can reuse the frame
+	if (render_scale < 1.0 || output->mirrored_by) {
+		scaled = ensure_render_buffer(output, render_scale, &new_buffer);
+	} else if (output->render_fbo) {
+		release_render_buffer(output);
+	}
+
+	if (scaled) {
+		int ow, oh;
+		wlr_output_transformed_resolution(wlr_output, &ow, &oh);
+
+		// The offscreen buffer keeps its content so only this frame's
+		// damage needs to be rendered. Upscaling filters across
+		// neighbouring texels so pad the area copied to the output.
+		if (new_buffer) {
+			pixman_region32_union_rect(&scene_damage, &scene_damage, 0, 0, ow, oh);
+		} else {
+			pixman_region32_copy(&scene_damage, &output->damage->current);
+		}
+		wlr_region_expand(&upscale_damage, &scene_damage, ceilf(1.0 / render_scale) + 1);
+		pixman_region32_intersect_rect(&upscale_damage, &upscale_damage, 0, 0, ow, oh);
+		pixman_region32_union(&buffer_damage, &buffer_damage, &upscale_damage);
+
+		glGetIntegerv(GL_FRAMEBUFFER_BINDING, &output_fbo);
+		glBindFramebuffer(GL_FRAMEBUFFER, output->render_fbo);
+		glViewport(0, 0, output->render_width, output->render_height);
+		output->render_scale_active = true;
+	} else {
+		pixman_region32_copy(&scene_damage, &buffer_damage);
+	}
+
+	if (!pixman_region32_not_empty(&scene_damage)) {
 		// Output isn't damaged but needs buffer swap
-		goto renderer_end;
+		goto scene_end;
 	}
 
+	PHOC_TRACE_BEGIN(trace_clear);
 	int nrects;
-	pixman_box32_t *rects = pixman_region32_rectangles(&buffer_damage, &nrects);
+	pixman_box32_t *rects = pixman_region32_rectangles(&scene_damage, &nrects);
 	for (int i = 0; i < nrects; ++i) {
 		scissor_output(output->wlr_output, &rects[i]);
 		wlr_renderer_clear(wlr_renderer, clear_color);
 	}
+	PHOC_TRACE_END(trace_clear, "output_render: clear");
 
+	PHOC_TRACE_BEGIN(trace_scene);
 	// If a view is fullscreen on this output, render it
 	if (output->fullscreen_view != NULL) {
 		struct roots_view *view = output->fullscreen_view;
@@ -696,14 +1439,14 @@ void output_render(PhocOutput *output) {
 
 		if (output->force_shell_reveal) {
 			// Render top layer above fullscreen view when requested
-			render_layer(output, &buffer_damage,
+			render_layer(output, &scene_damage,
 				&output->layers[ZWLR_LAYER_SHELL_V1_LAYER_TOP]);
 		}
 	} else {
 		// Render background and bottom layers under views
-		render_layer(output, &buffer_damage,
+		render_layer(output, &scene_damage,
 			&output->layers[ZWLR_LAYER_SHELL_V1_LAYER_BACKGROUND]);
-		render_layer(output, &buffer_damage,
+		render_layer(output, &scene_damage,
 			&output->layers[ZWLR_LAYER_SHELL_V1_LAYER_BOTTOM]);
 
 		struct roots_view *view;
@@ -715,16 +1458,28 @@ void output_render(PhocOutput *output) {
 		}
 
 		// Render top layer above views
-		render_layer(output, &buffer_damage,
+		render_layer(output, &scene_damage,
 			&output->layers[ZWLR_LAYER_SHELL_V1_LAYER_TOP]);
 	}
+	PHOC_TRACE_END(trace_scene, "output_render: views");
 
-	render_drag_icons(output, &buffer_damage, server->input);
+	PHOC_TRACE_BEGIN(trace_overlay);
+	render_drag_icons(output, &scene_damage, server->input);
 
-	render_layer(output, &buffer_damage,
+	render_layer(output, &scene_damage,
 		&output->layers[ZWLR_LAYER_SHELL_V1_LAYER_OVERLAY]);
+	PHOC_TRACE_END(trace_overlay, "output_render: overlay");
+
+scene_end:
+	if (scaled) {
+		PHOC_TRACE_SCOPE("output_render: upscale");
+		output->render_scale_active = false;
+		wlr_renderer_scissor(wlr_renderer, NULL);
+		glBindFramebuffer(GL_FRAMEBUFFER, output_fbo);
+		glViewport(0, 0, wlr_output->width, wlr_output->height);
+		blit_render_buffer(self, output, &buffer_damage);
+	}
 
-renderer_end:
 	wlr_output_render_software_cursors(wlr_output, &buffer_damage);
 	wlr_renderer_scissor(wlr_renderer, NULL);
 
@@ -737,7 +1492,8 @@ renderer_end:
 	pixman_region32_t frame_damage;
 	pixman_region32_init(&frame_damage);
 
-	wlr_region_transform(&frame_damage, &output->damage->current,
+	wlr_region_transform(&frame_damage,
+		scaled ? &upscale_damage : &output->damage->current,
 		transform, width, height);
 
 	if (G_UNLIKELY (server->debug_flags & PHOC_SERVER_DEBUG_FLAG_DAMAGE_TRACKING)) {
@@ -762,18 +1518,33 @@ renderer_end:
 		pixman_region32_fini(&previous_damage);
 	}
 
+	PHOC_TRACE_BEGIN(trace_commit);
 	wlr_renderer_end(wlr_renderer);
 
 	wlr_output_set_damage(wlr_output, &frame_damage);
 	pixman_region32_fini(&frame_damage);
 
-	if (!wlr_output_commit(wlr_output)) {
+	phoc_output_stage_adaptive_sync(output);
+	bool committed = wlr_output_commit(wlr_output);
+	PHOC_TRACE_END(trace_commit, "output_render: commit");
+	phoc_output_adaptive_sync_committed(output, committed);
+	if (G_UNLIKELY (server->latency_tracker)) {
+		phoc_latency_tracker_output_commit(server->latency_tracker,
+			wlr_output, committed);
+	}
+	if (!committed) {
 		goto buffer_damage_finish;
 	}
 	output->last_frame = desktop->last_frame = now;
 
+	if (scaled && output->mirrored_by) {
+		damage_mirror(output, &upscale_damage);
+	}
+
 buffer_damage_finish:
 	pixman_region32_fini(&buffer_damage);
+	pixman_region32_fini(&scene_damage);
+	pixman_region32_fini(&upscale_damage);
 
 send_frame_done:
 	// Send frame done events to all surfaces
@@ -788,7 +1559,12 @@ send_frame_done:
 static void
 phoc_renderer_finalize (GObject *object)
 {
+  PhocRenderer *self = PHOC_RENDERER (object);
+
+  g_hash_table_destroy (self->solid_surfaces);
   /* TODO: destroy wlr_renderer */
+
+  G_OBJECT_CLASS (phoc_renderer_parent_class)->finalize (object);
 }
 
 
@@ -844,6 +1620,8 @@ phoc_renderer_class_init (PhocRendererClass *klass)
 static void
 phoc_renderer_init (PhocRenderer *self)
 {
+  self->solid_surfaces = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL,
+                                                (GDestroyNotify) solid_surface_free);
 }
 
 
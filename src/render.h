@@ -9,6 +9,7 @@
 
 #include <glib-object.h>
 
+#include <wlr/render/dmabuf.h>
 #include <wlr/render/wlr_renderer.h>
 
 G_BEGIN_DECLS
@@ -19,6 +20,9 @@ G_DECLARE_FINAL_TYPE (PhocRenderer, phoc_renderer, PHOC, RENDERER, GObject)
 
 PhocRenderer *phoc_renderer_new (struct wlr_renderer *wlr_renderer);
 void          output_render(PhocOutput *output);
+void          phoc_renderer_release_output_buffer (PhocRenderer *self, PhocOutput *output);
+void          phoc_renderer_drop_caches (PhocRenderer *self);
 gboolean      view_render_to_buffer (struct roots_view *view, enum wl_shm_format fmt, int width, int height, int stride, uint32_t *flags, void* data);
+gboolean      view_render_to_dmabuf (struct roots_view *view, struct wlr_dmabuf_attributes *attribs);
 
 G_END_DECLS
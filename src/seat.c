@@ -32,11 +32,28 @@
 #include "seat.h"
 #include "text_input.h"
 #include "touch.h"
+#include "trace.h"
 #include "xcursor.h"
 
+static void
+track_input_latency (PhocSeat                *seat,
+                     struct wlr_input_device *device,
+                     uint32_t                 time_msec,
+                     struct wlr_surface      *surface)
+{
+  PhocServer *server = phoc_server_get_default ();
+
+  if (G_LIKELY (server->latency_tracker == NULL))
+    return;
+
+  phoc_latency_tracker_input_event (server->latency_tracker, seat->seat->name,
+                                    device, time_msec, surface);
+}
+
 static void
 handle_keyboard_key (struct wl_listener *listener, void *data)
 {
+  PHOC_TRACE_SCOPE ("seat: handle_keyboard_key");
   PhocServer *server = phoc_server_get_default ();
   PhocKeyboard *keyboard =
     wl_container_of (listener, keyboard, keyboard_key);
@@ -46,12 +63,15 @@ handle_keyboard_key (struct wl_listener *listener, void *data)
   struct wlr_event_keyboard_key *event = data;
 
   phoc_keyboard_handle_key (keyboard, event);
+  track_input_latency (keyboard->seat, keyboard->device, event->time_msec,
+                       keyboard->seat->seat->keyboard_state.focused_surface);
 }
 
 static void
 handle_keyboard_modifiers (struct wl_listener *listener,
                            void               *data)
 {
+  PHOC_TRACE_SCOPE ("seat: handle_keyboard_modifiers");
   PhocServer *server = phoc_server_get_default ();
   PhocKeyboard *keyboard =
     wl_container_of (listener, keyboard, keyboard_modifiers);
@@ -64,6 +84,7 @@ handle_keyboard_modifiers (struct wl_listener *listener,
 static void
 handle_cursor_motion (struct wl_listener *listener, void *data)
 {
+  PHOC_TRACE_SCOPE ("seat: handle_cursor_motion");
   PhocServer *server = phoc_server_get_default ();
   PhocCursor *cursor = wl_container_of (listener, cursor, motion);
   PhocDesktop *desktop = server->desktop;
@@ -72,12 +93,15 @@ handle_cursor_motion (struct wl_listener *listener, void *data)
   struct wlr_event_pointer_motion *event = data;
 
   phoc_cursor_handle_motion (cursor, event);
+  track_input_latency (cursor->seat, event->device, event->time_msec,
+                       cursor->seat->seat->pointer_state.focused_surface);
 }
 
 static void
 handle_cursor_motion_absolute (struct wl_listener *listener,
                                void               *data)
 {
+  PHOC_TRACE_SCOPE ("seat: handle_cursor_motion_absolute");
   PhocServer *server = phoc_server_get_default ();
   PhocCursor *cursor = wl_container_of (listener, cursor, motion_absolute);
   PhocDesktop *desktop = server->desktop;
@@ -86,11 +110,14 @@ handle_cursor_motion_absolute (struct wl_listener *listener,
   struct wlr_event_pointer_motion_absolute *event = data;
 
   phoc_cursor_handle_motion_absolute (cursor, event);
+  track_input_latency (cursor->seat, event->device, event->time_msec,
+                       cursor->seat->seat->pointer_state.focused_surface);
 }
 
 static void
 handle_cursor_button (struct wl_listener *listener, void *data)
 {
+  PHOC_TRACE_SCOPE ("seat: handle_cursor_button");
   PhocServer *server = phoc_server_get_default ();
   PhocCursor *cursor = wl_container_of (listener, cursor, button);
   PhocDesktop *desktop = server->desktop;
@@ -99,11 +126,14 @@ handle_cursor_button (struct wl_listener *listener, void *data)
   struct wlr_event_pointer_button *event = data;
 
   phoc_cursor_handle_button (cursor, event);
+  track_input_latency (cursor->seat, event->device, event->time_msec,
+                       cursor->seat->seat->pointer_state.focused_surface);
 }
 
 static void
 handle_cursor_axis (struct wl_listener *listener, void *data)
 {
+  PHOC_TRACE_SCOPE ("seat: handle_cursor_axis");
   PhocServer *server = phoc_server_get_default ();
   PhocCursor *cursor = wl_container_of (listener, cursor, axis);
   PhocDesktop *desktop = server->desktop;
@@ -112,11 +142,14 @@ handle_cursor_axis (struct wl_listener *listener, void *data)
   struct wlr_event_pointer_axis *event = data;
 
   phoc_cursor_handle_axis (cursor, event);
+  track_input_latency (cursor->seat, event->device, event->time_msec,
+                       cursor->seat->seat->pointer_state.focused_surface);
 }
 
 static void
 handle_cursor_frame (struct wl_listener *listener, void *data)
 {
+  PHOC_TRACE_SCOPE ("seat: handle_cursor_frame");
   PhocServer *server = phoc_server_get_default ();
   PhocCursor *cursor = wl_container_of (listener, cursor, frame);
   PhocDesktop *desktop = server->desktop;
@@ -221,6 +254,7 @@ handle_switch_toggle (struct wl_listener *listener, void *data)
 static void
 handle_touch_down (struct wl_listener *listener, void *data)
 {
+  PHOC_TRACE_SCOPE ("seat: handle_touch_down");
   PhocServer *server = phoc_server_get_default ();
   PhocCursor *cursor = wl_container_of (listener, cursor, touch_down);
   struct wlr_event_touch_down *event = data;
@@ -235,11 +269,17 @@ handle_touch_down (struct wl_listener *listener, void *data)
   }
   wlr_idle_notify_activity (desktop->idle, cursor->seat->seat);
   phoc_cursor_handle_touch_down (cursor, event);
+
+  struct wlr_touch_point *point =
+    wlr_seat_touch_get_point (cursor->seat->seat, event->touch_id);
+  track_input_latency (cursor->seat, event->device, event->time_msec,
+                       point ? point->surface : NULL);
 }
 
 static void
 handle_touch_up (struct wl_listener *listener, void *data)
 {
+  PHOC_TRACE_SCOPE ("seat: handle_touch_up");
   PhocServer *server = phoc_server_get_default ();
   PhocCursor *cursor = wl_container_of (listener, cursor, touch_up);
   struct wlr_event_touch_up *event = data;
@@ -260,6 +300,7 @@ handle_touch_up (struct wl_listener *listener, void *data)
 static void
 handle_touch_motion (struct wl_listener *listener, void *data)
 {
+  PHOC_TRACE_SCOPE ("seat: handle_touch_motion");
   PhocServer *server = phoc_server_get_default ();
   PhocCursor *cursor = wl_container_of (listener, cursor, touch_motion);
   struct wlr_event_touch_motion *event = data;
@@ -270,6 +311,11 @@ handle_touch_motion (struct wl_listener *listener, void *data)
   /* handle touch motion regardless of output status so events don't become
      stuck */
   phoc_cursor_handle_touch_motion (cursor, event);
+
+  struct wlr_touch_point *point =
+    wlr_seat_touch_get_point (cursor->seat->seat, event->touch_id);
+  track_input_latency (cursor->seat, event->device, event->time_msec,
+                       point ? point->surface : NULL);
   if (output && !output->wlr_output->enabled) {
     g_debug ("Touch event ignored since output '%s' is disabled.",
              output->wlr_output->name);
@@ -328,6 +374,7 @@ handle_tablet_tool_position (PhocCursor *cursor,
 static void
 handle_tool_axis (struct wl_listener *listener, void *data)
 {
+  PHOC_TRACE_SCOPE ("seat: handle_tool_axis");
   PhocServer *server = phoc_server_get_default ();
   PhocCursor *cursor = wl_container_of (listener, cursor, tool_axis);
   PhocDesktop *desktop = server->desktop;
@@ -393,6 +440,7 @@ handle_tool_axis (struct wl_listener *listener, void *data)
 static void
 handle_tool_tip (struct wl_listener *listener, void *data)
 {
+  PHOC_TRACE_SCOPE ("seat: handle_tool_tip");
   PhocServer *server = phoc_server_get_default ();
   PhocCursor *cursor = wl_container_of (listener, cursor, tool_tip);
   PhocDesktop *desktop = server->desktop;
@@ -1366,28 +1414,7 @@ phoc_seat_add_device (PhocSeat                *seat,
 void
 phoc_seat_configure_xcursor (PhocSeat *seat)
 {
-  PhocServer *server = phoc_server_get_default ();
-  const char *cursor_theme = NULL;
-
-  if (!seat->cursor->xcursor_manager) {
-    seat->cursor->xcursor_manager =
-      wlr_xcursor_manager_create (cursor_theme, ROOTS_XCURSOR_SIZE);
-    if (seat->cursor->xcursor_manager == NULL) {
-      wlr_log (WLR_ERROR, "Cannot create XCursor manager for theme");
-      return;
-    }
-  }
-
-  PhocOutput *output;
-
-  wl_list_for_each (output, &server->desktop->outputs, link) {
-    float scale = output->wlr_output->scale;
-    if (!wlr_xcursor_manager_load (seat->cursor->xcursor_manager, scale)) {
-      wlr_log (WLR_ERROR, "Cannot load xcursor theme for output '%s' "
-               "with scale %f", output->wlr_output->name, scale);
-    }
-  }
-
+  /* The cursor theme gets loaded lazily for the needed scales */
   phoc_seat_maybe_set_cursor (seat, seat->cursor->default_xcursor);
   wlr_cursor_warp (seat->cursor->cursor, NULL, seat->cursor->cursor->x,
                    seat->cursor->cursor->y);
@@ -1812,6 +1839,7 @@ phoc_seat_begin_move (PhocSeat *seat, struct roots_view *view)
   }
   cursor->offs_x = cursor->cursor->x;
   cursor->offs_y = cursor->cursor->y;
+  phoc_input_predictor_reset (&cursor->predictor);
   struct wlr_box geom;
 
   view_get_geometry (view, &geom);
@@ -1849,6 +1877,7 @@ phoc_seat_begin_resize (PhocSeat *seat, struct roots_view *view,
   }
   cursor->offs_x = cursor->cursor->x;
   cursor->offs_y = cursor->cursor->y;
+  phoc_input_predictor_reset (&cursor->predictor);
   struct wlr_box geom;
 
   view_get_geometry (view, &geom);
@@ -1933,10 +1962,21 @@ phoc_seat_maybe_set_cursor (PhocSeat *self, const char *name)
   if ((wlr_seat->capabilities & WL_SEAT_CAPABILITY_POINTER) == 0) {
     wlr_cursor_set_image (self->cursor->cursor, NULL, 0, 0, 0, 0, 0, 0);
   } else {
+    PhocServer *server = phoc_server_get_default ();
+    struct wlr_xcursor_manager *xcursor_manager = NULL;
+    PhocOutput *output;
+
     if (!name)
       name = self->cursor->default_xcursor;
-    wlr_xcursor_manager_set_cursor_image (self->cursor->xcursor_manager,
-                                          name, self->cursor->cursor);
+
+    wl_list_for_each (output, &server->desktop->outputs, link) {
+      xcursor_manager = phoc_desktop_get_xcursor_manager (server->desktop,
+                                                          output->wlr_output->scale);
+    }
+    if (xcursor_manager == NULL)
+      return;
+
+    wlr_xcursor_manager_set_cursor_image (xcursor_manager, name, self->cursor->cursor);
   }
 }
 
@@ -7,16 +7,29 @@
 #define G_LOG_DOMAIN "phoc-server"
 
 #include "config.h"
+#include "client.h"
+#include "keymap-cache.h"
+#include "phoc-enums.h"
 #include "render.h"
+#include "trace.h"
 #include "utils.h"
 #include "server.h"
 
 #include <errno.h>
+#include <glib-unix.h>
+#ifdef PHOC_HAVE_MALLOC_TRIM
+#include <malloc.h>
+#endif
+#include <signal.h>
+#include <unistd.h>
 
 /* FIXME */
 #include <wlr/render/gles2.h>
 
 static void phoc_server_initable_iface_init (GInitableIface *iface);
+#ifdef PHOC_TRACE
+static void dump_trace (PhocServer *self);
+#endif
 
 G_DEFINE_TYPE_WITH_CODE (PhocServer, phoc_server, G_TYPE_OBJECT,
 			 G_IMPLEMENT_INTERFACE (G_TYPE_INITABLE, phoc_server_initable_iface_init));
@@ -324,6 +337,31 @@ phoc_server_finalize (GObject *object)
     self->inited = FALSE;
   }
 
+  if (self->debug_dump_id) {
+    g_source_remove (self->debug_dump_id);
+    self->debug_dump_id = 0;
+  }
+
+#ifdef PHOC_TRACE
+  if (self->debug_flags & PHOC_SERVER_DEBUG_FLAG_TRACE)
+    dump_trace (self);
+#endif
+
+#if GLIB_CHECK_VERSION (2, 64, 0)
+  g_clear_object (&self->memory_monitor);
+#endif
+
+  if (self->debug_object_id) {
+    g_dbus_connection_unregister_object (self->debug_connection, self->debug_object_id);
+    self->debug_object_id = 0;
+  }
+  g_clear_object (&self->debug_connection);
+  if (self->debug_bus_id) {
+    g_bus_unown_name (self->debug_bus_id);
+    self->debug_bus_id = 0;
+  }
+  g_clear_object (&self->latency_tracker);
+
   wl_display_destroy (self->wl_display);
   G_OBJECT_CLASS (phoc_server_parent_class)->finalize (object);
 }
@@ -370,6 +408,186 @@ phoc_server_get_default (void)
   return instance;
 }
 
+static char *
+views_to_string (PhocServer *self)
+{
+  GEnumClass *content_types = g_type_class_ref (PHOC_TYPE_CONTENT_TYPE);
+  GString *str = g_string_new ("Views:\n");
+  struct roots_view *view;
+
+  wl_list_for_each (view, &self->desktop->views, link) {
+    GEnumValue *value = g_enum_get_value (content_types, view->content_type);
+
+    g_string_append_printf (str, "  %s: content-type=%s", view->app_id ?: "(no app-id)",
+                            value ? value->value_nick : "unknown");
+    if (view->content_rate)
+      g_string_append_printf (str, " rate=%.3fHz", view->content_rate / 1000.0);
+    if (view->fullscreen_output)
+      g_string_append_printf (str, " fullscreen=%s", view->fullscreen_output->wlr_output->name);
+    if (view->n_deferred_commits)
+      g_string_append_printf (str, " deferred-commits=%" G_GUINT64_FORMAT "%s",
+                              view->n_deferred_commits, view->commit_deferred ? " (pending)" : "");
+    g_string_append_c (str, '\n');
+  }
+
+  g_type_class_unref (content_types);
+  return g_string_free (str, FALSE);
+}
+
+#ifdef PHOC_TRACE
+static void
+dump_trace (PhocServer *self)
+{
+  g_autoptr (GError) err = NULL;
+  g_autofree char *dir = g_build_filename (g_get_user_cache_dir (), "phoc", NULL);
+  g_autofree char *name = g_strdup_printf ("trace-%d-%" G_GINT64_FORMAT ".json",
+                                           getpid (), g_get_real_time () / G_USEC_PER_SEC);
+  g_autofree char *path = g_build_filename (dir, name, NULL);
+
+  if (g_mkdir_with_parents (dir, 0700) < 0) {
+    g_warning ("Failed to create %s: %s", dir, g_strerror (errno));
+    return;
+  }
+
+  if (!phoc_trace_dump (path, &err)) {
+    g_warning ("Failed to write trace: %s", err->message);
+    return;
+  }
+
+  g_message ("Wrote trace to %s", path);
+}
+#endif
+
+
+static gboolean
+on_debug_dump_signal (gpointer data)
+{
+  PhocServer *self = PHOC_SERVER (data);
+
+  if (self->debug_flags & PHOC_SERVER_DEBUG_FLAG_VIEWS) {
+    g_autofree char *views = views_to_string (self);
+    g_message ("%s", views);
+  }
+
+  if (self->latency_tracker) {
+    g_autofree char *stats = phoc_latency_tracker_to_string (self->latency_tracker);
+    g_message ("%s", stats);
+  }
+
+  if (self->debug_flags & PHOC_SERVER_DEBUG_FLAG_CLIENT_STATS) {
+    g_autofree char *clients = phoc_client_stats_to_string (self->wl_display);
+    g_message ("%s", clients);
+  }
+
+#ifdef PHOC_TRACE
+  if (self->debug_flags & PHOC_SERVER_DEBUG_FLAG_TRACE)
+    dump_trace (self);
+#endif
+
+  return G_SOURCE_CONTINUE;
+}
+
+
+/**
+ * phoc_server_drop_caches:
+ * @self: The server
+ *
+ * Release memory phoc only holds on to speed things up later
+ * on. Used when the system runs low on memory.
+ */
+void
+phoc_server_drop_caches (PhocServer *self)
+{
+  g_return_if_fail (PHOC_IS_SERVER (self));
+
+  phoc_keymap_cache_clear (phoc_keymap_cache_get_default ());
+  if (self->renderer)
+    phoc_renderer_drop_caches (self->renderer);
+
+#ifdef PHOC_HAVE_MALLOC_TRIM
+  /* Hand freed heap memory back to the system */
+  malloc_trim (0);
+#endif
+}
+
+#if GLIB_CHECK_VERSION (2, 64, 0)
+static void
+on_low_memory_warning (PhocServer                  *self,
+                       GMemoryMonitorWarningLevel   level,
+                       GMemoryMonitor              *monitor)
+{
+  g_message ("Low memory warning (level %d), dropping caches", level);
+  phoc_server_drop_caches (self);
+}
+#endif
+
+
+/* Debug features that have something to dump on SIGUSR2 */
+#define PHOC_SERVER_DEBUG_SIGUSR2_FLAGS (PHOC_SERVER_DEBUG_FLAG_LATENCY |      \
+                                         PHOC_SERVER_DEBUG_FLAG_CLIENT_STATS | \
+                                         PHOC_SERVER_DEBUG_FLAG_TRACE |        \
+                                         PHOC_SERVER_DEBUG_FLAG_VIEWS)
+
+#define PHOC_DEBUG_DBUS_NAME "sm.puri.Phoc.Debug"
+#define PHOC_DEBUG_DBUS_PATH "/sm/puri/Phoc/Debug"
+
+static const char debug_introspection_xml[] =
+  "<node>"
+  "  <interface name='sm.puri.Phoc.Debug'>"
+  "    <method name='GetClientStats'>"
+  "      <arg type='aa{sv}' name='clients' direction='out'/>"
+  "    </method>"
+  "  </interface>"
+  "</node>";
+
+static void
+on_debug_method_call (GDBusConnection       *connection,
+                      const char            *sender,
+                      const char            *object_path,
+                      const char            *interface_name,
+                      const char            *method_name,
+                      GVariant              *parameters,
+                      GDBusMethodInvocation *invocation,
+                      gpointer               user_data)
+{
+  PhocServer *self = PHOC_SERVER (user_data);
+
+  if (g_strcmp0 (method_name, "GetClientStats") == 0) {
+    GVariant *clients = phoc_client_stats_to_variant (self->wl_display);
+
+    g_dbus_method_invocation_return_value (invocation, g_variant_new_tuple (&clients, 1));
+    return;
+  }
+
+  g_dbus_method_invocation_return_error (invocation, G_DBUS_ERROR, G_DBUS_ERROR_UNKNOWN_METHOD,
+                                         "Unknown method %s", method_name);
+}
+
+static const GDBusInterfaceVTable debug_vtable = {
+  .method_call = on_debug_method_call,
+};
+
+static void
+on_debug_bus_acquired (GDBusConnection *connection, const char *name, gpointer user_data)
+{
+  PhocServer *self = PHOC_SERVER (user_data);
+  g_autoptr (GDBusNodeInfo) info = g_dbus_node_info_new_for_xml (debug_introspection_xml, NULL);
+  g_autoptr (GError) err = NULL;
+
+  self->debug_object_id = g_dbus_connection_register_object (connection,
+                                                             PHOC_DEBUG_DBUS_PATH,
+                                                             info->interfaces[0],
+                                                             &debug_vtable,
+                                                             self,
+                                                             NULL,
+                                                             &err);
+  if (self->debug_object_id == 0) {
+    g_warning ("Failed to export debug interface: %s", err->message);
+    return;
+  }
+  self->debug_connection = g_object_ref (connection);
+}
+
 /**
  * phoc_server_setup:
  *
@@ -401,6 +619,39 @@ phoc_server_setup (PhocServer *self, const char *config_path,
   self->flags = flags;
   self->debug_flags = debug_flags;
 
+  if (G_UNLIKELY (self->debug_flags & PHOC_SERVER_DEBUG_FLAG_LATENCY))
+    self->latency_tracker = phoc_latency_tracker_new ();
+  if (G_UNLIKELY (self->debug_flags & PHOC_SERVER_DEBUG_FLAG_TRACE)) {
+#ifdef PHOC_TRACE
+    phoc_trace_start ();
+#else
+    g_warning ("PHOC_DEBUG=trace needs phoc built with -Dtrace=true");
+#endif
+  }
+  if (G_UNLIKELY (self->debug_flags & PHOC_SERVER_DEBUG_FLAG_CLIENT_STATS)) {
+    phoc_client_stats_init (self->compositor);
+    self->debug_bus_id = g_bus_own_name (G_BUS_TYPE_SESSION,
+                                         PHOC_DEBUG_DBUS_NAME,
+                                         G_BUS_NAME_OWNER_FLAGS_NONE,
+                                         on_debug_bus_acquired,
+                                         NULL,
+                                         NULL,
+                                         self,
+                                         NULL);
+  }
+  /* Dump debug statistics on SIGUSR2 */
+  if (self->debug_flags & PHOC_SERVER_DEBUG_SIGUSR2_FLAGS)
+    self->debug_dump_id = g_unix_signal_add (SIGUSR2, on_debug_dump_signal, self);
+
+#if GLIB_CHECK_VERSION (2, 64, 0)
+  self->memory_monitor = g_memory_monitor_dup_default ();
+  g_signal_connect_object (self->memory_monitor,
+                           "low-memory-warning",
+                           G_CALLBACK (on_low_memory_warning),
+                           self,
+                           G_CONNECT_SWAPPED);
+#endif
+
   const char *socket = wl_display_add_socket_auto(self->wl_display);
   if (!socket) {
     g_warning("Unable to open wayland socket: %s", strerror(errno));
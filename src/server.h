@@ -16,6 +16,7 @@
 #include "settings.h"
 #include "desktop.h"
 #include "input.h"
+#include "latency-tracker.h"
 
 G_BEGIN_DECLS
 
@@ -38,6 +39,10 @@ typedef enum _PhocServerDebugFlags {
   PHOC_SERVER_DEBUG_FLAG_DAMAGE_TRACKING = 1 << 0,
   PHOC_SERVER_DEBUG_FLAG_TOUCH_POINTS = 1 << 1,
   PHOC_SERVER_DEBUG_FLAG_NO_QUIT = 1 << 2,
+  PHOC_SERVER_DEBUG_FLAG_LATENCY = 1 << 3,
+  PHOC_SERVER_DEBUG_FLAG_CLIENT_STATS = 1 << 4,
+  PHOC_SERVER_DEBUG_FLAG_TRACE = 1 << 5,
+  PHOC_SERVER_DEBUG_FLAG_VIEWS = 1 << 6,
 } PhocServerDebugFlags;
 
 /* TODO: we keep the struct public due to heaps of direct access
@@ -52,6 +57,7 @@ struct _PhocServer {
   PhocServerFlags flags;
   PhocServerDebugFlags debug_flags;
   gboolean inited;
+  guint debug_dump_id;
 
   /* The session */
   gchar *session;
@@ -73,6 +79,16 @@ struct _PhocServer {
   /* Global resources */
   struct wlr_data_device_manager *data_device_manager;
 
+  /* Debugging */
+  PhocLatencyTracker *latency_tracker;
+  guint debug_bus_id;
+  guint debug_object_id;
+  GDBusConnection *debug_connection;
+
+#if GLIB_CHECK_VERSION (2, 64, 0)
+  GMemoryMonitor *memory_monitor;
+#endif
+
   /* Fader */
   gulong render_shield_id;
   gulong damage_shield_id;
@@ -85,5 +101,6 @@ gboolean phoc_server_setup (PhocServer *server, const char *config_path,
                             PhocServerFlags flags,
 			    PhocServerDebugFlags debug_flags);
 gint phoc_server_get_session_exit_status (PhocServer *self);
+void phoc_server_drop_caches (PhocServer *self);
 
 G_END_DECLS
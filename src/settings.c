@@ -6,6 +6,7 @@
 #define _POSIX_C_SOURCE 200809L
 #endif
 #include <assert.h>
+#include <errno.h>
 #include <getopt.h>
 #include <limits.h>
 #include <stdlib.h>
@@ -85,6 +86,27 @@ static int config_ini_handler(void *user, const char *section, const char *name,
 			} else {
 				wlr_log(WLR_ERROR, "got unknown xwayland value: %s", value);
 			}
+		} else if (strcmp(name, "input-prediction") == 0) {
+			if (strcasecmp(value, "true") == 0) {
+				config->input_prediction = true;
+			} else if (strcasecmp(value, "false") == 0) {
+				config->input_prediction = false;
+			} else {
+				wlr_log(WLR_ERROR, "got unknown input-prediction value: %s", value);
+			}
+		} else if (strcmp(name, "defer-external-outputs") == 0) {
+			if (strcasecmp(value, "true") == 0) {
+				config->defer_external_outputs = true;
+			} else if (strcasecmp(value, "false") == 0) {
+				config->defer_external_outputs = false;
+			} else {
+				wlr_log(WLR_ERROR, "got unknown defer-external-outputs value: %s", value);
+			}
+		} else if (strcmp(name, "thermal-zone") == 0) {
+			free(config->thermal_zone);
+			config->thermal_zone = strdup(value);
+		} else if (strcmp(name, "thermal-threshold") == 0) {
+			config->thermal_threshold = strtol(value, NULL, 10);
 		} else {
 			wlr_log(WLR_ERROR, "got unknown core config: %s", name);
 		}
@@ -106,6 +128,9 @@ static int config_ini_handler(void *user, const char *section, const char *name,
 			oc->transform = WL_OUTPUT_TRANSFORM_NORMAL;
 			oc->scale = 1;
 			oc->enable = true;
+			oc->edge_zone = -1;
+			oc->render_scale = 1.0;
+			oc->thermal_render_scale = 1.0;
 			wl_list_init(&oc->modes);
 			wl_list_insert(&config->outputs, &oc->link);
 		}
@@ -171,6 +196,50 @@ static int config_ini_handler(void *user, const char *section, const char *name,
 				free(mode);
 				wlr_log(WLR_ERROR, "Invalid modeline: %s", value);
 			}
+		} else if (strcmp(name, "edge-zone") == 0) {
+			char *end;
+			long zone;
+
+			errno = 0;
+			zone = strtol(value, &end, 10);
+			if (errno || end == value || *end != '\0' ||
+			    zone < 0 || zone > ROOTS_CONFIG_MAX_EDGE_ZONE) {
+				wlr_log(WLR_ERROR, "Invalid edge-zone: %s", value);
+			} else {
+				oc->edge_zone = zone;
+			}
+		} else if (strcmp(name, "idle-refresh-timeout") == 0) {
+			long timeout = strtol(value, NULL, 10);
+			oc->idle_refresh_timeout = timeout > 0 ? timeout : 0;
+		} else if (strcmp(name, "render-scale") == 0) {
+			oc->render_scale = strtof(value, NULL);
+			if (!(oc->render_scale >= ROOTS_CONFIG_MIN_RENDER_SCALE &&
+			      oc->render_scale <= 1)) {
+				wlr_log(WLR_ERROR, "Invalid render-scale: %s", value);
+				oc->render_scale = 1.0;
+			}
+		} else if (strcmp(name, "adaptive-sync") == 0) {
+			if (strcasecmp(value, "true") == 0) {
+				oc->adaptive_sync = ROOTS_ADAPTIVE_SYNC_ENABLED;
+			} else if (strcasecmp(value, "false") == 0) {
+				oc->adaptive_sync = ROOTS_ADAPTIVE_SYNC_DISABLED;
+			} else if (strcasecmp(value, "fullscreen") == 0) {
+				oc->adaptive_sync = ROOTS_ADAPTIVE_SYNC_FULLSCREEN;
+			} else if (strcasecmp(value, "game") == 0) {
+				oc->adaptive_sync = ROOTS_ADAPTIVE_SYNC_GAME;
+			} else {
+				wlr_log(WLR_ERROR, "got unknown adaptive-sync value: %s", value);
+			}
+		} else if (strcmp(name, "mirror") == 0) {
+			free(oc->mirror);
+			oc->mirror = strdup(value);
+		} else if (strcmp(name, "thermal-render-scale") == 0) {
+			oc->thermal_render_scale = strtof(value, NULL);
+			if (!(oc->thermal_render_scale >= ROOTS_CONFIG_MIN_RENDER_SCALE &&
+			      oc->thermal_render_scale <= 1)) {
+				wlr_log(WLR_ERROR, "Invalid thermal-render-scale: %s", value);
+				oc->thermal_render_scale = 1.0;
+			}
 		}
 	} else if (strncmp(cursor_prefix, section, strlen(cursor_prefix)) == 0) {
 		g_warning ("Found unused 'cursor:' config section. Please remove");
@@ -201,6 +270,7 @@ struct roots_config *roots_config_create(const char *config_path) {
 
 	config->xwayland = true;
 	config->xwayland_lazy = true;
+	config->thermal_threshold = 70000;
 	wl_list_init(&config->outputs);
 
 	config->config_path = g_strdup(config_path);
@@ -251,12 +321,14 @@ void roots_config_destroy(struct roots_config *config) {
 		wl_list_for_each_safe(omc, omctmp, &oc->modes, link) {
 			free(omc);
 		}
+		free(oc->mirror);
 		free(oc->name);
 		free(oc);
 	}
 
 	g_object_unref (config->keybindings);
 
+	free(config->thermal_zone);
 	free(config->config_path);
 	free(config);
 }
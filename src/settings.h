@@ -9,18 +9,35 @@
 #include <wlr/types/wlr_output_layout.h>
 
 #define ROOTS_CONFIG_DEFAULT_SEAT_NAME "seat0"
+/* Edge zones are in layout coordinates, anything larger is likely a typo */
+#define ROOTS_CONFIG_MAX_EDGE_ZONE 500
+/* Lower render scales aren't worth the blur */
+#define ROOTS_CONFIG_MIN_RENDER_SCALE 0.25
 
 struct roots_output_mode_config {
 	drmModeModeInfo info;
 	struct wl_list link;
 };
 
+enum roots_adaptive_sync_mode {
+	ROOTS_ADAPTIVE_SYNC_DISABLED = 0,
+	ROOTS_ADAPTIVE_SYNC_ENABLED,
+	ROOTS_ADAPTIVE_SYNC_FULLSCREEN,
+	ROOTS_ADAPTIVE_SYNC_GAME,
+};
+
 struct roots_output_config {
 	char *name;
 	bool enable;
 	enum wl_output_transform transform;
 	int x, y;
 	float scale;
+	int edge_zone;
+	unsigned int idle_refresh_timeout;
+	float render_scale;
+	float thermal_render_scale;
+	char *mirror;
+	enum roots_adaptive_sync_mode adaptive_sync;
 	struct wl_list link;
 	struct {
 		int width, height;
@@ -32,6 +49,10 @@ struct roots_output_config {
 struct roots_config {
 	bool xwayland;
 	bool xwayland_lazy;
+	bool input_prediction;
+	bool defer_external_outputs;
+	char *thermal_zone;
+	int thermal_threshold;
 
 	PhocKeybindings *keybindings;
 
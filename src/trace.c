@@ -0,0 +1,190 @@
+/*
+ * Copyright (C) 2021 Purism SPC
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#define G_LOG_DOMAIN "phoc-trace"
+
+#include "config.h"
+
+#include "trace.h"
+
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#define PHOC_TRACE_RING_SIZE (1 << 16)
+
+typedef struct {
+  const char *name;
+  gint64      start;
+  gint64      duration;
+} PhocTraceEvent;
+
+/*
+ * Spans recorded by a single thread. Once full the oldest spans get
+ * overwritten so the recorder can run for a long time and the last
+ * couple of seconds are available when a hitch happens.
+ */
+typedef struct {
+  GMutex         lock;
+  pid_t          tid;
+  guint          head;
+  gboolean       wrapped;
+  PhocTraceEvent events[PHOC_TRACE_RING_SIZE];
+} PhocTraceRing;
+
+static gboolean   enabled;
+static GMutex     rings_lock;
+static GPtrArray *rings;
+static GPrivate   thread_ring;
+
+
+static PhocTraceRing *
+get_thread_ring (void)
+{
+  PhocTraceRing *ring = g_private_get (&thread_ring);
+
+  if (G_LIKELY (ring))
+    return ring;
+
+  ring = g_new0 (PhocTraceRing, 1);
+  g_mutex_init (&ring->lock);
+  ring->tid = syscall (SYS_gettid);
+  g_private_set (&thread_ring, ring);
+
+  /* Rings outlive their threads so the spans can still be dumped */
+  g_mutex_lock (&rings_lock);
+  g_ptr_array_add (rings, ring);
+  g_mutex_unlock (&rings_lock);
+
+  return ring;
+}
+
+/**
+ * phoc_trace_start:
+ *
+ * Start recording trace spans.
+ */
+void
+phoc_trace_start (void)
+{
+  g_mutex_lock (&rings_lock);
+  if (rings == NULL)
+    rings = g_ptr_array_new ();
+  g_mutex_unlock (&rings_lock);
+
+  g_atomic_int_set (&enabled, TRUE);
+  g_message ("Recording trace spans");
+}
+
+/**
+ * phoc_trace_begin:
+ *
+ * Get the start time of a span. Use PHOC_TRACE_SCOPE() or
+ * PHOC_TRACE_BEGIN() rather than calling this directly.
+ *
+ * Returns: The start time or 0 if tracing is off
+ */
+gint64
+phoc_trace_begin (void)
+{
+  if (G_LIKELY (!g_atomic_int_get (&enabled)))
+    return 0;
+
+  return g_get_monotonic_time ();
+}
+
+/**
+ * phoc_trace_end:
+ * @name: The span's name. It must be a static string.
+ * @start: The start time as returned by phoc_trace_begin()
+ *
+ * Record a span that started at @start and ends now.
+ */
+void
+phoc_trace_end (const char *name, gint64 start)
+{
+  PhocTraceRing *ring;
+  PhocTraceEvent *event;
+
+  if (G_LIKELY (start == 0))
+    return;
+
+  ring = get_thread_ring ();
+  g_mutex_lock (&ring->lock);
+  event = &ring->events[ring->head];
+  event->name = name;
+  event->start = start;
+  event->duration = g_get_monotonic_time () - start;
+  if (++ring->head == PHOC_TRACE_RING_SIZE) {
+    ring->head = 0;
+    ring->wrapped = TRUE;
+  }
+  g_mutex_unlock (&ring->lock);
+}
+
+/**
+ * phoc_trace_span_end:
+ * @span: The span
+ *
+ * Cleanup function used by PHOC_TRACE_SCOPE().
+ */
+void
+phoc_trace_span_end (PhocTraceSpan *span)
+{
+  phoc_trace_end (span->name, span->start);
+}
+
+
+static void
+append_ring (GString *json, PhocTraceRing *ring, pid_t pid, gboolean *first)
+{
+  guint n, start;
+
+  g_mutex_lock (&ring->lock);
+  n = ring->wrapped ? PHOC_TRACE_RING_SIZE : ring->head;
+  start = ring->wrapped ? ring->head : 0;
+
+  for (guint i = 0; i < n; i++) {
+    PhocTraceEvent *event = &ring->events[(start + i) % PHOC_TRACE_RING_SIZE];
+
+    g_string_append_printf (json,
+                            "%s\n    {\"name\": \"%s\", \"cat\": \"phoc\", \"ph\": \"X\", "
+                            "\"ts\": %" G_GINT64_FORMAT ", \"dur\": %" G_GINT64_FORMAT ", "
+                            "\"pid\": %d, \"tid\": %d}",
+                            *first ? "" : ",", event->name, event->start, event->duration,
+                            pid, ring->tid);
+    *first = FALSE;
+  }
+  g_mutex_unlock (&ring->lock);
+}
+
+/**
+ * phoc_trace_dump:
+ * @path: The file to write to
+ * @error: Return location for error
+ *
+ * Write the recorded spans of all threads in Chrome's trace event
+ * format. The file can be loaded into Perfetto or chrome://tracing.
+ *
+ * Returns: %TRUE on success, %FALSE otherwise
+ */
+gboolean
+phoc_trace_dump (const char *path, GError **error)
+{
+  g_autoptr (GString) json = g_string_new ("{\n  \"displayTimeUnit\": \"ms\",\n  \"traceEvents\": [");
+  pid_t pid = getpid ();
+  gboolean first = TRUE;
+
+  g_return_val_if_fail (path, FALSE);
+
+  g_mutex_lock (&rings_lock);
+  for (guint i = 0; rings && i < rings->len; i++)
+    append_ring (json, g_ptr_array_index (rings, i), pid, &first);
+  g_mutex_unlock (&rings_lock);
+
+  g_string_append (json, "\n  ]\n}\n");
+
+  return g_file_set_contents (path, json->str, json->len, error);
+}
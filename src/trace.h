@@ -0,0 +1,44 @@
+/*
+ * Copyright (C) 2021 Purism SPC
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include "config.h"
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+#ifdef PHOC_TRACE
+
+typedef struct {
+  const char *name;
+  gint64      start;
+} PhocTraceSpan;
+
+void     phoc_trace_start    (void);
+gint64   phoc_trace_begin    (void);
+void     phoc_trace_end      (const char *name, gint64 start);
+void     phoc_trace_span_end (PhocTraceSpan *span);
+gboolean phoc_trace_dump     (const char *path, GError **error);
+
+/* Trace from here until the end of the enclosing block. Don't jump
+ * into the block past it. */
+#define PHOC_TRACE_SCOPE(name)                                          \
+  G_GNUC_UNUSED PhocTraceSpan G_PASTE (_phoc_trace_span_, __LINE__)     \
+  __attribute__ ((cleanup (phoc_trace_span_end))) = { (name), phoc_trace_begin () }
+#define PHOC_TRACE_BEGIN(var)     gint64 var = phoc_trace_begin ()
+#define PHOC_TRACE_END(var, name) phoc_trace_end ((name), (var))
+
+#else
+
+#define PHOC_TRACE_SCOPE(name)    do {} while (0)
+#define PHOC_TRACE_BEGIN(var)     do {} while (0)
+#define PHOC_TRACE_END(var, name) do {} while (0)
+
+#endif
+
+G_END_DECLS
@@ -9,6 +9,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <wlr/types/wlr_output_layout.h>
+#include "client.h"
 #include "desktop.h"
 #include "input.h"
 #include "seat.h"
@@ -171,6 +172,46 @@ static void surface_send_leave_iterator(struct wlr_surface *surface,
 	wlr_surface_send_leave(surface, wlr_output);
 }
 
+static void surface_set_scale_iterator(struct wlr_surface *surface,
+		int x, int y, void *data) {
+	struct roots_view *view = data;
+	phoc_desktop_set_surface_scale(view->desktop, surface, view->preferred_scale);
+}
+
+/**
+ * view_update_scale:
+ * @view: The view
+ *
+ * Let the client know the preferred scale of the view's surfaces. It's
+ * the largest scale of the outputs the view is on.
+ */
+void view_update_scale(struct roots_view *view) {
+	PhocDesktop *desktop = view->desktop;
+	float scale = 0;
+
+	if (view->wlr_surface == NULL) {
+		return;
+	}
+
+	struct wlr_box box;
+	view_get_box(view, &box);
+
+	PhocOutput *output;
+	wl_list_for_each(output, &desktop->outputs, link) {
+		if (wlr_output_layout_intersects(desktop->layout,
+				output->wlr_output, &box)) {
+			scale = MAX(scale, output->wlr_output->scale);
+		}
+	}
+
+	if (scale == 0) {
+		return;
+	}
+
+	view->preferred_scale = scale;
+	view_for_each_surface(view, surface_set_scale_iterator, view);
+}
+
 static void view_update_output(struct roots_view *view,
 		const struct wlr_box *before) {
 	PhocDesktop *desktop = view->desktop;
@@ -203,6 +244,8 @@ static void view_update_output(struct roots_view *view,
 			}
 		}
 	}
+
+	view_update_scale(view);
 }
 
 static void
@@ -478,6 +521,7 @@ void view_set_fullscreen(struct roots_view *view, bool fullscreen,
 
 		if (was_fullscreen) {
 			view->fullscreen_output->fullscreen_view = NULL;
+			phoc_output_update_content_policy(view->fullscreen_output);
 		}
 
 		struct wlr_box view_box;
@@ -494,6 +538,7 @@ void view_set_fullscreen(struct roots_view *view, bool fullscreen,
 		phoc_output->force_shell_reveal = false;
 		view->fullscreen_output = phoc_output;
 		phoc_output_damage_whole(phoc_output);
+		phoc_output_update_content_policy(phoc_output);
 	}
 
 	if (was_fullscreen && !fullscreen) {
@@ -502,6 +547,7 @@ void view_set_fullscreen(struct roots_view *view, bool fullscreen,
 		view->fullscreen_output = NULL;
 
 		phoc_output_damage_whole(phoc_output);
+		phoc_output_update_content_policy(phoc_output);
 
 		if (view->state == PHOC_VIEW_STATE_MAXIMIZED) {
 			view_arrange_maximized (view, phoc_output->wlr_output);
@@ -660,7 +706,14 @@ void view_child_destroy(struct roots_view_child *child) {
 static void view_child_handle_commit(struct wl_listener *listener,
 		void *data) {
 	struct roots_view_child *child = wl_container_of(listener, child, commit);
+
+	if (view_throttle_commit(child->view)) {
+		return;
+	}
+
+	gint64 start = phoc_client_commit_begin();
 	view_apply_damage(child->view);
+	phoc_client_commit_end(child->wlr_surface, start);
 }
 
 static void view_child_handle_new_subsurface(struct wl_listener *listener,
@@ -726,6 +779,10 @@ static void subsurface_handle_map(struct wl_listener *listener,
 			wlr_surface_send_enter (subsurface->wlr_subsurface->surface, output->wlr_output);
 		}
 	}
+	if (view->preferred_scale > 0) {
+		phoc_desktop_set_surface_scale(view->desktop,
+			subsurface->wlr_subsurface->surface, view->preferred_scale);
+	}
 }
 
 static void subsurface_handle_unmap(struct wl_listener *listener,
@@ -836,6 +893,12 @@ void view_map(struct roots_view *view, struct wlr_surface *surface) {
 	assert(view->wlr_surface == NULL);
 
 	view->wlr_surface = surface;
+	if (view->desktop->content_type) {
+		int content_rate;
+		PhocContentType content_type = phoc_content_type_manager_get_content_type(
+			view->desktop->content_type, surface, &content_rate);
+		view_set_content_type(view, content_type, content_rate);
+	}
 
 	struct wlr_subsurface *subsurface;
 	wl_list_for_each(subsurface, &view->wlr_surface->subsurfaces,
@@ -873,6 +936,7 @@ void view_unmap(struct roots_view *view) {
 	wl_signal_emit(&view->events.unmap, view);
 
 	view_damage_whole(view);
+	view->commit_deferred = false;
 
 	wl_list_remove(&view->new_subsurface.link);
 
@@ -884,6 +948,7 @@ void view_unmap(struct roots_view *view) {
 	if (view_is_fullscreen (view)) {
 		phoc_output_damage_whole(view->fullscreen_output);
 		view->fullscreen_output->fullscreen_view = NULL;
+		phoc_output_update_content_policy(view->fullscreen_output);
 		view->fullscreen_output = NULL;
 	}
 
@@ -945,6 +1010,31 @@ void view_apply_damage(struct roots_view *view) {
 	}
 }
 
+/**
+ * view_set_content_type:
+ * @view: The view
+ * @content_type: The content type
+ * @content_rate: The estimated frame rate in mHz of video content, 0
+ *   if not known
+ *
+ * Record the kind of content the view shows as hinted by the client.
+ * Outputs showing the view fullscreen adjust their policies to it.
+ */
+void view_set_content_type(struct roots_view *view, PhocContentType content_type,
+		int content_rate) {
+	if (view->content_type == content_type &&
+			view->content_rate == content_rate) {
+		return;
+	}
+
+	view->content_type = content_type;
+	view->content_rate = content_rate;
+
+	if (view->fullscreen_output) {
+		phoc_output_update_content_policy(view->fullscreen_output);
+	}
+}
+
 void view_damage_whole(struct roots_view *view) {
 	PhocOutput *output;
 	wl_list_for_each(output, &view->desktop->outputs, link) {
@@ -952,6 +1042,88 @@ void view_damage_whole(struct roots_view *view) {
 	}
 }
 
+/**
+ * view_is_on_screen:
+ * @view: The view
+ *
+ * Returns: %true if the view is visible on at least one enabled output
+ */
+bool view_is_on_screen(struct roots_view *view) {
+	if (!phoc_desktop_view_is_visible(view->desktop, view)) {
+		return false;
+	}
+
+	struct wlr_box box;
+	view_get_box(view, &box);
+
+	PhocOutput *output;
+	wl_list_for_each(output, &view->desktop->outputs, link) {
+		if (output->wlr_output->enabled &&
+		    wlr_output_layout_intersects(view->desktop->layout,
+		                                 output->wlr_output, &box)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+ * view_throttle_commit:
+ * @view: The view
+ *
+ * Account a commit of one of the view's surfaces against the client's
+ * commit budget. If the view isn't visible on any output and the client
+ * exceeded its budget the commit is not processed right away but
+ * coalesced with later ones until the client flushes them or the view
+ * becomes visible again.
+ *
+ * Returns: %true if the caller should skip processing the commit
+ */
+bool view_throttle_commit(struct roots_view *view) {
+	if (view->wlr_surface == NULL || view->impl->flush_commit == NULL) {
+		return false;
+	}
+
+	/* All of Xwayland is a single client, there's nothing to gain
+	 * from throttling it as a whole */
+#ifdef PHOC_XWAYLAND
+	if (view->type == ROOTS_XWAYLAND_VIEW) {
+		return false;
+	}
+#endif
+
+	struct wl_client *wl_client = wl_resource_get_client(view->wlr_surface->resource);
+	PhocClient *client = phoc_client_from_wl_client(wl_client);
+
+	if (phoc_client_account_commit(client, view_is_on_screen(view))) {
+		return false;
+	}
+
+	view->commit_deferred = true;
+	view->n_deferred_commits++;
+	return true;
+}
+
+/**
+ * view_flush_deferred_commit:
+ * @view: The view
+ *
+ * Process the latest state of a view whose commits got deferred by
+ * view_throttle_commit(). Damage from the coalesced commits is lost so
+ * the whole view gets damaged if it's visible.
+ */
+void view_flush_deferred_commit(struct roots_view *view) {
+	if (!view->commit_deferred) {
+		return;
+	}
+
+	view->commit_deferred = false;
+	view->impl->flush_commit(view);
+	if (view_is_on_screen(view)) {
+		view_damage_whole(view);
+	}
+}
+
 void view_for_each_surface(struct roots_view *view,
 		wlr_surface_iterator_func_t iterator, void *user_data) {
 	if (view->impl->for_each_surface) {
@@ -29,6 +29,8 @@ struct roots_view_interface {
 	void (*for_each_surface)(struct roots_view *view,
 		wlr_surface_iterator_func_t iterator, void *user_data);
 	void (*get_geometry)(struct roots_view *view, struct wlr_box *box);
+	// Process the latest surface state after commits got deferred
+	void (*flush_commit)(struct roots_view *view);
 	void (*destroy)(struct roots_view *view);
 };
 
@@ -60,6 +62,13 @@ struct roots_view {
 	struct wlr_box box;
 	float alpha;
 	float scale;
+	float preferred_scale;
+
+	PhocContentType content_type;
+	int content_rate; // mHz, estimated for video content
+
+	bool commit_deferred; // processing of the last commit is pending
+	guint64 n_deferred_commits;
 
 	bool decorated;
 	int border_width;
@@ -200,6 +209,9 @@ void view_appear_activated(struct roots_view *view, bool activated);
 void view_activate(struct roots_view *view, bool activate);
 void view_apply_damage(struct roots_view *view);
 void view_damage_whole(struct roots_view *view);
+bool view_is_on_screen(struct roots_view *view);
+bool view_throttle_commit(struct roots_view *view);
+void view_flush_deferred_commit(struct roots_view *view);
 gboolean view_is_floating(const struct roots_view *view);
 gboolean view_is_maximized(const struct roots_view *view);
 gboolean view_is_tiled(const struct roots_view *view);
@@ -237,6 +249,9 @@ void view_get_deco_box(const struct roots_view *view, struct wlr_box *box);
 void view_for_each_surface(struct roots_view *view,
 	wlr_surface_iterator_func_t iterator, void *user_data);
 struct roots_view *roots_view_from_wlr_surface (struct wlr_surface *surface);
+void view_update_scale(struct roots_view *view);
+void view_set_content_type(struct roots_view *view, PhocContentType content_type,
+	int content_rate);
 
 struct roots_xdg_surface *roots_xdg_surface_from_view(struct roots_view *view);
 struct roots_xwayland_surface *roots_xwayland_surface_from_view(
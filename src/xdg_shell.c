@@ -10,10 +10,12 @@
 #include <wlr/types/wlr_surface.h>
 #include <wlr/types/wlr_xdg_shell.h>
 #include <wlr/util/log.h>
+#include "client.h"
 #include "cursor.h"
 #include "desktop.h"
 #include "input.h"
 #include "server.h"
+#include "trace.h"
 #include "view.h"
 
 static const struct roots_view_child_interface popup_impl;
@@ -298,6 +300,48 @@ static void destroy(struct roots_view *view) {
 	free(roots_xdg_surface);
 }
 
+static void apply_commit(struct roots_view *view) {
+	struct roots_xdg_surface *roots_surface = roots_xdg_surface_from_view(view);
+	struct wlr_xdg_surface *surface = roots_surface->xdg_surface;
+
+	view_apply_damage(view);
+
+	struct wlr_box size;
+	get_size(view, &size);
+	view_update_size(view, size.width, size.height);
+
+	uint32_t pending_serial =
+		roots_surface->pending_move_resize_configure_serial;
+	if (pending_serial > 0 && pending_serial >= surface->configure_serial) {
+		double x = view->box.x;
+		double y = view->box.y;
+		if (view->pending_move_resize.update_x) {
+			x = view->pending_move_resize.x + view->pending_move_resize.width -
+				size.width;
+		}
+		if (view->pending_move_resize.update_y) {
+			y = view->pending_move_resize.y + view->pending_move_resize.height -
+				size.height;
+		}
+		view_update_position(view, x, y);
+
+		if (pending_serial == surface->configure_serial) {
+			roots_surface->pending_move_resize_configure_serial = 0;
+		}
+	}
+
+	struct wlr_box geometry;
+	get_geometry(view, &geometry);
+	if (roots_surface->saved_geometry.x != geometry.x || roots_surface->saved_geometry.y != geometry.y) {
+		if (view_is_floating (view)) {
+			view_update_position(view,
+			                     view->box.x + (roots_surface->saved_geometry.x - geometry.x) * view->scale,
+			                     view->box.y + (roots_surface->saved_geometry.y - geometry.y) * view->scale);
+		}
+	}
+	roots_surface->saved_geometry = geometry;
+}
+
 static const struct roots_view_interface view_impl = {
 	.activate = activate,
 	.resize = resize,
@@ -309,6 +353,7 @@ static const struct roots_view_interface view_impl = {
 	.close = _close,
 	.for_each_surface = for_each_surface,
 	.get_geometry = get_geometry,
+	.flush_commit = apply_commit,
 	.destroy = destroy,
 };
 
@@ -406,51 +451,30 @@ static void handle_set_parent(struct wl_listener *listener, void *data) {
 }
 
 static void handle_surface_commit(struct wl_listener *listener, void *data) {
+	PHOC_TRACE_SCOPE("xdg_shell: handle_surface_commit");
 	struct roots_xdg_surface *roots_surface =
 		wl_container_of(listener, roots_surface, surface_commit);
 	struct roots_view *view = &roots_surface->view;
-	struct wlr_xdg_surface *surface = roots_surface->xdg_surface;
 
-	if (!surface->mapped) {
+	if (!roots_surface->xdg_surface->mapped) {
 		return;
 	}
 
-	view_apply_damage(view);
-
-	struct wlr_box size;
-	get_size(view, &size);
-	view_update_size(view, size.width, size.height);
-
+	/* Don't defer the commit acking a pending move/resize: once merged
+	 * with later ones apply_commit can't match the serial anymore and
+	 * the position update would be lost */
 	uint32_t pending_serial =
 		roots_surface->pending_move_resize_configure_serial;
-	if (pending_serial > 0 && pending_serial >= surface->configure_serial) {
-		double x = view->box.x;
-		double y = view->box.y;
-		if (view->pending_move_resize.update_x) {
-			x = view->pending_move_resize.x + view->pending_move_resize.width -
-				size.width;
-		}
-		if (view->pending_move_resize.update_y) {
-			y = view->pending_move_resize.y + view->pending_move_resize.height -
-				size.height;
-		}
-		view_update_position(view, x, y);
+	bool acks_move_resize = pending_serial > 0 &&
+		roots_surface->xdg_surface->configure_serial >= pending_serial;
 
-		if (pending_serial == surface->configure_serial) {
-			roots_surface->pending_move_resize_configure_serial = 0;
-		}
+	if (!acks_move_resize && view_throttle_commit(view)) {
+		return;
 	}
 
-	struct wlr_box geometry;
-	get_geometry(view, &geometry);
-	if (roots_surface->saved_geometry.x != geometry.x || roots_surface->saved_geometry.y != geometry.y) {
-		if (view_is_floating (view)) {
-			view_update_position(view,
-			                     view->box.x + (roots_surface->saved_geometry.x - geometry.x) * view->scale,
-			                     view->box.y + (roots_surface->saved_geometry.y - geometry.y) * view->scale);
-		}
-	}
-	roots_surface->saved_geometry = geometry;
+	gint64 start = phoc_client_commit_begin();
+	apply_commit(view);
+	phoc_client_commit_end(roots_surface->xdg_surface->surface, start);
 }
 
 static void handle_new_popup(struct wl_listener *listener, void *data) {
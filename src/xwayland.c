@@ -11,7 +11,9 @@
 #include <wlr/types/wlr_surface.h>
 #include <wlr/util/log.h>
 #include <wlr/xwayland.h>
+#include "client.h"
 #include "server.h"
+#include "trace.h"
 #include "view.h"
 #include "xwayland.h"
 
@@ -308,10 +310,12 @@ static void handle_set_startup_id(struct wl_listener *listener, void *data) {
 #endif /* PHOC_HAVE_WLR_SET_STARTUP_ID */
 
 static void handle_surface_commit(struct wl_listener *listener, void *data) {
+	PHOC_TRACE_SCOPE("xwayland: handle_surface_commit");
 	struct roots_xwayland_surface *roots_surface =
 		wl_container_of(listener, roots_surface, surface_commit);
 	struct roots_view *view = &roots_surface->view;
 	struct wlr_surface *wlr_surface = view->wlr_surface;
+	gint64 start = phoc_client_commit_begin();
 
 	view_apply_damage(view);
 
@@ -332,6 +336,8 @@ static void handle_surface_commit(struct wl_listener *listener, void *data) {
 		view->pending_move_resize.update_y = false;
 	}
 	view_update_position(view, x, y);
+
+	phoc_client_commit_end(wlr_surface, start);
 }
 
 static void handle_map(struct wl_listener *listener, void *data) {
@@ -0,0 +1,67 @@
+#!/usr/bin/env python3
+#
+# Copyright (C) 2021 Purism SPC
+# SPDX-License-Identifier: GPL-3.0+
+#
+# Compare the JSON output of bench-scenes against a baseline and
+# flag regressions.
+
+import argparse
+import json
+import sys
+
+# Metrics where higher values are worse
+METRICS = [
+    'wall-us',
+    'frame-mean-us',
+    'frame-p95-us',
+    'frame-cpu-mean-us',
+    'output-commit-mean-us',
+    'commit-handlers-us',
+    'heap-delta-bytes',
+]
+
+
+def load(path):
+    with open(path) as f:
+        return {scene['name']: scene for scene in json.load(f)['scenes']}
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Compare phoc benchmark results')
+    parser.add_argument('baseline', help='JSON results of the baseline run')
+    parser.add_argument('current', help='JSON results of the run to check')
+    parser.add_argument('--threshold', type=float, default=10.0,
+                        help='Regression threshold in percent (default: %(default)s)')
+    args = parser.parse_args()
+
+    baseline = load(args.baseline)
+    current = load(args.current)
+    regressed = False
+
+    for name, scene in current.items():
+        base = baseline.get(name)
+        if base is None:
+            print(f'{name}: no baseline')
+            continue
+
+        print(f'{name}:')
+        for metric in METRICS:
+            old, new = base.get(metric, 0), scene.get(metric, 0)
+            # A relative change needs a positive baseline
+            if old <= 0:
+                print(f'  {metric:22} {old:12.1f} -> {new:12.1f} (no baseline)')
+                continue
+
+            change = (new - old) * 100.0 / old
+            mark = ''
+            if change > args.threshold:
+                mark = '  <-- regression'
+                regressed = True
+            print(f'  {metric:22} {old:12.1f} -> {new:12.1f} ({change:+.1f}%){mark}')
+
+    return 1 if regressed else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,845 @@
+/*
+ * Copyright (C) 2021 Purism SPC
+ * SPDX-License-Identifier: GPL-3.0+
+ *
+ * Benchmark scenes run against phoc's headless backend. Each scene is
+ * driven by a wayland client thread while the compositor side records
+ * timings of the frame stages (rendering the scene, committing it to
+ * the output) and of the client commit handlers. Results are written
+ * as JSON so runs can be compared against a baseline with
+ * bench-compare.py.
+ */
+
+#include "config.h"
+#include "testlib.h"
+#include "client.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#ifdef PHOC_HAVE_MALLOC_INFO
+# include <malloc.h>
+#endif
+
+#define SURFACE_SIZE 256
+
+typedef struct {
+  const char *name;
+  guint       iterations;
+  gint64      wall;            /* µs */
+  guint       frames;
+  double      frame_mean;      /* µs from render-start to render-end */
+  gint64      frame_p50;
+  gint64      frame_p95;
+  gint64      frame_max;
+  double      frame_cpu_mean;  /* µs of compositor CPU time per frame */
+  double      output_commit_mean; /* µs from render-end to the output commit */
+  gint64      commit_handlers; /* µs */
+  gint64      heap_delta;      /* bytes */
+} PhocBenchResult;
+
+typedef struct {
+  GMutex      lock;
+  GCond       cond;
+  gboolean    done;
+
+  /* Only touched from the compositor's main thread */
+  PhocServer *server;
+  gint64      frame_start;
+  gint64      frame_cpu_start;
+  gint64      frame_end;
+  GArray     *frame_times;
+  GArray     *frame_cpu_times;
+  GArray     *output_commit_times;
+  gint64      commit_handlers_start;
+  gint64      heap_start;
+
+  /* Exchanged with the client thread while holding the lock */
+  PhocBenchResult *result;
+  GArray     *results;
+  guint       iterations;
+  char       *scene;
+} PhocBench;
+
+typedef struct {
+  struct wl_surface    *wl_surface;
+  struct xdg_surface   *xdg_surface;
+  struct xdg_toplevel  *xdg_toplevel;
+  struct xdg_popup     *xdg_popup;
+  struct wl_subsurface *subsurface;
+  struct zwlr_layer_surface_v1 *layer_surface;
+  PhocTestBuffer        buffer;
+  guint32               width, height;
+  gboolean              configured;
+} PhocBenchSurface;
+
+typedef struct {
+  PhocBench          *bench;
+  struct wl_listener  commit;
+  struct wl_listener  destroy;
+} PhocBenchOutput;
+
+/* Compositor side */
+
+static gint64
+thread_cpu_time (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_THREAD_CPUTIME_ID, &ts);
+  return ts.tv_sec * G_USEC_PER_SEC + ts.tv_nsec / 1000;
+}
+
+
+#ifdef PHOC_HAVE_MALLOC_INFO
+static guint64
+malloc_info_size (const char *info, const char *tag)
+{
+  const char *p = strstr (info, tag);
+
+  if (p == NULL || (p = strstr (p, "size=\"")) == NULL)
+    return 0;
+
+  return g_ascii_strtoull (p + strlen ("size=\""), NULL, 10);
+}
+#endif
+
+/*
+ * Bytes in use in glibc's main arena. The compositor runs in the main
+ * thread while the client thread allocates from an arena of its own,
+ * so unlike mallinfo2() this leaves out the client's allocations.
+ */
+static gint64
+heap_in_use (void)
+{
+#ifdef PHOC_HAVE_MALLOC_INFO
+  /* Static so reading the statistics doesn't allocate from the heap itself */
+  static char info[64 * 1024];
+  const char *heap;
+  guint64 fast, rest, current;
+  FILE *fp;
+
+  memset (info, 0, sizeof (info));
+  fp = fmemopen (info, sizeof (info) - 1, "w");
+  if (fp == NULL)
+    return 0;
+  malloc_info (0, fp);
+  fclose (fp);
+
+  /* The main arena is always listed first */
+  heap = strstr (info, "<heap nr=\"0\">");
+  if (heap == NULL)
+    return 0;
+
+  fast = malloc_info_size (heap, "<total type=\"fast\"");
+  rest = malloc_info_size (heap, "<total type=\"rest\"");
+  current = malloc_info_size (heap, "<system type=\"current\"");
+
+  return current - fast - rest;
+#else
+  return 0;
+#endif
+}
+
+
+static gint64
+commit_handler_time (PhocServer *server)
+{
+  g_autoptr (GVariant) clients = g_variant_ref_sink (phoc_client_stats_to_variant (server->wl_display));
+  GVariantIter iter;
+  GVariant *client;
+  gint64 total = 0;
+
+  g_variant_iter_init (&iter, clients);
+  while ((client = g_variant_iter_next_value (&iter))) {
+    gint64 time;
+
+    if (g_variant_lookup (client, "commit-time-us", "x", &time))
+      total += time;
+    g_variant_unref (client);
+  }
+
+  return total;
+}
+
+
+static void
+on_render_start (PhocBench *bench, PhocOutput *output)
+{
+  bench->frame_start = g_get_monotonic_time ();
+  bench->frame_cpu_start = thread_cpu_time ();
+}
+
+
+static void
+on_render_end (PhocBench *bench, PhocOutput *output)
+{
+  gint64 elapsed = g_get_monotonic_time () - bench->frame_start;
+  gint64 cpu = thread_cpu_time () - bench->frame_cpu_start;
+
+  g_array_append_val (bench->frame_times, elapsed);
+  g_array_append_val (bench->frame_cpu_times, cpu);
+  bench->frame_end = g_get_monotonic_time ();
+}
+
+
+static void
+on_output_commit (struct wl_listener *listener, void *data)
+{
+  PhocBenchOutput *bench_output = wl_container_of (listener, bench_output, commit);
+  PhocBench *bench = bench_output->bench;
+  gint64 elapsed;
+
+  /* Directly scanned out frames don't go through the renderer */
+  if (bench->frame_end == 0)
+    return;
+
+  elapsed = g_get_monotonic_time () - bench->frame_end;
+  g_array_append_val (bench->output_commit_times, elapsed);
+  bench->frame_end = 0;
+}
+
+
+static void
+on_output_destroy (struct wl_listener *listener, void *data)
+{
+  PhocBenchOutput *bench_output = wl_container_of (listener, bench_output, destroy);
+
+  wl_list_remove (&bench_output->commit.link);
+  wl_list_remove (&bench_output->destroy.link);
+  g_free (bench_output);
+}
+
+
+static void
+bench_notify (PhocBench *bench)
+{
+  g_mutex_lock (&bench->lock);
+  bench->done = TRUE;
+  g_cond_signal (&bench->cond);
+  g_mutex_unlock (&bench->lock);
+}
+
+
+static gboolean
+on_scene_begin (gpointer data)
+{
+  PhocBench *bench = data;
+
+  g_array_set_size (bench->frame_times, 0);
+  g_array_set_size (bench->frame_cpu_times, 0);
+  g_array_set_size (bench->output_commit_times, 0);
+  bench->frame_end = 0;
+  bench->commit_handlers_start = commit_handler_time (bench->server);
+  bench->heap_start = heap_in_use ();
+
+  bench_notify (bench);
+  return G_SOURCE_REMOVE;
+}
+
+
+static int
+compare_gint64 (gconstpointer a, gconstpointer b)
+{
+  gint64 x = *(const gint64 *)a, y = *(const gint64 *)b;
+
+  return (x > y) - (x < y);
+}
+
+
+static gboolean
+on_scene_end (gpointer data)
+{
+  PhocBench *bench = data;
+  PhocBenchResult *result = bench->result;
+  GArray *times = bench->frame_times;
+  gint64 sum = 0, cpu_sum = 0, commit_sum = 0;
+
+  result->frames = times->len;
+  if (times->len) {
+    for (guint i = 0; i < times->len; i++) {
+      sum += g_array_index (times, gint64, i);
+      cpu_sum += g_array_index (bench->frame_cpu_times, gint64, i);
+    }
+    g_array_sort (times, compare_gint64);
+    result->frame_mean = (double)sum / times->len;
+    result->frame_cpu_mean = (double)cpu_sum / times->len;
+    result->frame_p50 = g_array_index (times, gint64, times->len / 2);
+    result->frame_p95 = g_array_index (times, gint64, (times->len * 95) / 100);
+    result->frame_max = g_array_index (times, gint64, times->len - 1);
+  }
+  if (bench->output_commit_times->len) {
+    for (guint i = 0; i < bench->output_commit_times->len; i++)
+      commit_sum += g_array_index (bench->output_commit_times, gint64, i);
+    result->output_commit_mean = (double)commit_sum / bench->output_commit_times->len;
+  }
+  result->commit_handlers = commit_handler_time (bench->server) - bench->commit_handlers_start;
+  result->heap_delta = heap_in_use () - bench->heap_start;
+
+  bench_notify (bench);
+  return G_SOURCE_REMOVE;
+}
+
+/* Run func in the compositor's main thread and wait for it */
+static void
+bench_invoke (PhocBench *bench, GSourceFunc func)
+{
+  g_mutex_lock (&bench->lock);
+  bench->done = FALSE;
+  g_main_context_invoke (NULL, func, bench);
+  while (!bench->done)
+    g_cond_wait (&bench->cond, &bench->lock);
+  g_mutex_unlock (&bench->lock);
+}
+
+
+static gboolean
+bench_server_prepare (PhocServer *server, gpointer data)
+{
+  PhocBench *bench = data;
+  PhocOutput *output;
+
+  bench->server = server;
+  /* Account time spent in commit handlers */
+  phoc_client_stats_init (server->compositor);
+
+  wl_list_for_each (output, &server->desktop->outputs, link) {
+    PhocBenchOutput *bench_output = g_new0 (PhocBenchOutput, 1);
+
+    bench_output->bench = bench;
+    bench_output->commit.notify = on_output_commit;
+    wl_signal_add (&output->wlr_output->events.commit, &bench_output->commit);
+    bench_output->destroy.notify = on_output_destroy;
+    wl_signal_add (&output->wlr_output->events.destroy, &bench_output->destroy);
+  }
+
+  g_signal_connect_swapped (server->renderer, "render-start", G_CALLBACK (on_render_start), bench);
+  g_signal_connect_swapped (server->renderer, "render-end", G_CALLBACK (on_render_end), bench);
+
+  return TRUE;
+}
+
+/* Client side */
+
+static void
+frame_handle_done (void *data, struct wl_callback *callback, uint32_t time)
+{
+  gboolean *done = data;
+
+  *done = TRUE;
+  wl_callback_destroy (callback);
+}
+
+static const struct wl_callback_listener frame_listener = {
+  .done = frame_handle_done,
+};
+
+
+static void
+commit_and_wait_frame (PhocTestClientGlobals *globals, struct wl_surface *wl_surface)
+{
+  struct wl_callback *callback = wl_surface_frame (wl_surface);
+  gboolean done = FALSE;
+
+  wl_callback_add_listener (callback, &frame_listener, &done);
+  wl_surface_commit (wl_surface);
+  while (!done && wl_display_dispatch (globals->display) != -1) {
+  }
+}
+
+
+static void
+fill_buffer (PhocBenchSurface *bs, guint32 color)
+{
+  for (guint i = 0; i < bs->buffer.stride * bs->buffer.height; i += 4)
+    *(guint32 *)(bs->buffer.shm_data + i) = color;
+}
+
+
+static void
+attach_new_buffer (PhocTestClientGlobals *globals, PhocBenchSurface *bs, guint32 color)
+{
+  phoc_test_client_create_shm_buffer (globals, &bs->buffer, bs->width, bs->height,
+                                      WL_SHM_FORMAT_XRGB8888);
+  fill_buffer (bs, color);
+  wl_surface_attach (bs->wl_surface, bs->buffer.wl_buffer, 0, 0);
+  wl_surface_damage (bs->wl_surface, 0, 0, bs->width, bs->height);
+}
+
+
+static void
+xdg_surface_handle_configure (void *data, struct xdg_surface *xdg_surface, uint32_t serial)
+{
+  PhocBenchSurface *bs = data;
+
+  xdg_surface_ack_configure (xdg_surface, serial);
+  bs->configured = TRUE;
+}
+
+static const struct xdg_surface_listener xdg_surface_listener = {
+  .configure = xdg_surface_handle_configure,
+};
+
+
+static void
+xdg_toplevel_handle_configure (void *data, struct xdg_toplevel *xdg_toplevel,
+                               int32_t width, int32_t height, struct wl_array *states)
+{
+  PhocBenchSurface *bs = data;
+
+  bs->width = width ?: SURFACE_SIZE;
+  bs->height = height ?: SURFACE_SIZE;
+}
+
+
+static void
+xdg_toplevel_handle_close (void *data, struct xdg_toplevel *xdg_toplevel)
+{
+}
+
+static const struct xdg_toplevel_listener xdg_toplevel_listener = {
+  .configure = xdg_toplevel_handle_configure,
+  .close = xdg_toplevel_handle_close,
+};
+
+
+static void
+xdg_popup_handle_configure (void *data, struct xdg_popup *xdg_popup,
+                            int32_t x, int32_t y, int32_t width, int32_t height)
+{
+  PhocBenchSurface *bs = data;
+
+  bs->width = width;
+  bs->height = height;
+}
+
+
+static void
+xdg_popup_handle_popup_done (void *data, struct xdg_popup *xdg_popup)
+{
+}
+
+static const struct xdg_popup_listener xdg_popup_listener = {
+  .configure = xdg_popup_handle_configure,
+  .popup_done = xdg_popup_handle_popup_done,
+};
+
+
+static void
+layer_surface_handle_configure (void *data, struct zwlr_layer_surface_v1 *surface,
+                                uint32_t serial, uint32_t width, uint32_t height)
+{
+  PhocBenchSurface *bs = data;
+
+  zwlr_layer_surface_v1_ack_configure (surface, serial);
+  bs->width = width;
+  bs->height = height;
+  bs->configured = TRUE;
+}
+
+
+static void
+layer_surface_handle_closed (void *data, struct zwlr_layer_surface_v1 *surface)
+{
+}
+
+static const struct zwlr_layer_surface_v1_listener layer_surface_listener = {
+  .configure = layer_surface_handle_configure,
+  .closed = layer_surface_handle_closed,
+};
+
+
+static void
+wait_configured (PhocTestClientGlobals *globals, PhocBenchSurface *bs)
+{
+  wl_surface_commit (bs->wl_surface);
+  while (!bs->configured && wl_display_dispatch (globals->display) != -1) {
+  }
+  g_assert_true (bs->configured);
+}
+
+
+static PhocBenchSurface *
+toplevel_new (PhocTestClientGlobals *globals, const char *title, guint32 color)
+{
+  PhocBenchSurface *bs = g_new0 (PhocBenchSurface, 1);
+
+  bs->wl_surface = wl_compositor_create_surface (globals->compositor);
+  bs->xdg_surface = xdg_wm_base_get_xdg_surface (globals->xdg_shell, bs->wl_surface);
+  xdg_surface_add_listener (bs->xdg_surface, &xdg_surface_listener, bs);
+  bs->xdg_toplevel = xdg_surface_get_toplevel (bs->xdg_surface);
+  xdg_toplevel_add_listener (bs->xdg_toplevel, &xdg_toplevel_listener, bs);
+  xdg_toplevel_set_title (bs->xdg_toplevel, title);
+  wait_configured (globals, bs);
+
+  attach_new_buffer (globals, bs, color);
+  commit_and_wait_frame (globals, bs->wl_surface);
+
+  return bs;
+}
+
+
+static PhocBenchSurface *
+subsurface_new (PhocTestClientGlobals *globals, struct wl_surface *parent, guint32 color)
+{
+  PhocBenchSurface *bs = g_new0 (PhocBenchSurface, 1);
+
+  bs->wl_surface = wl_compositor_create_surface (globals->compositor);
+  bs->subsurface = wl_subcompositor_get_subsurface (globals->subcompositor,
+                                                    bs->wl_surface, parent);
+  wl_subsurface_set_position (bs->subsurface, 16, 16);
+  wl_subsurface_set_desync (bs->subsurface);
+  bs->width = bs->height = SURFACE_SIZE / 2;
+  attach_new_buffer (globals, bs, color);
+  wl_surface_commit (bs->wl_surface);
+
+  return bs;
+}
+
+
+static PhocBenchSurface *
+popup_new (PhocTestClientGlobals *globals, PhocBenchSurface *parent, guint32 color)
+{
+  PhocBenchSurface *bs = g_new0 (PhocBenchSurface, 1);
+  struct xdg_positioner *positioner = xdg_wm_base_create_positioner (globals->xdg_shell);
+
+  xdg_positioner_set_size (positioner, SURFACE_SIZE / 2, SURFACE_SIZE / 4);
+  xdg_positioner_set_anchor_rect (positioner, 0, 0, 32, 32);
+  xdg_positioner_set_anchor (positioner, XDG_POSITIONER_ANCHOR_BOTTOM_RIGHT);
+
+  bs->wl_surface = wl_compositor_create_surface (globals->compositor);
+  bs->xdg_surface = xdg_wm_base_get_xdg_surface (globals->xdg_shell, bs->wl_surface);
+  xdg_surface_add_listener (bs->xdg_surface, &xdg_surface_listener, bs);
+  bs->xdg_popup = xdg_surface_get_popup (bs->xdg_surface, parent->xdg_surface, positioner);
+  xdg_popup_add_listener (bs->xdg_popup, &xdg_popup_listener, bs);
+  xdg_positioner_destroy (positioner);
+  wait_configured (globals, bs);
+
+  attach_new_buffer (globals, bs, color);
+  return bs;
+}
+
+
+static PhocBenchSurface *
+layer_surface_new (PhocTestClientGlobals *globals, guint32 anchor, guint32 height, guint32 color)
+{
+  PhocBenchSurface *bs = g_new0 (PhocBenchSurface, 1);
+
+  bs->wl_surface = wl_compositor_create_surface (globals->compositor);
+  bs->layer_surface = zwlr_layer_shell_v1_get_layer_surface (globals->layer_shell,
+                                                             bs->wl_surface,
+                                                             NULL,
+                                                             ZWLR_LAYER_SHELL_V1_LAYER_TOP,
+                                                             "bench-panel");
+  zwlr_layer_surface_v1_add_listener (bs->layer_surface, &layer_surface_listener, bs);
+  zwlr_layer_surface_v1_set_anchor (bs->layer_surface,
+                                    anchor |
+                                    ZWLR_LAYER_SURFACE_V1_ANCHOR_LEFT |
+                                    ZWLR_LAYER_SURFACE_V1_ANCHOR_RIGHT);
+  zwlr_layer_surface_v1_set_size (bs->layer_surface, 0, height);
+  zwlr_layer_surface_v1_set_exclusive_zone (bs->layer_surface, height);
+  wait_configured (globals, bs);
+
+  attach_new_buffer (globals, bs, color);
+  commit_and_wait_frame (globals, bs->wl_surface);
+
+  return bs;
+}
+
+
+static void
+bench_surface_free (PhocBenchSurface *bs)
+{
+  if (bs->xdg_toplevel)
+    xdg_toplevel_destroy (bs->xdg_toplevel);
+  if (bs->xdg_popup)
+    xdg_popup_destroy (bs->xdg_popup);
+  if (bs->xdg_surface)
+    xdg_surface_destroy (bs->xdg_surface);
+  if (bs->subsurface)
+    wl_subsurface_destroy (bs->subsurface);
+  if (bs->layer_surface)
+    zwlr_layer_surface_v1_destroy (bs->layer_surface);
+  wl_surface_destroy (bs->wl_surface);
+  if (bs->buffer.wl_buffer)
+    phoc_test_buffer_free (&bs->buffer);
+  g_free (bs);
+}
+
+
+static void
+bench_scene_toplevels (PhocTestClientGlobals *globals, guint iterations)
+{
+  g_autoptr (GPtrArray) surfaces = g_ptr_array_new_with_free_func ((GDestroyNotify)bench_surface_free);
+  PhocBenchSurface *top = NULL;
+
+  /* Toplevels with a chain of subsurfaces each */
+  for (int i = 0; i < 6; i++) {
+    g_autofree char *title = g_strdup_printf ("bench-toplevel-%d", i);
+    PhocBenchSurface *parent = toplevel_new (globals, title, 0xFF000080 + i * 16);
+
+    g_ptr_array_add (surfaces, parent);
+    top = parent;
+    for (int depth = 0; depth < 4; depth++) {
+      PhocBenchSurface *sub = subsurface_new (globals, parent->wl_surface, 0xFF008000 + depth * 32);
+
+      /* Free children before their parents */
+      g_ptr_array_insert (surfaces, 0, sub);
+      parent = sub;
+    }
+  }
+
+  for (guint n = 0; n < iterations; n++) {
+    for (guint i = 0; i < surfaces->len; i++) {
+      PhocBenchSurface *bs = g_ptr_array_index (surfaces, i);
+
+      if (bs == top)
+        continue;
+      wl_surface_attach (bs->wl_surface, bs->buffer.wl_buffer, 0, 0);
+      wl_surface_damage (bs->wl_surface, n % bs->width, 0, 8, bs->height);
+      wl_surface_commit (bs->wl_surface);
+    }
+    wl_surface_attach (top->wl_surface, top->buffer.wl_buffer, 0, 0);
+    wl_surface_damage (top->wl_surface, 0, 0, top->width, top->height);
+    commit_and_wait_frame (globals, top->wl_surface);
+  }
+}
+
+
+static void
+bench_scene_layer_panels (PhocTestClientGlobals *globals, guint iterations)
+{
+  PhocBenchSurface *top = layer_surface_new (globals, ZWLR_LAYER_SURFACE_V1_ANCHOR_TOP, 32, 0xFF202020);
+  PhocBenchSurface *bottom = layer_surface_new (globals, ZWLR_LAYER_SURFACE_V1_ANCHOR_BOTTOM, 48, 0xFF404040);
+  PhocBenchSurface *toplevel = toplevel_new (globals, "bench-panels", 0xFF808080);
+
+  for (guint n = 0; n < iterations; n++) {
+    /* A clock like update in the top bar */
+    wl_surface_attach (top->wl_surface, top->buffer.wl_buffer, 0, 0);
+    wl_surface_damage (top->wl_surface, top->width / 2 - 24, 4, 48, 24);
+    if (n % 4 == 0) {
+      wl_surface_attach (bottom->wl_surface, bottom->buffer.wl_buffer, 0, 0);
+      wl_surface_damage (bottom->wl_surface, 0, 0, bottom->width, bottom->height);
+      wl_surface_commit (bottom->wl_surface);
+    }
+    commit_and_wait_frame (globals, top->wl_surface);
+  }
+
+  bench_surface_free (toplevel);
+  bench_surface_free (bottom);
+  bench_surface_free (top);
+}
+
+
+static void
+bench_scene_popup_storm (PhocTestClientGlobals *globals, guint iterations)
+{
+  PhocBenchSurface *toplevel = toplevel_new (globals, "bench-popups", 0xFF808000);
+
+  for (guint n = 0; n < iterations; n++) {
+    PhocBenchSurface *popup = popup_new (globals, toplevel, 0xFF00FFFF);
+    PhocBenchSurface *nested = popup_new (globals, popup, 0xFFFF00FF);
+
+    wl_surface_commit (popup->wl_surface);
+    commit_and_wait_frame (globals, nested->wl_surface);
+    bench_surface_free (nested);
+    bench_surface_free (popup);
+  }
+
+  bench_surface_free (toplevel);
+}
+
+
+static void
+bench_scene_fragmented_damage (PhocTestClientGlobals *globals, guint iterations)
+{
+  PhocBenchSurface *toplevel = toplevel_new (globals, "bench-damage", 0xFF008080);
+  g_autoptr (GRand) rand = g_rand_new_with_seed (42);
+
+  for (guint n = 0; n < iterations; n++) {
+    wl_surface_attach (toplevel->wl_surface, toplevel->buffer.wl_buffer, 0, 0);
+    for (int i = 0; i < 64; i++) {
+      wl_surface_damage (toplevel->wl_surface,
+                         g_rand_int_range (rand, 0, toplevel->width - 4),
+                         g_rand_int_range (rand, 0, toplevel->height - 4),
+                         4, 4);
+    }
+    commit_and_wait_frame (globals, toplevel->wl_surface);
+  }
+
+  bench_surface_free (toplevel);
+}
+
+
+static void
+bench_scene_thumbnails (PhocTestClientGlobals *globals, guint iterations)
+{
+  g_autoptr (GPtrArray) toplevels = g_ptr_array_new_with_free_func ((GDestroyNotify)bench_surface_free);
+  PhocTestForeignToplevel *handles[4];
+
+  for (guint i = 0; i < G_N_ELEMENTS (handles); i++) {
+    g_autofree char *title = g_strdup_printf ("bench-thumbnail-%d", i);
+
+    g_ptr_array_add (toplevels, toplevel_new (globals, title, 0xFF800000 + i * 32));
+    wl_display_roundtrip (globals->display);
+    handles[i] = phoc_test_client_get_foreign_toplevel_handle (globals, title);
+    g_assert_nonnull (handles[i]);
+  }
+
+  /* Thumbnail generation is expensive, do fewer rounds */
+  iterations = MAX (1, iterations / 4);
+  for (guint n = 0; n < iterations; n++) {
+    for (guint i = 0; i < G_N_ELEMENTS (handles); i++) {
+      PhocTestScreencopyFrame frame = { 0 };
+      struct zwlr_screencopy_frame_v1 *handle;
+
+      handle = phosh_private_get_thumbnail (globals->phosh, handles[i]->handle,
+                                            SURFACE_SIZE / 2, SURFACE_SIZE / 2);
+      phoc_test_client_capture_frame (globals, &frame, handle);
+      phoc_test_buffer_free (&frame.buffer);
+      zwlr_screencopy_frame_v1_destroy (handle);
+    }
+  }
+}
+
+
+typedef void (*PhocBenchSceneFunc) (PhocTestClientGlobals *globals, guint iterations);
+
+static const struct {
+  const char        *name;
+  PhocBenchSceneFunc func;
+} scenes[] = {
+  { "toplevels-subsurfaces", bench_scene_toplevels },
+  { "layer-panels",          bench_scene_layer_panels },
+  { "popup-storm",           bench_scene_popup_storm },
+  { "fragmented-damage",     bench_scene_fragmented_damage },
+  { "thumbnail-flood",       bench_scene_thumbnails },
+};
+
+
+static gboolean
+bench_client_run (PhocTestClientGlobals *globals, gpointer data)
+{
+  PhocBench *bench = data;
+
+  g_assert_nonnull (globals->subcompositor);
+  g_assert_nonnull (globals->phosh);
+
+  for (guint i = 0; i < G_N_ELEMENTS (scenes); i++) {
+    PhocBenchResult result = { .name = scenes[i].name, .iterations = bench->iterations };
+    gint64 start;
+
+    if (bench->scene && g_strcmp0 (bench->scene, scenes[i].name))
+      continue;
+
+    g_debug ("Running scene %s", scenes[i].name);
+    bench_invoke (bench, on_scene_begin);
+    start = g_get_monotonic_time ();
+    scenes[i].func (globals, bench->iterations);
+    wl_display_roundtrip (globals->display);
+    result.wall = g_get_monotonic_time () - start;
+
+    g_mutex_lock (&bench->lock);
+    bench->result = &result;
+    g_mutex_unlock (&bench->lock);
+    bench_invoke (bench, on_scene_end);
+
+    g_array_append_val (bench->results, result);
+  }
+
+  return TRUE;
+}
+
+
+static char *
+results_to_json (GArray *results)
+{
+  GString *json = g_string_new ("{\n  \"version\": 1,\n  \"scenes\": [\n");
+
+  for (guint i = 0; i < results->len; i++) {
+    PhocBenchResult *r = &g_array_index (results, PhocBenchResult, i);
+
+    g_string_append_printf (json,
+                            "    {\n"
+                            "      \"name\": \"%s\",\n"
+                            "      \"iterations\": %u,\n"
+                            "      \"wall-us\": %" G_GINT64_FORMAT ",\n"
+                            "      \"frames\": %u,\n"
+                            "      \"frame-mean-us\": %.1f,\n"
+                            "      \"frame-p50-us\": %" G_GINT64_FORMAT ",\n"
+                            "      \"frame-p95-us\": %" G_GINT64_FORMAT ",\n"
+                            "      \"frame-max-us\": %" G_GINT64_FORMAT ",\n"
+                            "      \"frame-cpu-mean-us\": %.1f,\n"
+                            "      \"output-commit-mean-us\": %.1f,\n"
+                            "      \"commit-handlers-us\": %" G_GINT64_FORMAT ",\n"
+                            "      \"heap-delta-bytes\": %" G_GINT64_FORMAT "\n"
+                            "    }%s\n",
+                            r->name, r->iterations, r->wall, r->frames,
+                            r->frame_mean, r->frame_p50, r->frame_p95, r->frame_max,
+                            r->frame_cpu_mean, r->output_commit_mean,
+                            r->commit_handlers, r->heap_delta,
+                            i + 1 < results->len ? "," : "");
+  }
+  g_string_append (json, "  ]\n}\n");
+
+  return g_string_free (json, FALSE);
+}
+
+
+int
+main (int argc, char *argv[])
+{
+  g_autoptr (GOptionContext) context = g_option_context_new ("- phoc benchmarks");
+  g_autoptr (GError) err = NULL;
+  g_autofree char *output = NULL;
+  g_autofree char *json = NULL;
+  PhocBench bench = { .iterations = 120 };
+  int iterations = 0;
+  const GOptionEntry options[] = {
+    { "output", 'o', 0, G_OPTION_ARG_FILENAME, &output, "Write JSON results to FILE", "FILE" },
+    { "scene", 's', 0, G_OPTION_ARG_STRING, &bench.scene, "Only run SCENE", "SCENE" },
+    { "iterations", 'n', 0, G_OPTION_ARG_INT, &iterations, "Iterations per scene", "N" },
+    { NULL }
+  };
+  PhocTestClientIface iface = {
+    .server_prepare = bench_server_prepare,
+    .client_run = bench_client_run,
+  };
+
+  g_option_context_add_main_entries (context, options, NULL);
+  if (!g_option_context_parse (context, &argc, &argv, &err)) {
+    g_printerr ("%s\n", err->message);
+    return 1;
+  }
+  if (iterations > 0)
+    bench.iterations = iterations;
+
+  g_mutex_init (&bench.lock);
+  g_cond_init (&bench.cond);
+  bench.frame_times = g_array_new (FALSE, FALSE, sizeof (gint64));
+  bench.frame_cpu_times = g_array_new (FALSE, FALSE, sizeof (gint64));
+  bench.output_commit_times = g_array_new (FALSE, FALSE, sizeof (gint64));
+  bench.results = g_array_new (FALSE, TRUE, sizeof (PhocBenchResult));
+
+  phoc_test_client_run (300, &iface, &bench);
+
+  json = results_to_json (bench.results);
+  if (output) {
+    if (!g_file_set_contents (output, json, -1, &err)) {
+      g_printerr ("Failed to write %s: %s\n", output, err->message);
+      return 1;
+    }
+  } else {
+    g_print ("%s", json);
+  }
+
+  g_array_unref (bench.results);
+  g_array_unref (bench.output_commit_times);
+  g_array_unref (bench.frame_cpu_times);
+  g_array_unref (bench.frame_times);
+  g_cond_clear (&bench.cond);
+  g_mutex_clear (&bench.lock);
+  g_free (bench.scene);
+
+  return 0;
+}
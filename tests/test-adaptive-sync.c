@@ -0,0 +1,102 @@
+/*
+ * Copyright (C) 2021 Purism SPC
+ * SPDX-License-Identifier: GPL-3.0+
+ */
+
+#include "testlib.h"
+#include "output.h"
+
+static gboolean
+staged_adaptive_sync (PhocOutput *output, gboolean *enabled)
+{
+  struct wlr_output *wlr_output = output->wlr_output;
+  gboolean staged;
+
+  phoc_output_stage_adaptive_sync (output);
+  staged = !!(wlr_output->pending.committed & WLR_OUTPUT_STATE_ADAPTIVE_SYNC_ENABLED);
+  *enabled = wlr_output->pending.adaptive_sync_enabled;
+  g_assert_cmpint (staged, ==, output->adaptive_sync_staged);
+
+  wlr_output_rollback (wlr_output);
+  output->adaptive_sync_staged = FALSE;
+
+  return staged;
+}
+
+static gboolean
+server_prepare_policy (PhocServer *server, gpointer data)
+{
+  PhocOutput *output;
+  gboolean enabled;
+
+  g_assert_false (wl_list_empty (&server->desktop->outputs));
+  output = wl_container_of (server->desktop->outputs.next, output, link);
+  g_assert_null (output->fullscreen_view);
+  g_assert_cmpint (output->wlr_output->adaptive_sync_status, ==,
+                   WLR_OUTPUT_ADAPTIVE_SYNC_DISABLED);
+
+  /* Pretend the backend supports it, what matters here is the policy */
+  output->adaptive_sync_supported = TRUE;
+
+  output->adaptive_sync_mode = ROOTS_ADAPTIVE_SYNC_DISABLED;
+  g_assert_false (staged_adaptive_sync (output, &enabled));
+
+  output->adaptive_sync_mode = ROOTS_ADAPTIVE_SYNC_ENABLED;
+  g_assert_true (staged_adaptive_sync (output, &enabled));
+  g_assert_true (enabled);
+
+  /* Without a fullscreen view there's nothing to follow */
+  output->adaptive_sync_mode = ROOTS_ADAPTIVE_SYNC_FULLSCREEN;
+  g_assert_false (staged_adaptive_sync (output, &enabled));
+  output->adaptive_sync_mode = ROOTS_ADAPTIVE_SYNC_GAME;
+  g_assert_false (staged_adaptive_sync (output, &enabled));
+
+  /* Unsupported outputs are never touched */
+  output->adaptive_sync_supported = FALSE;
+  output->adaptive_sync_mode = ROOTS_ADAPTIVE_SYNC_ENABLED;
+  g_assert_false (staged_adaptive_sync (output, &enabled));
+
+  /* A failed commit disables it for good */
+  output->adaptive_sync_supported = TRUE;
+  phoc_output_stage_adaptive_sync (output);
+  g_assert_true (output->adaptive_sync_staged);
+  wlr_output_rollback (output->wlr_output);
+  phoc_output_adaptive_sync_committed (output, FALSE);
+  g_assert_false (output->adaptive_sync_supported);
+  g_assert_false (staged_adaptive_sync (output, &enabled));
+
+  output->adaptive_sync_mode = ROOTS_ADAPTIVE_SYNC_DISABLED;
+  return TRUE;
+}
+
+static gboolean
+test_client_nop (PhocTestClientGlobals *globals, gpointer data)
+{
+  return TRUE;
+}
+
+static void
+test_adaptive_sync_policy (void)
+{
+  PhocTestClientIface iface = {
+    .server_prepare = server_prepare_policy,
+    .client_run = test_client_nop,
+  };
+
+  phoc_test_client_run (3, &iface, NULL);
+}
+
+
+gint
+main (gint argc, gchar *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  /* The policy doesn't depend on the backend's VRR support */
+  g_setenv ("WLR_BACKENDS", "headless", TRUE);
+  g_setenv ("WLR_HEADLESS_OUTPUTS", "1", TRUE);
+
+  g_test_add_func ("/phoc/adaptive-sync/policy", test_adaptive_sync_policy);
+
+  return g_test_run ();
+}
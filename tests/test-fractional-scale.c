@@ -0,0 +1,150 @@
+/*
+ * Copyright (C) 2021 Purism SPC
+ * SPDX-License-Identifier: GPL-3.0+
+ */
+
+#include "testlib.h"
+#include "output.h"
+
+#include <wayland-client-protocol.h>
+
+#define OUTPUT_SCALE 1.5
+#define OUTPUT_SCALE_120 180
+
+typedef struct _PhocTestFractionalSurface
+{
+  struct wl_surface *wl_surface;
+  struct zwlr_layer_surface_v1 *layer_surface;
+  struct wp_fractional_scale_v1 *fractional_scale;
+  guint32 preferred_scale;
+} PhocTestFractionalSurface;
+
+static void
+fractional_scale_preferred_scale (void                          *data,
+                                  struct wp_fractional_scale_v1 *fractional_scale,
+                                  uint32_t                       scale)
+{
+  PhocTestFractionalSurface *surface = data;
+
+  surface->preferred_scale = scale;
+}
+
+static const struct wp_fractional_scale_v1_listener fractional_scale_listener = {
+  .preferred_scale = fractional_scale_preferred_scale,
+};
+
+static void
+get_fractional_scale (PhocTestClientGlobals *globals, PhocTestFractionalSurface *surface)
+{
+  surface->fractional_scale =
+    wp_fractional_scale_manager_v1_get_fractional_scale (globals->fractional_scale_manager,
+                                                         surface->wl_surface);
+  wp_fractional_scale_v1_add_listener (surface->fractional_scale,
+                                       &fractional_scale_listener,
+                                       surface);
+}
+
+static void
+get_layer_surface (PhocTestClientGlobals *globals, PhocTestFractionalSurface *surface)
+{
+  surface->layer_surface = zwlr_layer_shell_v1_get_layer_surface (globals->layer_shell,
+                                                                  surface->wl_surface,
+                                                                  NULL,
+                                                                  ZWLR_LAYER_SHELL_V1_LAYER_TOP,
+                                                                  "phoc-test");
+}
+
+static void
+destroy_surface (PhocTestFractionalSurface *surface)
+{
+  g_clear_pointer (&surface->fractional_scale, wp_fractional_scale_v1_destroy);
+  g_clear_pointer (&surface->layer_surface, zwlr_layer_surface_v1_destroy);
+  g_clear_pointer (&surface->wl_surface, wl_surface_destroy);
+}
+
+static gboolean
+test_client_fractional_scale (PhocTestClientGlobals *globals, gpointer data)
+{
+  PhocTestFractionalSurface placed = { 0 }, late = { 0 }, unplaced = { 0 };
+
+  g_assert_nonnull (globals->fractional_scale_manager);
+
+  /* Placing the surface on an output sends that output's scale */
+  placed.wl_surface = wl_compositor_create_surface (globals->compositor);
+  get_fractional_scale (globals, &placed);
+  wl_display_roundtrip (globals->display);
+  g_assert_cmpuint (placed.preferred_scale, ==, 0);
+  get_layer_surface (globals, &placed);
+  wl_display_roundtrip (globals->display);
+  g_assert_cmpuint (placed.preferred_scale, ==, OUTPUT_SCALE_120);
+
+  /* A fractional scale object created later gets the scale right away */
+  late.wl_surface = wl_compositor_create_surface (globals->compositor);
+  get_layer_surface (globals, &late);
+  wl_display_roundtrip (globals->display);
+  get_fractional_scale (globals, &late);
+  wl_display_roundtrip (globals->display);
+  g_assert_cmpuint (late.preferred_scale, ==, OUTPUT_SCALE_120);
+
+  /* Scales of other surfaces don't leak into surfaces that aren't placed yet */
+  unplaced.wl_surface = wl_compositor_create_surface (globals->compositor);
+  get_fractional_scale (globals, &unplaced);
+  wl_display_roundtrip (globals->display);
+  g_assert_cmpuint (unplaced.preferred_scale, ==, 0);
+
+  /* Objects can be recreated once destroyed */
+  g_clear_pointer (&placed.fractional_scale, wp_fractional_scale_v1_destroy);
+  placed.preferred_scale = 0;
+  get_fractional_scale (globals, &placed);
+  wl_display_roundtrip (globals->display);
+  g_assert_cmpuint (placed.preferred_scale, ==, OUTPUT_SCALE_120);
+
+  destroy_surface (&placed);
+  destroy_surface (&late);
+  destroy_surface (&unplaced);
+  wl_display_roundtrip (globals->display);
+
+  return TRUE;
+}
+
+static gboolean
+server_prepare_fractional_scale (PhocServer *server, gpointer data)
+{
+  PhocOutput *output;
+
+  g_assert_false (wl_list_empty (&server->desktop->outputs));
+  output = wl_container_of (server->desktop->outputs.next, output, link);
+  wlr_output_set_scale (output->wlr_output, OUTPUT_SCALE);
+  g_assert_true (wlr_output_commit (output->wlr_output));
+
+  /* The global depends on wp_viewporter support in wlroots */
+  if (server->desktop->fractional_scale == NULL)
+    server->desktop->fractional_scale = phoc_fractional_scale_manager_create (server->wl_display);
+
+  return TRUE;
+}
+
+static void
+test_fractional_scale_per_surface (void)
+{
+  PhocTestClientIface iface = {
+    .server_prepare = server_prepare_fractional_scale,
+    .client_run = test_client_fractional_scale,
+  };
+
+  phoc_test_client_run (3, &iface, NULL);
+}
+
+
+gint
+main (gint argc, gchar *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_setenv ("WLR_BACKENDS", "headless", TRUE);
+  g_setenv ("WLR_HEADLESS_OUTPUTS", "1", TRUE);
+
+  g_test_add_func ("/phoc/fractional-scale/per-surface", test_fractional_scale_per_surface);
+
+  return g_test_run ();
+}
@@ -0,0 +1,167 @@
+/*
+ * Copyright (C) 2021 Purism SPC
+ * SPDX-License-Identifier: GPL-3.0+
+ */
+
+#include "gesture-recognizer.h"
+
+#include <wlr/util/edges.h>
+
+typedef struct {
+  gboolean claim;
+  guint    edge;
+  int      n_begin, n_update, n_end;
+  int      n_cancel;
+  double   last_dx;
+} GestureTestData;
+
+static const struct wlr_box output_box = { .x = 0, .y = 0, .width = 720, .height = 1440 };
+
+static gboolean
+on_edge_swipe (PhocGestureRecognizer *recognizer, PhocGestureState state, guint edge,
+               int touch_id, guint time, double lx, double ly, GestureTestData *data)
+{
+  data->edge = edge;
+  if (state == PHOC_GESTURE_STATE_BEGIN)
+    data->n_begin++;
+  else if (state == PHOC_GESTURE_STATE_UPDATE)
+    data->n_update++;
+  else if (state == PHOC_GESTURE_STATE_END)
+    data->n_end++;
+  return data->claim;
+}
+
+static gboolean
+on_swipe (PhocGestureRecognizer *recognizer, PhocGestureState state, guint n_fingers,
+          double dx, double dy, GestureTestData *data)
+{
+  g_assert_cmpuint (n_fingers, >=, PHOC_GESTURE_MIN_FINGERS);
+  data->last_dx = dx;
+  if (state == PHOC_GESTURE_STATE_BEGIN)
+    data->n_begin++;
+  else if (state == PHOC_GESTURE_STATE_UPDATE)
+    data->n_update++;
+  else if (state == PHOC_GESTURE_STATE_END)
+    data->n_end++;
+  return data->claim;
+}
+
+static void
+on_touch_cancel (PhocGestureRecognizer *recognizer, int touch_id, guint time, GestureTestData *data)
+{
+  data->n_cancel++;
+}
+
+static void
+test_phoc_gesture_recognizer_edge_swipe (void)
+{
+  g_autoptr (PhocGestureRecognizer) recognizer = phoc_gesture_recognizer_new ();
+  GestureTestData data = { .claim = TRUE };
+
+  g_signal_connect (recognizer, "edge-swipe", G_CALLBACK (on_edge_swipe), &data);
+
+  /* Outside of the edge zone */
+  g_assert_false (phoc_gesture_recognizer_touch_down (recognizer, 0, 100, 300, 300,
+                                                      &output_box, WLR_EDGE_TOP, 10));
+  g_assert_false (phoc_gesture_recognizer_touch_motion (recognizer, 0, 110, 300, 5));
+  g_assert_false (phoc_gesture_recognizer_touch_up (recognizer, 0, 120));
+  g_assert_cmpint (data.n_begin, ==, 0);
+
+  /* Edge without a panel */
+  g_assert_false (phoc_gesture_recognizer_touch_down (recognizer, 0, 200, 300, 1435,
+                                                      &output_box, WLR_EDGE_TOP, 10));
+  g_assert_false (phoc_gesture_recognizer_touch_up (recognizer, 0, 220));
+  g_assert_cmpint (data.n_begin, ==, 0);
+
+  /* Edge swipe from the top */
+  g_assert_true (phoc_gesture_recognizer_touch_down (recognizer, 0, 300, 300, 5,
+                                                     &output_box, WLR_EDGE_TOP, 10));
+  g_assert_cmpint (data.n_begin, ==, 1);
+  g_assert_cmpuint (data.edge, ==, WLR_EDGE_TOP);
+  /* Other fingers aren't claimed */
+  g_assert_false (phoc_gesture_recognizer_touch_down (recognizer, 1, 305, 100, 500,
+                                                      &output_box, WLR_EDGE_TOP, 10));
+  g_assert_false (phoc_gesture_recognizer_touch_motion (recognizer, 1, 310, 110, 500));
+  g_assert_true (phoc_gesture_recognizer_touch_motion (recognizer, 0, 310, 300, 50));
+  g_assert_cmpint (data.n_update, ==, 1);
+  g_assert_true (phoc_gesture_recognizer_touch_up (recognizer, 0, 320));
+  g_assert_false (phoc_gesture_recognizer_touch_up (recognizer, 1, 320));
+  g_assert_cmpint (data.n_end, ==, 1);
+
+  /* Not claimed if unhandled */
+  data.claim = FALSE;
+  g_assert_false (phoc_gesture_recognizer_touch_down (recognizer, 0, 400, 300, 5,
+                                                      &output_box, WLR_EDGE_TOP, 10));
+  g_assert_false (phoc_gesture_recognizer_touch_motion (recognizer, 0, 410, 300, 50));
+  g_assert_false (phoc_gesture_recognizer_touch_up (recognizer, 0, 420));
+}
+
+static void
+test_phoc_gesture_recognizer_swipe (void)
+{
+  g_autoptr (PhocGestureRecognizer) recognizer = phoc_gesture_recognizer_new ();
+  GestureTestData data = { .claim = TRUE };
+  double cx, cy;
+
+  g_signal_connect (recognizer, "swipe", G_CALLBACK (on_swipe), &data);
+  g_signal_connect (recognizer, "touch-cancel", G_CALLBACK (on_touch_cancel), &data);
+
+  for (int i = 0; i < 3; i++) {
+    g_assert_false (phoc_gesture_recognizer_touch_down (recognizer, i, 100 + i, 100 + 50 * i, 500,
+                                                        &output_box, WLR_EDGE_TOP, 10));
+  }
+  g_assert_true (phoc_gesture_recognizer_get_center (recognizer, &cx, &cy));
+  g_assert_cmpfloat_with_epsilon (cx, 150.0, 0.0001);
+  g_assert_cmpfloat_with_epsilon (cy, 500.0, 0.0001);
+
+  /* Small moves aren't a swipe yet */
+  g_assert_false (phoc_gesture_recognizer_touch_motion (recognizer, 0, 110, 105, 500));
+  g_assert_cmpint (data.n_begin, ==, 0);
+
+  for (int i = 0; i < 3; i++)
+    phoc_gesture_recognizer_touch_motion (recognizer, i, 120, 200 + 50 * i, 500);
+  g_assert_cmpint (data.n_begin, ==, 1);
+  g_assert_cmpint (data.n_cancel, ==, 3);
+  g_assert_true (phoc_gesture_recognizer_touch_motion (recognizer, 2, 130, 320, 500));
+  g_assert_cmpint (data.n_update, >=, 1);
+  g_assert_cmpfloat (data.last_dx, >, 0.0);
+
+  for (int i = 0; i < 3; i++)
+    g_assert_true (phoc_gesture_recognizer_touch_up (recognizer, i, 140));
+  g_assert_cmpint (data.n_end, ==, 1);
+  g_assert_false (phoc_gesture_recognizer_get_center (recognizer, &cx, &cy));
+}
+
+static void
+test_phoc_gesture_recognizer_swipe_unhandled (void)
+{
+  g_autoptr (PhocGestureRecognizer) recognizer = phoc_gesture_recognizer_new ();
+  GestureTestData data = { .claim = FALSE };
+
+  g_signal_connect (recognizer, "swipe", G_CALLBACK (on_swipe), &data);
+  g_signal_connect (recognizer, "touch-cancel", G_CALLBACK (on_touch_cancel), &data);
+
+  for (int i = 0; i < 3; i++) {
+    g_assert_false (phoc_gesture_recognizer_touch_down (recognizer, i, 100 + i, 100 + 50 * i, 500,
+                                                        &output_box, WLR_EDGE_NONE, 10));
+  }
+  for (int i = 0; i < 3; i++)
+    g_assert_false (phoc_gesture_recognizer_touch_motion (recognizer, i, 120, 200 + 50 * i, 500));
+
+  g_assert_cmpint (data.n_begin, ==, 1);
+  g_assert_cmpint (data.n_cancel, ==, 0);
+  for (int i = 0; i < 3; i++)
+    g_assert_false (phoc_gesture_recognizer_touch_up (recognizer, i, 140));
+}
+
+gint
+main (gint argc, gchar *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/phoc/gesture-recognizer/edge-swipe", test_phoc_gesture_recognizer_edge_swipe);
+  g_test_add_func ("/phoc/gesture-recognizer/swipe", test_phoc_gesture_recognizer_swipe);
+  g_test_add_func ("/phoc/gesture-recognizer/swipe-unhandled", test_phoc_gesture_recognizer_swipe_unhandled);
+
+  return g_test_run ();
+}
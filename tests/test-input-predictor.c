@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) 2021 Purism SPC
+ * SPDX-License-Identifier: GPL-3.0+
+ */
+
+#include "input-predictor.h"
+
+static void
+test_phoc_input_predictor_empty (void)
+{
+  PhocInputPredictor predictor = { 0 };
+  double x = -1.0, y = -1.0;
+
+  g_assert_false (phoc_input_predictor_predict (&predictor, 10, &x, &y));
+
+  phoc_input_predictor_add_sample (&predictor, 10, 5.0, 6.0);
+  g_assert_false (phoc_input_predictor_predict (&predictor, 20, &x, &y));
+  g_assert_cmpfloat (x, ==, 5.0);
+  g_assert_cmpfloat (y, ==, 6.0);
+}
+
+static void
+test_phoc_input_predictor_linear (void)
+{
+  PhocInputPredictor predictor = { 0 };
+  double x, y;
+
+  /* 1px/ms to the right, 2px/ms up */
+  for (int i = 0; i < 20; i++)
+    phoc_input_predictor_add_sample (&predictor, 100 + 4 * i, 4.0 * i, -8.0 * i);
+
+  g_assert_true (phoc_input_predictor_predict (&predictor, 176 + 16, &x, &y));
+  g_assert_cmpfloat_with_epsilon (x, 76.0 + 16.0, 0.0001);
+  g_assert_cmpfloat_with_epsilon (y, -152.0 - 32.0, 0.0001);
+
+  /* Prediction horizon is limited */
+  g_assert_true (phoc_input_predictor_predict (&predictor, 176 + 1000, &x, &y));
+  g_assert_cmpfloat_with_epsilon (x, 76.0 + 40.0, 0.0001);
+}
+
+static void
+test_phoc_input_predictor_reset (void)
+{
+  PhocInputPredictor predictor = { 0 };
+  double x, y;
+
+  phoc_input_predictor_add_sample (&predictor, 100, 0.0, 0.0);
+  phoc_input_predictor_add_sample (&predictor, 110, 10.0, 0.0);
+  g_assert_true (phoc_input_predictor_predict (&predictor, 120, &x, &y));
+
+  phoc_input_predictor_reset (&predictor);
+  g_assert_false (phoc_input_predictor_predict (&predictor, 120, &x, &y));
+
+  /* Going back in time starts over */
+  phoc_input_predictor_add_sample (&predictor, 100, 0.0, 0.0);
+  phoc_input_predictor_add_sample (&predictor, 110, 10.0, 0.0);
+  phoc_input_predictor_add_sample (&predictor, 50, 3.0, 3.0);
+  g_assert_false (phoc_input_predictor_predict (&predictor, 60, &x, &y));
+  g_assert_cmpfloat (x, ==, 3.0);
+}
+
+gint
+main (gint argc, gchar *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/phoc/input-predictor/empty", test_phoc_input_predictor_empty);
+  g_test_add_func ("/phoc/input-predictor/linear", test_phoc_input_predictor_linear);
+  g_test_add_func ("/phoc/input-predictor/reset", test_phoc_input_predictor_reset);
+
+  return g_test_run ();
+}
@@ -0,0 +1,136 @@
+/*
+ * Copyright (C) 2021 Purism SPC
+ * SPDX-License-Identifier: GPL-3.0+
+ */
+
+#include "keymap-cache.h"
+
+#include <glib/gstdio.h>
+
+static void
+remove_dir (const char *dir)
+{
+  g_autoptr (GDir) gdir = g_dir_open (dir, 0, NULL);
+  const char *name;
+
+  while (gdir && (name = g_dir_read_name (gdir))) {
+    g_autofree char *path = g_build_filename (dir, name, NULL);
+
+    if (g_file_test (path, G_FILE_TEST_IS_DIR))
+      remove_dir (path);
+    else
+      g_unlink (path);
+  }
+  g_rmdir (dir);
+}
+
+static guint
+count_cached_keymaps (void)
+{
+  g_autofree char *dir = g_build_filename (g_get_user_cache_dir (), "phoc", "keymaps", NULL);
+  g_autoptr (GDir) gdir = g_dir_open (dir, 0, NULL);
+  guint n = 0;
+
+  if (gdir == NULL)
+    return 0;
+
+  while (g_dir_read_name (gdir))
+    n++;
+
+  return n;
+}
+
+static void
+test_phoc_keymap_cache_shared (void)
+{
+  PhocKeymapCache *cache = phoc_keymap_cache_get_default ();
+  struct xkb_rule_names names = { .rules = "evdev", .layout = "us" };
+  struct xkb_rule_names other = { .rules = "evdev", .layout = "de" };
+  struct xkb_keymap *keymap1, *keymap2, *keymap3;
+
+  keymap1 = phoc_keymap_cache_lookup (cache, &names);
+  g_assert_nonnull (keymap1);
+  keymap2 = phoc_keymap_cache_lookup (cache, &names);
+  g_assert_true (keymap1 == keymap2);
+
+  keymap3 = phoc_keymap_cache_lookup (cache, &other);
+  g_assert_nonnull (keymap3);
+  g_assert_true (keymap1 != keymap3);
+
+  xkb_keymap_unref (keymap1);
+  xkb_keymap_unref (keymap2);
+  xkb_keymap_unref (keymap3);
+  phoc_keymap_cache_clear (cache);
+}
+
+static void
+test_phoc_keymap_cache_null_names (void)
+{
+  PhocKeymapCache *cache = phoc_keymap_cache_get_default ();
+  struct xkb_rule_names null_variant = { .rules = "evdev", .layout = "us", .variant = NULL };
+  struct xkb_rule_names empty_variant = { .rules = "evdev", .layout = "us", .variant = "" };
+  struct xkb_keymap *keymap1, *keymap2;
+
+  keymap1 = phoc_keymap_cache_lookup (cache, &null_variant);
+  keymap2 = phoc_keymap_cache_lookup (cache, &empty_variant);
+  g_assert_nonnull (keymap1);
+  g_assert_nonnull (keymap2);
+  g_assert_true (keymap1 != keymap2);
+
+  xkb_keymap_unref (keymap1);
+  xkb_keymap_unref (keymap2);
+  phoc_keymap_cache_clear (cache);
+}
+
+static void
+test_phoc_keymap_cache_persist (void)
+{
+  PhocKeymapCache *cache = phoc_keymap_cache_get_default ();
+  struct xkb_rule_names names = { .rules = "evdev", .layout = "fr", .variant = "" };
+  struct xkb_keymap *keymap;
+  g_autofree char *compiled = NULL;
+  g_autofree char *loaded = NULL;
+  guint n_cached;
+
+  n_cached = count_cached_keymaps ();
+  keymap = phoc_keymap_cache_lookup (cache, &names);
+  g_assert_nonnull (keymap);
+  compiled = xkb_keymap_get_as_string (keymap, XKB_KEYMAP_FORMAT_TEXT_V1);
+  xkb_keymap_unref (keymap);
+  g_assert_cmpint (count_cached_keymaps (), ==, n_cached + 1);
+
+  /* Drop the in memory copy so the keymap is loaded from disk */
+  phoc_keymap_cache_clear (cache);
+  keymap = phoc_keymap_cache_lookup (cache, &names);
+  g_assert_nonnull (keymap);
+  loaded = xkb_keymap_get_as_string (keymap, XKB_KEYMAP_FORMAT_TEXT_V1);
+  xkb_keymap_unref (keymap);
+  g_assert_cmpint (count_cached_keymaps (), ==, n_cached + 1);
+  g_assert_cmpstr (compiled, ==, loaded);
+
+  phoc_keymap_cache_clear (cache);
+}
+
+gint
+main (gint argc, gchar *argv[])
+{
+  g_autofree char *cache_dir = NULL;
+  int ret;
+
+  g_test_init (&argc, &argv, NULL);
+
+  /* Start with an empty on disk cache */
+  cache_dir = g_dir_make_tmp ("phoc-test-keymap-cache-XXXXXX", NULL);
+  g_assert_nonnull (cache_dir);
+  g_setenv ("XDG_CACHE_HOME", cache_dir, TRUE);
+
+  g_test_add_func ("/phoc/keymap-cache/shared", test_phoc_keymap_cache_shared);
+  g_test_add_func ("/phoc/keymap-cache/null-names", test_phoc_keymap_cache_null_names);
+  g_test_add_func ("/phoc/keymap-cache/persist", test_phoc_keymap_cache_persist);
+
+  ret = g_test_run ();
+
+  g_object_unref (phoc_keymap_cache_get_default ());
+  remove_dir (cache_dir);
+  return ret;
+}
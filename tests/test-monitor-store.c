@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2021 Purism SPC
+ * SPDX-License-Identifier: GPL-3.0+
+ */
+
+#include "monitor-store.h"
+
+#include <glib/gstdio.h>
+#include <string.h>
+
+static char *config_dir;
+
+static void
+init_output (struct wlr_output *wlr_output, const char *make, const char *model)
+{
+  memset (wlr_output, 0, sizeof (*wlr_output));
+  g_strlcpy (wlr_output->name, "HDMI-A-1", sizeof (wlr_output->name));
+  g_strlcpy (wlr_output->make, make, sizeof (wlr_output->make));
+  g_strlcpy (wlr_output->model, model, sizeof (wlr_output->model));
+  wlr_output->enabled = true;
+  wlr_output->width = 1920;
+  wlr_output->height = 1080;
+  wlr_output->refresh = 60000;
+  wlr_output->scale = 1.5;
+  wlr_output->transform = WL_OUTPUT_TRANSFORM_90;
+}
+
+static void
+test_phoc_monitor_store_round_trip (void)
+{
+  PhocMonitorStore *store = phoc_monitor_store_get_default ();
+  g_autofree char *path = g_build_filename (config_dir, "phoc", "monitors.ini", NULL);
+  struct wlr_output wlr_output;
+  PhocMonitorConfig config = { 0 };
+
+  init_output (&wlr_output, "Foo", "Bar 27");
+  g_assert_false (phoc_monitor_store_lookup (store, &wlr_output, &config));
+
+  phoc_monitor_store_update (store, &wlr_output, 720, 0);
+  /* Nothing hits the disk before saving */
+  g_assert_false (g_file_test (path, G_FILE_TEST_EXISTS));
+  phoc_monitor_store_save (store);
+  g_assert_true (g_file_test (path, G_FILE_TEST_EXISTS));
+
+  /* Reload from disk */
+  g_object_unref (store);
+  store = phoc_monitor_store_get_default ();
+
+  g_assert_true (phoc_monitor_store_lookup (store, &wlr_output, &config));
+  g_assert_true (config.enabled);
+  g_assert_cmpint (config.width, ==, 1920);
+  g_assert_cmpint (config.height, ==, 1080);
+  g_assert_cmpint (config.refresh, ==, 60000);
+  g_assert_cmpfloat_with_epsilon (config.scale, 1.5, 0.0001);
+  g_assert_cmpint (config.transform, ==, WL_OUTPUT_TRANSFORM_90);
+  g_assert_cmpint (config.x, ==, 720);
+  g_assert_cmpint (config.y, ==, 0);
+
+  /* Disabling keeps the last mode */
+  wlr_output.enabled = false;
+  wlr_output.width = 0;
+  wlr_output.height = 0;
+  phoc_monitor_store_update (store, &wlr_output, 0, 0);
+  g_assert_true (phoc_monitor_store_lookup (store, &wlr_output, &config));
+  g_assert_false (config.enabled);
+  g_assert_cmpint (config.width, ==, 1920);
+  g_assert_cmpint (config.x, ==, 720);
+}
+
+static void
+test_phoc_monitor_store_unidentifiable (void)
+{
+  PhocMonitorStore *store = phoc_monitor_store_get_default ();
+  struct wlr_output wlr_output;
+  PhocMonitorConfig config = { 0 };
+
+  /* Monitors without EDID can't be told apart */
+  init_output (&wlr_output, "", "");
+  phoc_monitor_store_update (store, &wlr_output, 0, 0);
+  g_assert_false (phoc_monitor_store_lookup (store, &wlr_output, &config));
+}
+
+gint
+main (gint argc, gchar *argv[])
+{
+  g_autofree char *path = NULL;
+  g_autofree char *dir = NULL;
+  int ret;
+
+  g_test_init (&argc, &argv, NULL);
+
+  /* Start with an empty store */
+  config_dir = g_dir_make_tmp ("phoc-test-monitor-store-XXXXXX", NULL);
+  g_assert_nonnull (config_dir);
+  g_setenv ("XDG_CONFIG_HOME", config_dir, TRUE);
+
+  g_test_add_func ("/phoc/monitor-store/round-trip", test_phoc_monitor_store_round_trip);
+  g_test_add_func ("/phoc/monitor-store/unidentifiable", test_phoc_monitor_store_unidentifiable);
+
+  ret = g_test_run ();
+
+  g_object_unref (phoc_monitor_store_get_default ());
+  dir = g_build_filename (config_dir, "phoc", NULL);
+  path = g_build_filename (dir, "monitors.ini", NULL);
+  g_unlink (path);
+  g_rmdir (dir);
+  g_rmdir (config_dir);
+  g_free (config_dir);
+
+  return ret;
+}
@@ -0,0 +1,141 @@
+/*
+ * Copyright (C) 2021 Purism SPC
+ * SPDX-License-Identifier: GPL-3.0+
+ */
+
+#include "testlib.h"
+#include "output.h"
+
+#include <wayland-client-protocol.h>
+
+#define PANEL_HEIGHT 100
+#define RED 0xFFFF0000
+
+typedef struct _PhocTestPanel
+{
+  struct wl_surface *wl_surface;
+  struct zwlr_layer_surface_v1 *layer_surface;
+  PhocTestBuffer buffer;
+  guint32 width, height;
+  gboolean configured;
+} PhocTestPanel;
+
+static void
+panel_configure (void                         *data,
+                 struct zwlr_layer_surface_v1 *surface,
+                 uint32_t                      serial,
+                 uint32_t                      width,
+                 uint32_t                      height)
+{
+  PhocTestPanel *panel = data;
+
+  zwlr_layer_surface_v1_ack_configure (surface, serial);
+  panel->width = width;
+  panel->height = height;
+  panel->configured = TRUE;
+}
+
+static void
+panel_closed (void *data, struct zwlr_layer_surface_v1 *surface)
+{
+}
+
+static struct zwlr_layer_surface_v1_listener panel_listener = {
+  .configure = panel_configure,
+  .closed = panel_closed,
+};
+
+static guint32
+get_pixel (PhocTestBuffer *buffer, guint32 x, guint32 y)
+{
+  return *(guint32 *)(buffer->shm_data + y * buffer->stride + x * 4) & 0x00FFFFFF;
+}
+
+/*
+ * A red panel at the top must stay at the top when the scene is
+ * rendered offscreen and upscaled.
+ */
+static gboolean
+test_client_render_scale_orientation (PhocTestClientGlobals *globals, gpointer data)
+{
+  PhocTestPanel panel = { 0 };
+  PhocTestBuffer *screenshot;
+  guint32 w, h;
+
+  panel.wl_surface = wl_compositor_create_surface (globals->compositor);
+  panel.layer_surface = zwlr_layer_shell_v1_get_layer_surface (globals->layer_shell,
+                                                               panel.wl_surface,
+                                                               NULL,
+                                                               ZWLR_LAYER_SHELL_V1_LAYER_OVERLAY,
+                                                               "phoc-test");
+  zwlr_layer_surface_v1_set_size (panel.layer_surface, 0, PANEL_HEIGHT);
+  zwlr_layer_surface_v1_set_anchor (panel.layer_surface,
+                                    ZWLR_LAYER_SURFACE_V1_ANCHOR_TOP |
+                                    ZWLR_LAYER_SURFACE_V1_ANCHOR_LEFT |
+                                    ZWLR_LAYER_SURFACE_V1_ANCHOR_RIGHT);
+  zwlr_layer_surface_v1_add_listener (panel.layer_surface, &panel_listener, &panel);
+  wl_surface_commit (panel.wl_surface);
+  wl_display_dispatch (globals->display);
+  wl_display_roundtrip (globals->display);
+  g_assert_true (panel.configured);
+
+  phoc_test_client_create_shm_buffer (globals, &panel.buffer, panel.width, panel.height,
+                                      WL_SHM_FORMAT_XRGB8888);
+  for (guint i = 0; i < panel.width * panel.height * 4; i += 4)
+    *(guint32 *)(panel.buffer.shm_data + i) = RED;
+  wl_surface_attach (panel.wl_surface, panel.buffer.wl_buffer, 0, 0);
+  wl_surface_damage (panel.wl_surface, 0, 0, panel.width, panel.height);
+  wl_surface_commit (panel.wl_surface);
+  wl_display_dispatch (globals->display);
+  wl_display_roundtrip (globals->display);
+
+  screenshot = phoc_test_client_capture_output (globals, &globals->output);
+  w = screenshot->width;
+  h = screenshot->height;
+  g_assert_cmpuint (h, >, 4 * PANEL_HEIGHT);
+
+  /* Stay clear of the panel's border where upscaling blends colors */
+  g_assert_cmphex (get_pixel (screenshot, w / 2, PANEL_HEIGHT / 2), ==, RED & 0x00FFFFFF);
+  g_assert_cmphex (get_pixel (screenshot, w / 2, h - PANEL_HEIGHT / 2), !=, RED & 0x00FFFFFF);
+  phoc_test_buffer_free (screenshot);
+
+  zwlr_layer_surface_v1_destroy (panel.layer_surface);
+  wl_surface_destroy (panel.wl_surface);
+  phoc_test_buffer_free (&panel.buffer);
+
+  return TRUE;
+}
+
+static gboolean
+server_prepare_half_scale (PhocServer *server, gpointer data)
+{
+  PhocOutput *output;
+
+  g_assert_false (wl_list_empty (&server->desktop->outputs));
+  wl_list_for_each (output, &server->desktop->outputs, link)
+    phoc_output_set_render_scale (output, 0.5);
+
+  return TRUE;
+}
+
+static void
+test_render_scale_orientation (void)
+{
+  PhocTestClientIface iface = {
+    .server_prepare = server_prepare_half_scale,
+    .client_run = test_client_render_scale_orientation,
+  };
+
+  phoc_test_client_run (3, &iface, NULL);
+}
+
+
+gint
+main (gint argc, gchar *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/phoc/render-scale/orientation", test_render_scale_orientation);
+
+  return g_test_run ();
+}
@@ -293,6 +293,8 @@ static void registry_handle_global(void *data, struct wl_registry *registry,
 
   if (!g_strcmp0 (interface, wl_compositor_interface.name)) {
     globals->compositor = wl_registry_bind (registry, name, &wl_compositor_interface, 4);
+  } else if (!g_strcmp0 (interface, wl_subcompositor_interface.name)) {
+    globals->subcompositor = wl_registry_bind (registry, name, &wl_subcompositor_interface, 1);
   } else if (!g_strcmp0 (interface, wl_shm_interface.name)) {
     globals->shm = wl_registry_bind (registry, name, &wl_shm_interface, 1);
     wl_shm_add_listener (globals->shm, &shm_listener, globals);
@@ -317,6 +319,9 @@ static void registry_handle_global(void *data, struct wl_registry *registry,
 							  &zwlr_foreign_toplevel_manager_v1_interface, 2);
     zwlr_foreign_toplevel_manager_v1_add_listener (globals->foreign_toplevel_manager,
 						   &foreign_toplevel_manager_listener, globals);
+  } else if (!g_strcmp0 (interface, wp_fractional_scale_manager_v1_interface.name)) {
+    globals->fractional_scale_manager = wl_registry_bind (registry, name,
+							  &wp_fractional_scale_manager_v1_interface, 1);
   } else if (!g_strcmp0 (interface, phosh_private_interface.name)) {
     globals->phosh = wl_registry_bind (registry, name, &phosh_private_interface, 6);
   } else if (!g_strcmp0 (interface, gtk_shell1_interface.name)) {
@@ -6,6 +6,7 @@
 #include "server.h"
 
 #include <glib.h>
+#include "fractional-scale-v1-client-protocol.h"
 #include "gtk-shell-client-protocol.h"
 #include "xdg-shell-client-protocol.h"
 #include "wlr-foreign-toplevel-management-unstable-v1-client-protocol.h"
@@ -42,11 +43,13 @@ typedef struct _PhocTestOutput {
 typedef struct _PhocTestWlGlobals {
   struct wl_display *display;
   struct wl_compositor *compositor;
+  struct wl_subcompositor *subcompositor;
   struct wl_shm *shm;
   struct xdg_wm_base *xdg_shell;
   struct zwlr_layer_shell_v1 *layer_shell;
   struct zwlr_screencopy_manager_v1 *screencopy_manager;
   struct zwlr_foreign_toplevel_manager_v1 *foreign_toplevel_manager;
+  struct wp_fractional_scale_manager_v1 *fractional_scale_manager;
   GSList *foreign_toplevels;
   struct phosh_private *phosh;
   struct gtk_shell1 *gtk_shell1;